@@ -20,11 +20,6 @@
 // stb
 #include <stb_image_write.h>
 
-// openmp
-#ifdef CGRA_HAVE_OPENMP
-#include <omp.h>
-#endif // CGRA_HAVE_OPENMP
-
 // project
 #include "opengl.hpp"
 #include "application.hpp"
@@ -154,8 +149,8 @@ Application::~Application() {
 	glDeleteTextures(1, &m_render_texture_front);
 	glDeleteBuffers(1, &m_render_pbo);
 	glDeleteFramebuffers(1, &m_render_fbo);
-	m_should_exit = true;
-	m_raytrace_thread.join();
+	m_background.reset();
+	stop();
 }
 
 
@@ -190,7 +185,10 @@ void Application::render() {
 
 	// update camera
 	updateCameraMovement(width, height);
-	if (m_restart_render) start();
+	if (m_restart_render) {
+		m_view_version++;
+		start(true);
+	}
 
 	glActiveTexture(GL_TEXTURE0);
 
@@ -204,6 +202,9 @@ void Application::render() {
 		// swap buffers (start displaying previous upload)
 		swap(m_render_texture_back, m_render_texture_front);
 
+		// show the denoised render once it is ready
+		const PixelBuffer &upload_data = (m_denoise && m_denoised_ready) ? m_denoised_data : m_render_data;
+
 		// upload new data, use pbo for async
 		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_render_pbo);
 		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_render_data.size() * sizeof(pixel), nullptr, GL_STREAM_DRAW);
@@ -213,7 +214,7 @@ void Application::render() {
 			m_render_data.size() * sizeof(pixel),
 			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
 		));
-		copy(m_render_data.begin(), m_render_data.end(), pbodata);
+		copy(upload_data.begin(), upload_data.end(), pbodata);
 		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
 		glBindTexture(GL_TEXTURE_2D, m_render_texture_back);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, m_render_width, m_render_height, 0, GL_RGBA, GL_FLOAT, nullptr);
@@ -304,19 +305,13 @@ void Application::renderGUI() {
 		m_restart_render = true;
 	}
 
-	static int scene_index = -1;
-	if (ImGui::Combo("Scene", &scene_index, "Simple Test\0Light Test\0Material Test\0Shape Test\0Cornell Box\0", 4)) {
-		stop();
-		switch (scene_index) {
-		case 0: m_scene = Scene::simpleScene(); break;
-		case 1: m_scene = Scene::lightScene(); break;
-		case 2: m_scene = Scene::materialScene(); break;
-		case 3: m_scene = Scene::shapeScene(); break;
-		case 4: m_scene = Scene::cornellBoxScene(); break;
-		}
-		
-		m_restart_render = true;
-		start();
+	// moving previews are traced at a reduced scale to hold this frame time
+	float preview_ms = m_preview.m_target_frame_time * 1000;
+	if (ImGui::SliderFloat("Preview frame (ms)", &preview_ms, 5, 200, "%.0f")) m_preview.m_target_frame_time = preview_ms / 1000;
+	if (m_preview_mode) ImGui::Text("Preview scale 1/%d (%.2f Msamples/s)", m_preview.scale(), m_preview.samplesPerSecond() * 1e-6f);
+
+	if (ImGui::Combo("Scene", &m_scene_index, "Simple Test\0Light Test\0Material Test\0Shape Test\0Cornell Box\0Area Lights\0Sky\0", 4)) {
+		m_scene_changed = true;
 	}
 
 	static int pathtracer_index = 0;
@@ -328,12 +323,44 @@ void Application::renderGUI() {
 		case 2: m_pathtracer = make_unique<CompletionPathTracer>(&m_scene); break;
 		case 3: m_pathtracer = make_unique<ChallengePathTracer>(&m_scene); break;
 		}
+		m_replicas.clear();
 		m_restart_render = true;
 		start();
 	}
 
+	// node format of the scene bvh, with its memory use to choose by
+	static int bvh_index = 0;
+	if (ImGui::Combo("BVH", &bvh_index, "Wide\0Compressed\0", bvh_format_count)) {
+		m_bvh_options.format = BVHFormat(bvh_index);
+		m_bvh_changed = true;
+	}
+	static int bvh_quality_index = bvh_sah;
+	if (ImGui::Combo("BVH build", &bvh_quality_index, "Fast\0SAH\0", bvh_quality_count)) {
+		m_bvh_options.quality = BVHQuality(bvh_quality_index);
+		m_bvh_changed = true;
+	}
+	if (ImGui::Checkbox("Spatial splits", &m_spatial_splits)) {
+		m_bvh_options.split_budget = m_spatial_splits ? m_split_budget : 0;
+		m_bvh_changed = true;
+	}
+
+	// build changes one at a time, swapping each in once ready
+	if (m_scene_built.valid() && m_scene_built.wait_for(0s) == future_status::ready) finishScene();
+	if ((m_scene_changed || m_bvh_changed) && !m_scene_built.valid()) buildScene();
+	if (m_scene_built.valid()) {
+		ImGui::Text("Building scene...");
+	} else {
+		ImGui::Text("BVH %.1f bytes per primitive, built in %.1f ms", m_scene.bvh().bytesPerPrimitive(), m_scene.buildSeconds() * 1000);
+	}
+
 	ImGui::SliderFloat("Exposure", &m_exposure, 0, 100.0, "%.1f", 3.f);
 
+	// denoise straight away if the render has already finished
+	if (ImGui::Checkbox("Denoise", &m_denoise) && m_denoise && !m_denoised_ready && !rendering()) {
+		stop();
+		denoise();
+	}
+
 
 	// screen shots
 	static char filename[1024] = "";
@@ -347,12 +374,48 @@ void Application::renderGUI() {
 			ImGui::CloseCurrentPopup();
 		}
 		ImGui::SameLine();
+		// hdr images are written straight from the render data, so only
+		// once it has stopped changing
+		if (!rendering() && !m_hdr_written.valid()) {
+			if (ImGui::Button("Save EXR")) {
+				saveHDR(string(filename) + ".exr");
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Save PFM")) {
+				saveHDR(string(filename) + ".pfm");
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::SameLine();
+		}
 		if (ImGui::Button("Close")) {
 			ImGui::CloseCurrentPopup();
 		}
 		ImGui::EndPopup();
 	}
 
+	// report a finished hdr write
+	if (m_hdr_written.valid() && m_hdr_written.wait_for(0s) == future_status::ready) finishHDR();
+
+
+	ImGui::Separator();
+
+	ImGui::Text("Background Render");
+
+	// renders the current view while the interactive render carries on
+	ImGui::InputInt("Samples##background", &m_background_samples);
+	if (!m_background) {
+		static const char *pathtracer_names[] = { "simple", "core", "completion", "challenge" };
+		if (ImGui::Button("Render view to background.exr", ImVec2(-1, 0))) startBackground(pathtracer_names[pathtracer_index]);
+	}
+	else {
+		RenderProgress progress = m_background->job().progress();
+		ImGui::ProgressBar((progress.m_passes + progress.m_pass_fraction) / max(progress.m_total_passes, 1), ImVec2(-60, 0));
+		ImGui::SameLine();
+		if (ImGui::Button("Cancel")) m_background->job().cancel();
+		finishBackground();
+	}
+
 
 
 	ImGui::Separator();
@@ -367,6 +430,20 @@ void Application::renderGUI() {
 	ImGui::SliderFloat("Samples", &samples, 1, 10000, "%.0f", 5.f);
 	ImGui::SliderInt("Ray depth", &ray_depth, 0, 10);
 
+	// sorting the reflections of each chunk of pixels, with the time to
+	// trace them since it last changed to compare by
+	static bool sort_rays = m_sort_rays;
+	if (ImGui::Checkbox("Sort secondary rays", &sort_rays)) {
+		stop();
+		m_sort_rays = sort_rays;
+		RayStats::reset();
+		m_restart_render = true;
+		start();
+	}
+	const RayStats rays = RayStats::total();
+	ImGui::Text("%.1f ns per secondary ray (%ld rays)", rays.m_secondary ? rays.m_secondary_seconds / rays.m_secondary * 1e9 : 0.0, rays.m_secondary);
+	ImGui::Text("Occluder cache %.1f%% hits, %.3g steps saved", rays.occluderHitRate() * 100, rays.occluderStepsSaved());
+
 	if (ImGui::Button("Force Restart", ImVec2(-1, 0))) {
 		stop();
 		resize(size[0], size[1]);
@@ -476,50 +553,194 @@ void Application::resize(int w, int h) {
 		m_render_height = h;
 
 		m_camera->setImageSize({w, h});
-
-		// setup shuffle table
+		finishHDR();
+		m_framebuffer.configure(w, h, Denoiser::features | TemporalHistory::features, 0, false);
+		m_render_data = PixelBuffer(w * h);
+		m_sample_counts.clear();
+		m_sample_counts.shrink_to_fit();
+		m_sample_counts.resize(w * h);
+
+		// setup shuffle table, shuffling within the partition of each node
+		RenderPool &pool = RenderPool::shared();
+		minstd_rand randgen;
 		m_shuffle_table.resize(w * h);
 		std::iota(m_shuffle_table.begin(), m_shuffle_table.end(), 0);
-		std::shuffle(m_shuffle_table.begin(), m_shuffle_table.end(), minstd_rand());
+		for (int node = 0; node < pool.nodes(); node++) {
+			int begin, end;
+			pool.partition(w * h, node, begin, end);
+			std::shuffle(m_shuffle_table.begin() + begin, m_shuffle_table.begin() + end, randgen);
+		}
 	}
 
-	// clear pixel data
-	m_render_data.assign(w*h, {});
+	// clear pixel data, on the node that renders it
+	RenderPool::shared().parallelFor(w * h, 4096, render_priority_interactive, 0, [&](int begin, int end) {
+		std::fill(m_render_data.begin() + begin, m_render_data.begin() + end, pixel{});
+		std::fill(m_sample_counts.begin() + begin, m_sample_counts.begin() + end, 0.f);
+		m_framebuffer.clear(begin, end);
+	}, true);
+	m_accumulated = false;
+	m_history.clear();
 }
 
 
-void Application::start() {
-	if (m_raytrace_thread.joinable()) {
-		if (m_should_exit) {
+void Application::start(bool reproject) {
+	if (m_job) {
+		if (m_job->done()) {
 			stop();
 		} else {
 			return;
 		}
 	}
-	// restarting the thread, so ensure image is the right size
+	// restarting the render, so ensure image is the right size
 	// (but don't bother clearing it, shuffle index randomization means it basically isnt necessary)
+	finishHDR();
 	m_render_data.resize(m_render_width * m_render_height);
-	m_should_exit = false;
+	m_sample_counts.resize(m_render_width * m_render_height);
+	if (!reproject) {
+		m_accumulated = false;
+		m_history.clear();
+	}
+	m_denoised_ready = false;
 	m_sample_pass_count = 0;
 	m_sample_pixel_count = 0;
-	m_raytrace_thread = thread([this]() { runPathTraceIntegrator(); });
+	m_replicas.update(*m_pathtracer, RenderPool::shared());
+	m_job = make_unique<RenderJob>([this](RenderJob &job) { runPathTraceIntegrator(job); }, render_priority_interactive);
 }
 
 void Application::stop() {
-	m_should_exit = true;
-	if (m_raytrace_thread.joinable()) m_raytrace_thread.join();
+	if (!m_job) return;
+	m_job->cancel();
+	m_job->wait();
+	m_job.reset();
 }
 
 
+void Application::saveHDR(const std::string &filename) {
+	ImageView image;
+	if (filename.size() > 4 && filename.substr(filename.size() - 4) == ".exr") {
+		image = framebufferImage(m_framebuffer, aovBit(aov_albedo) | aovBit(aov_normal) | aovBit(aov_depth));
+	}
+	image.m_width = m_render_width;
+	image.m_height = m_render_height;
+
+	const PixelBuffer &data = (m_denoise && m_denoised_ready) ? m_denoised_data : m_render_data;
+	image.m_channels.insert(image.m_channels.begin(), {
+		{ "R", &data[0].r, 4 }, { "G", &data[0].g, 4 }, { "B", &data[0].b, 4 }
+	});
 
-void Application::runPathTraceIntegrator() {
+	m_hdr_filename = filename;
+	m_hdr_written = writeHDRAsync(filename, image);
+}
+
+
+void Application::buildScene() {
+	// rebuild a copy of the current scene for option changes, taken here
+	// as nothing changes it while rendering
+	const int index = m_scene_changed ? m_scene_index : -1;
+	Scene scene;
+	if (index < 0) scene = m_scene;
+	m_scene_built = async(launch::async, [index, options = m_bvh_options, scene = std::move(scene)]() mutable {
+		switch (index) {
+		case 0: scene = Scene::simpleScene(); break;
+		case 1: scene = Scene::lightScene(); break;
+		case 2: scene = Scene::materialScene(); break;
+		case 3: scene = Scene::shapeScene(); break;
+		case 4: scene = Scene::cornellBoxScene(); break;
+		case 5: scene = Scene::areaLightScene(); break;
+		case 6: scene = Scene::skyScene(); break;
+		}
+		scene.setBVHOptions(options);
+		return std::move(scene);
+	});
+	m_scene_changed = false;
+	m_bvh_changed = false;
+}
+
+
+void Application::finishScene() {
+	if (!m_scene_built.valid()) return;
+	Scene scene = m_scene_built.get();
+	stop();
+	m_scene = std::move(scene);
+	m_replicas.clear();
+	m_restart_render = true;
+	start();
+}
+
+
+void Application::finishHDR() {
+	if (!m_hdr_written.valid()) return;
+	if (m_hdr_written.get()) {
+		std::cout << "Wrote image: " << m_hdr_filename << std::endl;
+	}
+	else {
+		std::cerr << "Failed to write image: " << m_hdr_filename << std::endl;
+	}
+}
+
+
+void Application::startBackground(const std::string &pathtracer) {
+	RenderSettings settings;
+	settings.m_pathtracer = pathtracer;
+	settings.m_width = m_render_width;
+	settings.m_height = m_render_height;
+	settings.m_samples = max(m_background_samples, 1);
+	settings.m_ray_depth = m_render_ray_depth;
+	settings.m_sort_rays = m_sort_rays;
+	settings.m_camera_position = m_camera->position();
+	settings.m_camera_yaw = m_camera->yaw();
+	settings.m_camera_pitch = m_camera->pitch();
+
+	m_background.reset();
+	m_background_scene = make_unique<Scene>(m_scene);
+	m_background_pathtracer = makePathTracer(pathtracer, m_background_scene.get());
+	m_background = make_unique<FrameJob>(settings, *m_background_pathtracer, int(m_scene.lights().size()));
+}
+
+
+void Application::finishBackground() {
+	if (!m_background || !m_background->job().done()) return;
+
+	// written like a saved hdr image, a cancelled render is dropped
+	if (!m_background->job().progress().m_cancelled && !m_hdr_written.valid()) {
+		try {
+			m_background_result = m_background->result();
+			m_hdr_filename = m_background_filename;
+			m_hdr_written = writeHDRAsync(m_hdr_filename, framebufferImage(m_background_result, aovBit(aov_color)));
+		}
+		catch (exception &e) {
+			std::cerr << "Background render failed: " << e.what() << std::endl;
+		}
+	}
+	else if (!m_background->job().progress().m_cancelled) {
+		// wait for the last write to finish
+		return;
+	}
+	m_background.reset();
+	m_background_pathtracer.reset();
+	m_background_scene.reset();
+}
+
+
+void Application::denoise() {
+	// copy to keep the pixel timestamps
+	m_denoised_data = m_render_data;
+	m_denoiser.denoise(m_framebuffer, m_sample_pass_count, &m_render_data[0].r, 4, &m_denoised_data[0].r, 4,
+		RenderPool::shared(), render_priority_interactive);
+	m_denoised_ready = true;
+}
+
+
+
+void Application::runPathTraceIntegrator(RenderJob &job) {
 	
 	// was any rendering done in preview mode?
 	bool was_preview = false;
 
-	// count 'idle' preview frames so we can exit instead of spinning uselessly
-	int idle_preview_frames = 0;
-	int preview_frames = 0;
+	// in preview mode, the view last rendered and whether it has been
+	// refined to all passes at full resolution, which ends the preview
+	int view_version = -1;
+	bool refined = false;
 
 	// we can't break out of an openmp loop
 	// so we have a variable that gets checked
@@ -527,11 +748,22 @@ void Application::runPathTraceIntegrator() {
 	bool cancel_for = false;
 
 	do {
-		// stop rendering
-		if (idle_preview_frames > 15) break;
-
 		was_preview = m_preview_mode;
 
+		// moving views are rendered at a reduced scale that holds the frame time,
+		// which is then refined back to full resolution once the view stops
+		const bool moving = view_version != m_view_version;
+		view_version = m_view_version;
+		const int scale = was_preview ? m_preview.next(m_render_width, m_render_height, moving) : 1;
+
+		// the view of this frame, the camera keeps moving in preview mode
+		Camera camera = *m_camera;
+
+		// keep the last render as history to reuse its samples in the new view
+		if (was_preview && moving && m_accumulated) {
+			m_history.store(m_accumulated_camera, m_framebuffer, &m_render_data[0].r, 4, m_sample_counts.data());
+		}
+
 		// reset time variables
 		m_end_time = chrono::steady_clock::now() - 1ms;
 		m_start_time = chrono::steady_clock::now();
@@ -542,69 +774,140 @@ void Application::runPathTraceIntegrator() {
 
 		cancel_for = false;
 
-		// for each sample
-		for (m_sample_pass_count = 0; m_sample_pass_count < (was_preview ? 1 : m_render_perpixel_samples) && !cancel_for; m_sample_pass_count++) {
-
-			m_sample_pixel_count = 0;
-
-			// for each pixel
-			// use 1 fewer threads in preview mode to maintain responsiveness
-#pragma omp parallel for num_threads(max(omp_get_max_threads() - was_preview, 1))
-			for (int i = 0; i < int(m_render_data.size()); ++i) {
-				if (!cancel_for) {
-					int idx = m_shuffle_table[(i + preview_frames * 9001) % m_render_data.size()];
-
-					// calculate the pixel coordinate
-					glm::vec2 screen_coord(idx % m_render_width, idx / m_render_width);
-
-					// calculate some jitter
-					// glm's random is implemented with rand(), which is terrible
-					static thread_local minstd_rand randgen{std::random_device()()};
-					uniform_real_distribution<float> dist{0, 1};
-					glm::vec2 rand = glm::vec2(dist(randgen), dist(randgen));
-					// reduce jitter for initial samples, improves results for low sample counts
-					rand = (rand - 0.5f) * (1.f - exp(float(m_sample_pass_count) * -0.4f)) + 0.5f;
-
-
-					// The actual raytracing commands!!!
-					// create the ray and trace the scene
-					Ray ray = m_camera->generateRay(screen_coord + rand);
-					glm::vec3 sample_color = m_pathtracer->sampleRay(ray, m_render_ray_depth);
-
-
-					// mix with the existing color
-					float sample_mix_factor = m_sample_pass_count / float(m_sample_pass_count + 1);
-					glm::vec3 running_mean_color(m_render_data[idx].r, m_render_data[idx].g, m_render_data[idx].b);
-					glm::vec3 final_color = glm::mix(sample_color, running_mean_color, sample_mix_factor);
-
-					// record final color and increase sample count
-					m_render_data[idx] = {final_color.r, final_color.g, final_color.b, m_frame_time};
-					m_sample_pixel_count++;
-
-					// check cancel things every some number of pixels
-					if ((i & 0xFF) == 0) {
-						cancel_for |= m_should_exit;
-						// if preview needs restarting, bail after 30ms to maintain ~30Hz
-						if (m_preview_mode && m_restart_render) {
-							was_preview = true;
-							if (chrono::steady_clock::now() - m_start_time > 30ms) cancel_for = true;
-						}
-					}
-				}
-			}
+		if (scale > 1) {
+			runPreviewFrame(job, camera, scale, cancel_for);
+		} else {
+			runFullFrame(job, camera, was_preview, view_version, cancel_for);
+			refined = !cancel_for;
 		}
 
 		m_end_time = chrono::steady_clock::now();
-		preview_frames += was_preview;
-		if (m_preview_mode && m_restart_render) {
-			idle_preview_frames = 0;
-		} else {
-			idle_preview_frames++;
-		}
 
 		// exit after proper render or if requested
-	} while ((was_preview || m_preview_mode) && !m_should_exit);
+	} while ((was_preview || m_preview_mode) && !refined && !job.cancelled());
 
-	// we'll abuse this to indicate the thread has exited normally too
-	m_should_exit = true;
+	// denoise as a final stage of a completed render
+	if (m_denoise && !cancel_for && !job.cancelled()) denoise();
+}
+
+
+void Application::runPreviewFrame(RenderJob &job, Camera &camera, int scale, bool &cancel_for) {
+	const int lw = (m_render_width + scale - 1) / scale;
+	const int lh = (m_render_height + scale - 1) / scale;
+	m_preview_color.resize(lw * lh);
+	m_preview_depth.resize(lw * lh);
+	m_sample_pass_count = 0;
+	m_sample_pixel_count = 0;
+
+	// the upsampled frame replaces the accumulated render
+	m_accumulated = false;
+
+	// one sample per scale x scale block
+	// use 1 fewer threads in preview mode to maintain responsiveness
+	job.parallelForBatches(lw * lh, [&](int begin, int end) {
+		if (cancel_for) return;
+		Ray *rays = scratchArena().allocate<Ray>(end - begin);
+		for (int i = begin; i < end; i++) {
+			// jittered within the block (clipped to the image)
+			glm::vec2 block(i % lw * scale, i / lw * scale);
+			glm::vec2 size = glm::min(glm::vec2(m_render_width, m_render_height) - block, glm::vec2(scale));
+			static thread_local minstd_rand randgen{std::random_device()()};
+			uniform_real_distribution<float> dist{0, 1};
+			glm::vec2 rand = glm::vec2(dist(randgen), dist(randgen));
+			rays[i - begin] = camera.generateRay(block + rand * size);
+		}
+
+		SampleBatch batch(end - begin);
+		m_replicas.local().sampleRays(rays, end - begin, m_render_ray_depth, batch.m_colors, batch.m_records, m_sort_rays);
+		for (int i = begin; i < end; i++) {
+			m_preview_color[i] = batch.m_colors[i - begin];
+			m_preview_depth[i] = batch.m_records[i - begin].m_depth;
+		}
+		m_sample_pixel_count += (end - begin) * scale * scale;
+		cancel_for |= job.cancelled();
+	}, max(RenderPool::shared().size() - 1, 1));
+	if (cancel_for) return;
+
+	m_preview.record(lw * lh, float((chrono::steady_clock::now() - m_start_time) / 1.0s));
+
+	// the whole image is replaced, so stamp it all as current
+	upsamplePreview(m_render_width, m_render_height, scale, m_preview_color.data(), m_preview_depth.data(), &m_render_data[0].r, 4,
+		job.pool(), job.priority());
+	for (pixel &p : m_render_data) p.time = m_frame_time;
+}
+
+
+void Application::runFullFrame(RenderJob &job, Camera &camera, bool preview, int view_version, bool &cancel_for) {
+	// the first pass starts each pixel from its reprojected history, if any
+	const bool reproject = preview && m_history.valid();
+	m_accumulated = false;
+	m_accumulated_camera = camera;
+
+	// for each sample
+	for (m_sample_pass_count = 0; m_sample_pass_count < m_render_perpixel_samples && !cancel_for; m_sample_pass_count++) {
+
+		m_sample_pixel_count = 0;
+		const auto pass_start = chrono::steady_clock::now();
+
+		// for each pixel
+		// use 1 fewer threads in preview mode to maintain responsiveness
+		job.parallelForBatches(int(m_render_data.size()), [&](int begin, int end) {
+			if (cancel_for) return;
+			Ray *rays = scratchArena().allocate<Ray>(end - begin);
+			for (int i = begin; i < end; i++) {
+				int idx = m_shuffle_table[i];
+
+				// calculate the pixel coordinate
+				glm::vec2 screen_coord(idx % m_render_width, idx / m_render_width);
+
+				// calculate some jitter
+				// glm's random is implemented with rand(), which is terrible
+				static thread_local minstd_rand randgen{std::random_device()()};
+				uniform_real_distribution<float> dist{0, 1};
+				glm::vec2 rand = glm::vec2(dist(randgen), dist(randgen));
+				// reduce jitter for initial samples, improves results for low sample counts
+				rand = (rand - 0.5f) * (1.f - exp(float(m_sample_pass_count) * -0.4f)) + 0.5f;
+
+				rays[i - begin] = camera.generateRay(screen_coord + rand);
+			}
+
+			// The actual raytracing commands!!!
+			// trace the rays of the chunk into the scene together
+			SampleBatch batch(end - begin);
+			m_replicas.local().sampleRays(rays, end - begin, m_render_ray_depth, batch.m_colors, batch.m_records, m_sort_rays);
+
+			for (int i = begin; i < end; i++) {
+				int idx = m_shuffle_table[i];
+				const glm::vec3 &sample_color = batch.m_colors[i - begin];
+				const SampleRecord &record = batch.m_records[i - begin];
+
+				// mix with the existing color
+				float &samples = m_sample_counts[idx];
+				if (m_sample_pass_count == 0) samples = reproject ? m_history.reproject(record, camera.position(), idx, m_framebuffer, &m_render_data[0].r, 4) : 0;
+				float sample_mix_factor = samples / (samples + 1);
+				glm::vec3 running_mean_color(m_render_data[idx].r, m_render_data[idx].g, m_render_data[idx].b);
+				glm::vec3 final_color = glm::mix(sample_color, running_mean_color, sample_mix_factor);
+				m_framebuffer.accumulate(idx, sample_color, record, sample_mix_factor);
+
+				// record final color and increase sample count
+				m_render_data[idx] = {final_color.r, final_color.g, final_color.b, m_frame_time};
+				samples += 1;
+			}
+			m_sample_pixel_count += end - begin;
+
+			// check cancel things every chunk
+			cancel_for |= job.cancelled();
+			// a preview goes back to a reduced scale once the view has changed, after
+			// the frame time so passes at full resolution complete (to become history)
+			if (preview && view_version != m_view_version) {
+				cancel_for |= chrono::steady_clock::now() - m_start_time > chrono::duration<float>(m_preview.m_target_frame_time.load());
+			}
+		}, max(RenderPool::shared().size() - preview, 1));
+
+		if (!cancel_for) {
+			m_accumulated = true;
+			m_preview.record(long(m_render_data.size()), float((chrono::steady_clock::now() - pass_start) / 1.0s));
+			job.setPasses(m_sample_pass_count + 1, m_render_perpixel_samples);
+		}
+	}
 }
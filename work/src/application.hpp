@@ -3,13 +3,20 @@
 
 // std
 #include <atomic>
-#include <thread>
+#include <future>
+#include <memory>
+#include <string>
 
 // glm
 #include <glm.hpp>
 
 // project
 #include "opengl.hpp"
+#include "render/denoiser.hpp"
+#include "render/hdr_image.hpp"
+#include "render/preview.hpp"
+#include "render/render_job.hpp"
+#include "render/reprojection.hpp"
 #include "scene/path_tracer.hpp"
 #include "scene/scene.hpp"
 #include "scene/camera.hpp"
@@ -28,18 +35,24 @@ private:
 	int m_render_width = 0, m_render_height = 0; // current render size
 	int m_render_perpixel_samples = 1;
 	int m_render_ray_depth = 2;
+	bool m_sort_rays = false; // reorder each batch of secondary rays before tracing it
 
 	// render data
 	float m_exposure = 1.0;
+	// pixel buffers are first touched (cleared) by the render pool, each
+	// numa node its partition of the pixels, which the shuffle table keeps
+	// to that node's threads
 	struct pixel { float r, g, b, time; };
-	std::vector<pixel> m_render_data;
+	using PixelBuffer = std::vector<pixel, UninitializedAllocator<pixel>>;
+	PixelBuffer m_render_data;
 	std::vector<int> m_shuffle_table;
+	Framebuffer m_framebuffer; // aovs other than color (denoiser and history features)
+	std::vector<float, UninitializedAllocator<float>> m_sample_counts; // per pixel, history included
 	int m_sample_pass_count = 0;
 	std::atomic<int> m_sample_pixel_count{0};
 
-	// render thread and state
-	std::thread m_raytrace_thread;
-	std::atomic<bool> m_should_exit{false};
+	// render job and state, the job runs on the shared render pool
+	std::unique_ptr<RenderJob> m_job;
 	std::chrono::time_point<std::chrono::steady_clock> m_start_time;
 	std::chrono::time_point<std::chrono::steady_clock> m_end_time;
 	float m_frame_time = 0;
@@ -47,6 +60,27 @@ private:
 	// preview state
 	bool m_preview_mode = false;
 	bool m_restart_render = false;
+	std::atomic<int> m_view_version{0}; // changes with every restart
+	PreviewController m_preview;
+	std::vector<glm::vec3> m_preview_color; // reduced scale frame
+	std::vector<float> m_preview_depth;
+
+	// the accumulated render is of m_accumulated_camera's view, and is
+	// kept as history (in preview mode) to reproject when the view changes
+	bool m_accumulated = false;
+	Camera m_accumulated_camera;
+	TemporalHistory m_history;
+
+	// denoising of the finished render, displayed instead
+	// of m_render_data once ready (if enabled)
+	bool m_denoise = false;
+	Denoiser m_denoiser;
+	PixelBuffer m_denoised_data;
+	std::atomic<bool> m_denoised_ready{false};
+
+	// hdr image being written in the background from the render data
+	std::future<bool> m_hdr_written;
+	std::string m_hdr_filename;
 
 	// gl handles
 	GLuint m_filter_prog = 0, m_display_prog = 0;
@@ -57,8 +91,29 @@ private:
 
 	// scene
 	Scene m_scene;
+	int m_scene_index = -1; // of the scenes in the gui, -1 for none chosen yet
+	BVHOptions m_bvh_options;
+	bool m_spatial_splits = false; // build a split bvh
+	float m_split_budget = 0.3f; // duplicate references allowed, relative to the objects
+
+	// changes to the scene are built in the background, rendering the
+	// current one until it replaces it (and later changes wait for it)
+	bool m_scene_changed = false; // to another of the scenes
+	bool m_bvh_changed = false; // options only
+	std::future<Scene> m_scene_built;
 	std::unique_ptr<Camera> m_camera = nullptr;
 	std::unique_ptr<PathTracer> m_pathtracer = nullptr;
+	PathTracerReplicas m_replicas; // of m_pathtracer, per numa node
+
+	// final render of the current view on the same pool as the interactive
+	// render, at a lower priority so it only uses the cores that leaves idle.
+	// it has its own copy of the scene so the scene can change meanwhile
+	int m_background_samples = 256;
+	std::string m_background_filename = "background.exr";
+	std::unique_ptr<Scene> m_background_scene;
+	std::unique_ptr<PathTracer> m_background_pathtracer;
+	std::unique_ptr<FrameJob> m_background;
+	Framebuffer m_background_result; // being written
 
 	// updates the cameras position and rotation
 	// if preview mode is enabled
@@ -67,13 +122,32 @@ private:
 	// saves a png screenshot of the current rendering
 	void screenshot(const std::string &filename);
 
+	// starts writing the linear render (and features if an exr) to
+	// an exr or pfm image, finishHDR waits for it and reports the result
+	void saveHDR(const std::string &filename);
+	void finishHDR();
+
+	// start building the changed scene in the background, finishScene
+	// replaces the current scene with it and restarts the render
+	void buildScene();
+	void finishScene();
+
 	// helper functions for running integration
 	void resize(int w, int h);
-	void start();
+	void start(bool reproject = false); // reproject the last render (camera moves only)
 	void stop();
-
-	// thread only function
-	void runPathTraceIntegrator();
+	bool rendering() const { return m_job && !m_job->done(); }
+	void denoise();
+
+	// start a background render with the current settings, finishBackground
+	// writes it out once it is done
+	void startBackground(const std::string &pathtracer);
+	void finishBackground();
+
+	// render job only functions
+	void runPathTraceIntegrator(RenderJob &job);
+	void runPreviewFrame(RenderJob &job, Camera &camera, int scale, bool &cancel_for);
+	void runFullFrame(RenderJob &job, Camera &camera, bool preview, int view_version, bool &cancel_for);
 
 
 public:
@@ -0,0 +1,569 @@
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <utility>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// glm
+#include <glm.hpp>
+
+// stb
+#include <stb_image_write.h>
+
+// project
+#include "headless.hpp"
+#include "render/denoiser.hpp"
+#include "render/framebuffer.hpp"
+#include "render/distributed.hpp"
+#include "render/allocation_counter.hpp"
+#include "render/hdr_image.hpp"
+#include "render/render_job.hpp"
+#include "render/service.hpp"
+#include "render/work_unit.hpp"
+#include "scene/animation.hpp"
+#include "scene/camera.hpp"
+#include "scene/path_tracer.hpp"
+#include "scene/scene.hpp"
+
+
+using namespace std;
+
+
+namespace {
+
+	struct HeadlessOptions {
+		RenderSettings render;
+		float exposure = 1;
+		bool denoise = false;
+		unsigned aovs = 0;
+		string hdr;
+		ExrPixelType exr_type = exr_half;
+		ExrCompression exr_compression = exr_zip;
+		string output = "render";
+
+		// distributed rendering, -1 local workers renders in this process
+		int local_workers = -1;
+		int port = 0;
+		int tile_size = 64;
+		int unit_samples = 4;
+		string worker; // coordinator address when running as a worker
+
+		// run the render service instead
+		bool serve = false;
+
+		// render this many times reporting timings instead of writing images
+		int benchmark_runs = 0;
+
+		// render pool, 0 threads for one per core
+		int threads = 0;
+		bool pin = false;
+
+		// animation, frames first to last at fps (none if last < first)
+		int first_frame = 0;
+		int last_frame = -1;
+		float fps = 24;
+		float shutter = 0; // fraction of a frame the shutter is open for
+		Track<Pose> camera_motion;
+	};
+
+	// split host:port
+	pair<string, int> parseAddress(const string &address) {
+		size_t colon = address.rfind(':');
+		if (colon == string::npos) throw invalid_argument("Expected host:port, got " + address);
+		return { address.substr(0, colon), stoi(address.substr(colon + 1)) };
+	}
+
+	void printUsage() {
+		cout << "Usage: a4 --headless [options]" << endl;
+		cout << "  --scene <name>          simple, light, material, shape, cornell, area or sky" << endl;
+		cout << "  --environment <file>    light the scene by an equirectangular hdr image," << endl;
+		cout << "                          which rays that miss it also see" << endl;
+		cout << "  --pathtracer <name>     simple, core, completion or challenge" << endl;
+		cout << "  --size <w> <h>          image size in pixels" << endl;
+		cout << "  --samples <n>           samples per pixel" << endl;
+		cout << "  --depth <n>             ray depth" << endl;
+		cout << "  --camera <x y z yaw pitch>" << endl;
+		cout << "  --exposure <e>          exposure used for tonemapping" << endl;
+		cout << "  --denoise               denoise the final image" << endl;
+		cout << "  --aov <name,...>        also write albedo, normal, depth, direct," << endl;
+		cout << "                          indirect, lights or object images" << endl;
+		cout << "                          (and position, only to an exr)" << endl;
+		cout << "  --hdr <pfm|exr>         also write the linear color as a pfm, or the" << endl;
+		cout << "                          color and aovs as layers of an exr" << endl;
+		cout << "  --exr-float             store exr channels as float instead of half" << endl;
+		cout << "  --exr-compression <c>   none, rle, zips or zip (default)" << endl;
+		cout << "  --output <file>         output filename (without extension)" << endl;
+		cout << "  --seed <n>              seed of the sample jitter" << endl;
+		cout << "  --sort-rays             reorder each batch of secondary rays by direction" << endl;
+		cout << "                          and origin before tracing it" << endl;
+		cout << "  --benchmark <n>         render n times, reporting the time and heap" << endl;
+		cout << "                          allocations of the render loop (writes nothing," << endl;
+		cout << "                          allocations need CGRA_COUNT_ALLOCATIONS)" << endl;
+		cout << "  --bvh <format>          wide (default) or compressed bvh nodes" << endl;
+		cout << "  --bvh-build <quality>   sah (default) or fast (morton order) bvh build" << endl;
+		cout << "  --spatial-splits <f>    build a split bvh duplicating up to f times the" << endl;
+		cout << "                          objects, 0 for none (default per scene)" << endl;
+		cout << "  --threads <n>           render threads (default one per core)" << endl;
+		cout << "  --pin                   pin the render threads to cores, spread over the" << endl;
+		cout << "                          numa nodes, each rendering from a local copy of" << endl;
+		cout << "                          the scene into its own part of the image" << endl;
+		cout << "Distributed rendering:" << endl;
+		cout << "  --distribute <n>        render with worker processes, starting n locally" << endl;
+		cout << "                          (others can connect with --worker)" << endl;
+		cout << "  --port <p>              port to listen for workers on (default any)" << endl;
+		cout << "  --tile <n>              size of the tiles handed to workers" << endl;
+		cout << "  --unit-samples <n>      samples of a tile handed to workers at once" << endl;
+		cout << "  --worker <host:port>    run as a worker for the coordinator at host:port" << endl;
+		cout << "Animation:" << endl;
+		cout << "  --frames <first> <last> render a sequence of frames as <output>.<frame>" << endl;
+		cout << "  --fps <f>               frames per second (default 24)" << endl;
+		cout << "  --shutter <f>           fraction of a frame the shutter is open for," << endl;
+		cout << "                          motion blurring moving objects (default 0)" << endl;
+		cout << "  --camera-key <t x y z yaw pitch>" << endl;
+		cout << "                          keyframe the camera at t seconds" << endl;
+		cout << "  --object-key <i t x y z yaw pitch roll>" << endl;
+		cout << "                          keyframe object i at t seconds, as an offset" << endl;
+		cout << "                          and a rotation about its center" << endl;
+		cout << "Render service:" << endl;
+		cout << "  --serve                 run the render service (http on localhost," << endl;
+		cout << "                          --port, default 8080) until /shutdown" << endl;
+	}
+
+	HeadlessOptions parseOptions(const vector<string> &args) {
+		HeadlessOptions opt;
+		size_t i = 0;
+		auto next = [&]() -> const string & {
+			if (++i >= args.size()) throw invalid_argument("Missing value for " + args[i - 1]);
+			return args[i];
+		};
+		for (i = 0; i < args.size(); i++) {
+			const string &arg = args[i];
+			if (arg == "--headless") continue;
+			else if (arg == "--scene") opt.render.m_scene = next();
+			else if (arg == "--environment") opt.render.m_environment = next();
+			else if (arg == "--pathtracer") opt.render.m_pathtracer = next();
+			else if (arg == "--size") { opt.render.m_width = stoi(next()); opt.render.m_height = stoi(next()); }
+			else if (arg == "--samples") opt.render.m_samples = stoi(next());
+			else if (arg == "--depth") opt.render.m_ray_depth = stoi(next());
+			else if (arg == "--seed") opt.render.m_seed = uint32_t(stoul(next()));
+			else if (arg == "--sort-rays") opt.render.m_sort_rays = true;
+			else if (arg == "--exposure") opt.exposure = stof(next());
+			else if (arg == "--denoise") opt.denoise = true;
+			else if (arg == "--aov") {
+				istringstream names(next());
+				for (string name; getline(names, name, ',');) {
+					AOV a = aovFromName(name);
+					if (a == aov_color || a == aov_moments) throw invalid_argument("AOV " + name + " can not be written separately");
+					opt.aovs |= aovBit(a);
+				}
+			}
+			else if (arg == "--output") opt.output = next();
+			else if (arg == "--hdr") {
+				opt.hdr = next();
+				if (opt.hdr != "pfm" && opt.hdr != "exr") throw invalid_argument("Unknown HDR format " + opt.hdr);
+			}
+			else if (arg == "--exr-float") opt.exr_type = exr_float;
+			else if (arg == "--exr-compression") {
+				const string &c = next();
+				if (c == "none") opt.exr_compression = exr_none;
+				else if (c == "rle") opt.exr_compression = exr_rle;
+				else if (c == "zips") opt.exr_compression = exr_zips;
+				else if (c == "zip") opt.exr_compression = exr_zip;
+				else throw invalid_argument("Unknown EXR compression " + c);
+			}
+			else if (arg == "--camera") {
+				for (int k = 0; k < 3; k++) opt.render.m_camera_position[k] = stof(next());
+				opt.render.m_camera_yaw = stof(next());
+				opt.render.m_camera_pitch = stof(next());
+			}
+			else if (arg == "--distribute") opt.local_workers = max(stoi(next()), 0);
+			else if (arg == "--port") opt.port = stoi(next());
+			else if (arg == "--tile") opt.tile_size = stoi(next());
+			else if (arg == "--unit-samples") opt.unit_samples = stoi(next());
+			else if (arg == "--worker") opt.worker = next();
+			else if (arg == "--serve") opt.serve = true;
+			else if (arg == "--benchmark") opt.benchmark_runs = stoi(next());
+			else if (arg == "--bvh") opt.render.m_bvh_format = bvhFormatFromName(next());
+			else if (arg == "--bvh-build") opt.render.m_bvh_quality = bvhQualityFromName(next());
+			else if (arg == "--spatial-splits") opt.render.m_split_budget = max(stof(next()), 0.f);
+			else if (arg == "--threads") opt.threads = max(stoi(next()), 0);
+			else if (arg == "--pin") opt.pin = true;
+			else if (arg == "--frames") { opt.first_frame = stoi(next()); opt.last_frame = stoi(next()); }
+			else if (arg == "--fps") opt.fps = stof(next());
+			else if (arg == "--shutter") opt.shutter = stof(next());
+			else if (arg == "--camera-key") {
+				float t = stof(next());
+				Pose pose;
+				for (int k = 0; k < 3; k++) pose.m_position[k] = stof(next());
+				pose.m_yaw = stof(next());
+				pose.m_pitch = stof(next());
+				opt.camera_motion.add(t, pose);
+			}
+			else if (arg == "--object-key") {
+				int object = stoi(next());
+				float t = stof(next());
+				Pose pose;
+				for (int k = 0; k < 3; k++) pose.m_position[k] = stof(next());
+				pose.m_yaw = stof(next());
+				pose.m_pitch = stof(next());
+				pose.m_roll = stof(next());
+				vector<pair<int, Track<Pose>>> &motion = opt.render.m_object_motion;
+				auto it = find_if(motion.begin(), motion.end(), [&](const pair<int, Track<Pose>> &m) { return m.first == object; });
+				if (it == motion.end()) it = motion.insert(it, { object, Track<Pose>() });
+				it->second.add(t, pose);
+			}
+			else throw invalid_argument("Unknown option " + arg);
+		}
+		if (opt.render.m_width <= 0 || opt.render.m_height <= 0 || opt.render.m_samples <= 0) throw invalid_argument("Size and samples must be positive");
+		if (opt.tile_size <= 0 || opt.unit_samples <= 0) throw invalid_argument("Tile size and unit samples must be positive");
+		if (opt.fps <= 0) throw invalid_argument("Frames per second must be positive");
+		if (opt.shutter < 0 || opt.shutter > 1) throw invalid_argument("Shutter must be between 0 and 1");
+		if (opt.last_frame >= opt.first_frame && opt.local_workers >= 0) throw invalid_argument("Sequences can not be distributed");
+		if (opt.benchmark_runs > 0 && (opt.last_frame >= opt.first_frame || opt.local_workers >= 0)) throw invalid_argument("Benchmarks render a single local frame");
+		opt.render.m_aovs = aovBit(aov_color) | opt.aovs | (opt.denoise ? Denoiser::features : 0);
+		opt.render.m_shutter_close = opt.shutter / opt.fps;
+		return opt;
+	}
+
+	// same tonemapping as display.glsl
+	glm::vec3 tonemap(const glm::vec3 &color, float exposure) {
+		return glm::pow(1.f - glm::exp(-exposure * color), glm::vec3(0.45f));
+	}
+
+	// tonemapped if given an exposure, otherwise clamped
+	bool writePNG(const string &filename, int w, int h, const vector<glm::vec3> &color, float exposure = 0) {
+		vector<unsigned char> data(w * h * 3);
+		for (int i = 0; i < w * h; i++) {
+			glm::vec3 c = glm::clamp(exposure > 0 ? tonemap(color[i], exposure) : color[i], glm::vec3(0), glm::vec3(1));
+			for (int k = 0; k < 3; k++) data[i * 3 + k] = (unsigned char)(c[k] * 255 + 0.5f);
+		}
+		// rows are stored bottom up
+		return stbi_write_png(filename.c_str(), w, h, 3, data.data() + (h - 1) * w * 3, -w * 3) != 0;
+	}
+
+	// gather 3 planes of the framebuffer starting at channel
+	vector<glm::vec3> interleave(const Framebuffer &fb, AOV a, int channel = 0) {
+		vector<glm::vec3> v(fb.width() * fb.height());
+		for (int c = 0; c < 3; c++) {
+			const float *p = fb.plane(a, channel + c);
+			for (size_t i = 0; i < v.size(); i++) v[i][c] = p[i];
+		}
+		return v;
+	}
+
+	// write a viewable image of each enabled aov (other than color)
+	// as <output>.<aov>.png, lights are written per light
+	bool writeAOVs(const HeadlessOptions &opt, const string &output, const Framebuffer &fb) {
+		const int n = fb.width() * fb.height();
+		bool ok = true;
+		auto write = [&](const string &name, const vector<glm::vec3> &image, float exposure = 0) {
+			string filename = output + "." + name + ".png";
+			if (writePNG(filename, fb.width(), fb.height(), image, exposure)) {
+				cout << "Wrote image: " << filename << endl;
+			} else {
+				cerr << "Failed to write image: " << filename << endl;
+				ok = false;
+			}
+		};
+
+		for (AOV a : { aov_albedo, aov_direct, aov_indirect }) {
+			if (!(opt.aovs & aovBit(a))) continue;
+			write(aovName(a), interleave(fb, a), opt.exposure);
+		}
+
+		if (opt.aovs & aovBit(aov_lights)) {
+			for (int l = 0; l < fb.lightCount(); l++) {
+				write(aovName(aov_lights) + to_string(l), interleave(fb, aov_lights, 3 * l), opt.exposure);
+			}
+		}
+
+		if (opt.aovs & aovBit(aov_normal)) {
+			vector<glm::vec3> image = interleave(fb, aov_normal);
+			for (glm::vec3 &c : image) c = c * 0.5f + 0.5f;
+			write(aovName(aov_normal), image);
+		}
+
+		// depth scaled to the furthest hit
+		if (opt.aovs & aovBit(aov_depth)) {
+			const float *depth = fb.plane(aov_depth);
+			float max_depth = *max_element(depth, depth + n);
+			vector<glm::vec3> image(n);
+			for (int i = 0; i < n; i++) image[i] = glm::vec3(max_depth > 0 ? depth[i] / max_depth : 0);
+			write(aovName(aov_depth), image);
+		}
+
+		// a random color per object, black for none
+		if (opt.aovs & aovBit(aov_object)) {
+			const float *object = fb.plane(aov_object);
+			vector<glm::vec3> image(n);
+			for (int i = 0; i < n; i++) {
+				if (object[i] < 0) continue;
+				minstd_rand hash(unsigned(object[i]) + 1);
+				hash.discard(8);
+				uniform_real_distribution<float> dist{ 0.2f, 1 };
+				image[i] = glm::vec3(dist(hash), dist(hash), dist(hash));
+			}
+			write(aovName(aov_object), image);
+		}
+		return ok;
+	}
+
+	// render the settings in this process
+	void renderLocal(const RenderSettings &settings, PathTracer &pathtracer, int light_count, Framebuffer &framebuffer, bool progress) {
+		FrameJob frame(settings, pathtracer, light_count);
+		if (progress) {
+			int passes = 0;
+			while (frame.job().finished().wait_for(100ms) != future_status::ready) {
+				RenderProgress p = frame.job().progress();
+				if (p.m_passes == passes) continue;
+				passes = p.m_passes;
+				cout << "\rPass " << passes << "/" << p.m_total_passes << flush;
+			}
+			cout << "\rPass " << settings.m_samples << "/" << settings.m_samples << endl;
+		}
+		framebuffer = frame.result();
+	}
+
+	// write the png, aov pngs and hdr image (if any) of a render as <output>.*
+	bool writeImages(const HeadlessOptions &opt, const string &output, const Framebuffer &framebuffer, const vector<glm::vec3> &color) {
+		const int w = framebuffer.width(), h = framebuffer.height();
+
+		// write the hdr image in the background, straight from the buffers
+		future<bool> hdr_written;
+		string hdr_filename = output + "." + opt.hdr;
+		if (!opt.hdr.empty()) {
+			ImageView image;
+			if (opt.hdr == "exr") image = framebufferImage(framebuffer, opt.aovs);
+			image.m_width = w;
+			image.m_height = h;
+			image.m_channels.insert(image.m_channels.begin(), {
+				{ "R", &color[0].r, 3 }, { "G", &color[0].g, 3 }, { "B", &color[0].b, 3 }
+			});
+			hdr_written = writeHDRAsync(hdr_filename, image, opt.exr_type, opt.exr_compression);
+		}
+
+		bool ok = true;
+		string filename = output + ".png";
+		if (writePNG(filename, w, h, color, opt.exposure)) {
+			cout << "Wrote image: " << filename << endl;
+		} else {
+			cerr << "Failed to write image: " << filename << endl;
+			ok = false;
+		}
+		ok &= writeAOVs(opt, output, framebuffer);
+
+		if (hdr_written.valid()) {
+			if (hdr_written.get()) {
+				cout << "Wrote image: " << hdr_filename << endl;
+			} else {
+				cerr << "Failed to write image: " << hdr_filename << endl;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+	// color of a render, denoised if enabled
+	vector<glm::vec3> finalColor(const HeadlessOptions &opt, const Framebuffer &framebuffer, int samples) {
+		vector<glm::vec3> color = interleave(framebuffer, aov_color);
+		if (opt.denoise) {
+			Denoiser denoiser;
+			denoiser.denoise(framebuffer, samples, &color[0].x, 3, &color[0].x, 3, RenderPool::shared(), render_priority_background);
+		}
+		return color;
+	}
+
+	// render frames first to last, the scene is only moved between frames
+	// (refitting what moves) and each frame is written in the background
+	// while the next is set up and rendered
+	int renderSequence(const HeadlessOptions &opt, Scene &scene, PathTracer &pathtracer) {
+		const int digits = max(4, int(to_string(opt.last_frame).size()));
+		future<bool> written;
+		bool ok = true;
+		auto start_time = chrono::steady_clock::now();
+
+		for (int frame = opt.first_frame; frame <= opt.last_frame; frame++) {
+			const float time = frame / opt.fps;
+			scene.setShutter(time, time + opt.shutter / opt.fps);
+
+			// vary the noise between frames
+			RenderSettings settings = opt.render;
+			settings.m_seed = opt.render.m_seed + uint32_t(frame);
+			if (!opt.camera_motion.empty()) {
+				Pose pose = opt.camera_motion.at(time);
+				settings.m_camera_position = pose.m_position;
+				settings.m_camera_yaw = pose.m_yaw;
+				settings.m_camera_pitch = pose.m_pitch;
+			}
+
+			auto framebuffer = make_shared<Framebuffer>();
+			renderLocal(settings, pathtracer, int(scene.lights().size()), *framebuffer, false);
+			auto color = make_shared<vector<glm::vec3>>(finalColor(opt, *framebuffer, settings.m_samples));
+			cout << "Rendered frame " << frame << " (" << (frame - opt.first_frame + 1) << "/" << (opt.last_frame - opt.first_frame + 1) << ")" << endl;
+
+			// only one frame is held for writing at a time
+			if (written.valid()) ok &= written.get();
+			string number = to_string(frame);
+			string output = opt.output + "." + string(max(0, digits - int(number.size())), '0') + number;
+			written = async(launch::async, [&opt, output, framebuffer, color]() {
+				return writeImages(opt, output, *framebuffer, *color);
+			});
+		}
+		if (written.valid()) ok &= written.get();
+
+		float duration = float((chrono::steady_clock::now() - start_time) / 1.0s);
+		cout << "Rendered " << (opt.last_frame - opt.first_frame + 1) << " frames in " << duration << " seconds" << endl;
+		return ok ? 0 : 1;
+	}
+
+	// the secondary rays traced since the stats were reset, per thread and
+	// in total, as the time to find their hits per ray
+	void printRayStats(bool sorted) {
+		auto line = [](const RayStats &r) {
+			ostringstream out;
+			out << r.m_camera << " camera rays, " << r.m_secondary << " secondary in " << r.m_batches << " batches ("
+				<< r.m_sorted << " sorted), " << (r.m_secondary ? r.m_secondary_seconds / r.m_secondary * 1e9 : 0) << " ns per secondary ray";
+			if (r.m_occluder_lookups > 0 || r.m_occluded_traversals > 0) {
+				out << ", occluder cache " << r.occluderHitRate() * 100 << "% of " << r.m_occluder_lookups << " hit, "
+					<< r.occluderStepsSaved() << " traversal steps saved";
+			}
+			return out.str();
+		};
+		const vector<RayStats> threads = RayStats::threads();
+		for (int t = 0; t < int(threads.size()); t++) {
+			if (threads[t].m_camera > 0) cout << "  Thread " << t << ": " << line(threads[t]) << endl;
+		}
+		cout << "  Rays" << (sorted ? " (sorted)" : "") << ": " << line(RayStats::total()) << endl;
+	}
+
+	// render the frame repeatedly on the render pool, timing each run and
+	// counting the heap allocations of its passes (which should be none,
+	// in builds that count them)
+	int runBenchmark(const HeadlessOptions &opt, PathTracer &pathtracer, int light_count) {
+		const RenderSettings &s = opt.render;
+		const int w = s.m_width, h = s.m_height;
+		Camera camera = s.camera();
+		Framebuffer framebuffer;
+		framebuffer.configure(w, h, s.m_aovs, light_count, false);
+		PathTracerReplicas replicas;
+
+		RenderPool &pool = RenderPool::shared();
+		cout << "Rendering on " << pool.size() << " threads over " << pool.nodes() << " numa nodes" << endl;
+		const WideBVH &bvh = pathtracer.m_scene->bvh();
+		cout << "BVH: " << bvhFormatName(bvh.format()) << ", " << bvh.nodeCount() << " nodes, " << bvh.bytes()
+			<< " bytes (" << bvh.bytesPerPrimitive() << " per primitive), "
+			<< bvhQualityName(pathtracer.m_scene->bvhOptions().quality) << " build in "
+			<< pathtracer.m_scene->buildSeconds() * 1000 << " ms" << endl;
+		float best = numeric_limits<float>::infinity();
+		for (int run = 0; run < opt.benchmark_runs; run++) {
+			long allocations = 0;
+			float seconds = 0;
+			RenderJob job([&](RenderJob &job) {
+				replicas.update(pathtracer, job.pool());
+				job.parallelFor(w * h, [&](int idx) { framebuffer.clear(idx, idx + 1); }, 0, 4096, true);
+
+				RayStats::reset();
+				const long start_allocations = heapAllocations();
+				const auto start_time = chrono::steady_clock::now();
+				for (int pass = 0; pass < s.m_samples; pass++) {
+					const float mix = pass / float(pass + 1);
+					job.parallelForBatches(w * h, [&](int begin, int end) {
+						SampleBatch batch(end - begin);
+						traceSamples(s, replicas.local(), camera, 0, 0, w, begin, end, pass, batch);
+						for (int idx = begin; idx < end; idx++) framebuffer.accumulate(idx, batch.m_colors[idx - begin], batch.m_records[idx - begin], mix);
+					}, 0, 256);
+				}
+				seconds = float((chrono::steady_clock::now() - start_time) / 1.0s);
+				allocations = heapAllocations() - start_allocations;
+			});
+			job.finished().get();
+
+			best = min(best, seconds);
+			cout << "Run " << (run + 1) << ": " << seconds << " seconds, "
+				<< (float(w) * h * s.m_samples / seconds * 1e-6f) << " Msamples/s";
+			if (heapAllocations() >= 0) cout << ", " << allocations << " heap allocations";
+			cout << endl;
+			printRayStats(s.m_sort_rays);
+		}
+		cout << "Best " << best << " seconds, " << (float(w) * h * s.m_samples / best * 1e-6f) << " Msamples/s" << endl;
+		return 0;
+	}
+}
+
+
+int runHeadless(const string &executable, const vector<string> &args) {
+	HeadlessOptions opt;
+	Scene scene;
+	unique_ptr<PathTracer> pathtracer;
+	try {
+		for (const string &arg : args) {
+			if (arg == "--help") {
+				printUsage();
+				return 0;
+			}
+		}
+		opt = parseOptions(args);
+		RenderPool::configureShared(opt.threads, opt.pin);
+		if (!opt.worker.empty()) {
+			pair<string, int> address = parseAddress(opt.worker);
+			return runWorker(address.first, address.second);
+		}
+		if (opt.serve) {
+			RenderService service;
+			if (opt.port) service.m_port = opt.port;
+			return service.run();
+		}
+		scene = opt.render.scene();
+		pathtracer = makePathTracer(opt.render.m_pathtracer, &scene);
+	}
+	catch (exception &e) {
+		cerr << "Error: " << e.what() << endl;
+		printUsage();
+		return 1;
+	}
+
+	if (opt.last_frame >= opt.first_frame) return renderSequence(opt, scene, *pathtracer);
+	if (opt.benchmark_runs > 0) return runBenchmark(opt, *pathtracer, int(scene.lights().size()));
+
+	Framebuffer framebuffer;
+
+	auto start_time = chrono::steady_clock::now();
+
+	if (opt.local_workers >= 0) {
+		Coordinator coordinator;
+		coordinator.m_port = opt.port;
+		coordinator.m_local_workers = opt.local_workers;
+		coordinator.m_executable = executable;
+		coordinator.m_tile_size = opt.tile_size;
+		coordinator.m_unit_samples = opt.unit_samples;
+		try {
+			if (!coordinator.render(opt.render, framebuffer)) {
+				cerr << "Error: Distributed render failed" << endl;
+				return 1;
+			}
+		}
+		catch (exception &e) {
+			cerr << "Error: " << e.what() << endl;
+			return 1;
+		}
+	}
+	else {
+		renderLocal(opt.render, *pathtracer, int(scene.lights().size()), framebuffer, true);
+	}
+
+	vector<glm::vec3> color = finalColor(opt, framebuffer, opt.render.m_samples);
+
+	float duration = float((chrono::steady_clock::now() - start_time) / 1.0s);
+	cout << "Rendered in " << duration << " seconds" << endl;
+
+	return writeImages(opt, opt.output, framebuffer, color) ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+
+
+// Renders a single image (or an animated sequence of frames) without opening
+// a window or creating a GL context, configured by command line arguments
+// (run with --help for the options).
+// Also runs distributed renders, starting workers with the executable.
+// Returns the exit code for the process.
+int runHeadless(const std::string &executable, const std::vector<std::string> &args);
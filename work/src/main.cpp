@@ -3,9 +3,11 @@
 #include <iostream>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 // project
 #include "application.hpp"
+#include "headless.hpp"
 #include "opengl.hpp"
 #include "cgra/cgra_gui.hpp"
 
@@ -28,7 +30,11 @@ static Application *application_ptr = nullptr;
 
 // Main program
 // 
-int main() {
+int main(int argc, char *argv[]) {
+
+	// render without a window if requested
+	std::vector<std::string> args(argv + 1, argv + argc);
+	if (!args.empty() && args[0] == "--headless") return runHeadless(argv[0], args);
 
 	// Initialize the GLFW library
 	if (!glfwInit()) {
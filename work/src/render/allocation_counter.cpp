@@ -0,0 +1,102 @@
+// std
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// msvc
+#ifdef _WIN32
+#include <malloc.h>
+#endif // _WIN32
+
+// project
+#include "allocation_counter.hpp"
+
+
+#ifdef CGRA_COUNT_ALLOCATIONS
+
+namespace {
+	std::atomic<long> allocations{ 0 };
+
+	void * countedAllocate(std::size_t size) {
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		if (void *p = std::malloc(size ? size : 1)) return p;
+		throw std::bad_alloc();
+	}
+
+	void * countedAllocate(std::size_t size, std::align_val_t alignment) {
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		const std::size_t a = std::max(std::size_t(alignment), sizeof(void *));
+#ifdef _WIN32
+		if (void *p = _aligned_malloc(size ? size : 1, a)) return p;
+#else
+		void *p = nullptr;
+		if (posix_memalign(&p, a, size ? size : 1) == 0) return p;
+#endif // _WIN32
+		throw std::bad_alloc();
+	}
+
+	void alignedFree(void *p) {
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif // _WIN32
+	}
+}
+
+
+long heapAllocations() {
+	return allocations.load(std::memory_order_relaxed);
+}
+
+
+// the array, nothrow and aligned forms are replaced too, so everything is
+// counted and matches the (malloc based) deallocation below
+void * operator new(std::size_t size) { return countedAllocate(size); }
+void * operator new[](std::size_t size) { return countedAllocate(size); }
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+	try { return countedAllocate(size); }
+	catch (...) { return nullptr; }
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+	try { return countedAllocate(size); }
+	catch (...) { return nullptr; }
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment) { return countedAllocate(size, alignment); }
+void * operator new[](std::size_t size, std::align_val_t alignment) { return countedAllocate(size, alignment); }
+
+void * operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	try { return countedAllocate(size, alignment); }
+	catch (...) { return nullptr; }
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	try { return countedAllocate(size, alignment); }
+	catch (...) { return nullptr; }
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { alignedFree(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { alignedFree(p); }
+
+#else
+
+long heapAllocations() {
+	return -1;
+}
+
+#endif // CGRA_COUNT_ALLOCATIONS
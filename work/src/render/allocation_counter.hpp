@@ -0,0 +1,9 @@
+#pragma once
+
+
+// number of heap allocations (through operator new, including its aligned
+// forms) made by the process so far, for checking that the render loops
+// don't allocate. counted by replacing the global operator new, which
+// otherwise behaves as usual, only in builds with CGRA_COUNT_ALLOCATIONS
+// (-1 in others)
+long heapAllocations();
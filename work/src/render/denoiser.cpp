@@ -0,0 +1,138 @@
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// project
+#include "denoiser.hpp"
+
+
+namespace {
+	// smooth falloff standing in for exp(-x) with x >= 0, a rational
+	// polynomial rather than exp so the filter loops vectorize
+	inline float edgeStop(float x) {
+		return 1.f / (1.f + x * (1.f + x * (0.5f + x * (1.f / 6.f))));
+	}
+
+	// B3 spline
+	const float kernel[5] = { 1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16 };
+
+	// rows filtered by a thread at a time
+	const int rows_per_chunk = 8;
+
+}
+
+
+void Denoiser::denoise(const Framebuffer &fb, int samples, const float *color, int stride, float *out, int out_stride,
+	RenderPool &pool, int priority) const
+{
+	const int w = fb.width(), h = fb.height(), n = w * h;
+	if (n == 0 || (fb.enabledMask() & features) != features) return;
+
+	// demodulated color and the variance of its luminance (ping-pong)
+	std::vector<float> src[4], dst[4];
+	for (int c = 0; c < 4; c++) {
+		src[c].resize(n);
+		dst[c].resize(n);
+	}
+
+	pool.parallelFor(n, 4096, priority, 0, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			for (int c = 0; c < 3; c++) {
+				src[c][i] = demodulate(color[i * stride + c], fb.plane(aov_albedo, c)[i]);
+			}
+			// variance of the mean of the samples
+			float m = fb.plane(aov_moments, 0)[i];
+			src[3][i] = std::max(0.f, fb.plane(aov_moments, 1)[i] - m * m) / std::max(samples, 1);
+		}
+	});
+
+	const float *nx = fb.plane(aov_normal, 0);
+	const float *ny = fb.plane(aov_normal, 1);
+	const float *nz = fb.plane(aov_normal, 2);
+	const float *ar = fb.plane(aov_albedo, 0);
+	const float *ag = fb.plane(aov_albedo, 1);
+	const float *ab = fb.plane(aov_albedo, 2);
+	const float *depth = fb.plane(aov_depth);
+
+	const float inv_normal = 1 / (m_sigma_normal * m_sigma_normal);
+	const float inv_albedo = 1 / (m_sigma_albedo * m_sigma_albedo);
+
+	for (int it = 0; it < m_iterations; it++) {
+		const int step = 1 << it;
+		const float sigma_depth = m_sigma_depth * step;
+
+		pool.parallelFor(h, rows_per_chunk, priority, 0, [&](int y_begin, int y_end) {
+			// accumulators for one row, shared by the rows of the chunk
+			std::vector<float> sum_w(w), sum_r(w), sum_g(w), sum_b(w), sum_v(w);
+
+			for (int y = y_begin; y < y_end; y++) {
+				for (std::vector<float> *sum : { &sum_w, &sum_r, &sum_g, &sum_b, &sum_v }) {
+					std::fill(sum->begin(), sum->end(), 0.f);
+				}
+
+				const int row = y * w;
+				const float *cr = src[0].data(), *cg = src[1].data(), *cb = src[2].data(), *var = src[3].data();
+
+				for (int ky = -2; ky <= 2; ky++) {
+					const int qy = y + ky * step;
+					if (qy < 0 || qy >= h) continue;
+					for (int kx = -2; kx <= 2; kx++) {
+						// taps outside the image are skipped, the weights are normalized anyway
+						const int off = (qy - y) * w + kx * step;
+						const int x0 = std::max(0, -kx * step);
+						const int x1 = std::min(w, w - kx * step);
+						const float hk = kernel[ky + 2] * kernel[kx + 2];
+
+#pragma omp simd
+						for (int x = x0; x < x1; x++) {
+							const int p = row + x;
+							const int q = p + off;
+
+							float dl = luminance(cr[q], cg[q], cb[q]) - luminance(cr[p], cg[p], cb[p]);
+							float d_luminance = std::abs(dl) / (m_sigma_luminance * std::sqrt(var[p]) + 1e-4f);
+
+							float dnx = nx[q] - nx[p], dny = ny[q] - ny[p], dnz = nz[q] - nz[p];
+							float d_normal = (dnx * dnx + dny * dny + dnz * dnz) * inv_normal;
+
+							float dar = ar[q] - ar[p], dag = ag[q] - ag[p], dab = ab[q] - ab[p];
+							float d_albedo = (dar * dar + dag * dag + dab * dab) * inv_albedo;
+
+							// depth difference relative to the nearer surface (0 is a miss)
+							float d_depth = std::abs(depth[q] - depth[p]) / (sigma_depth * std::max(depth[p], depth[q]) + 1e-6f);
+
+							float wgt = hk * edgeStop(d_luminance + d_normal + d_albedo + d_depth);
+							sum_w[x] += wgt;
+							sum_r[x] += wgt * cr[q];
+							sum_g[x] += wgt * cg[q];
+							sum_b[x] += wgt * cb[q];
+							sum_v[x] += wgt * wgt * var[q];
+						}
+					}
+				}
+
+				// the center tap always has full weight so sum_w > 0,
+				// the variance is filtered with the squared weights
+				for (int x = 0; x < w; x++) {
+					dst[0][row + x] = sum_r[x] / sum_w[x];
+					dst[1][row + x] = sum_g[x] / sum_w[x];
+					dst[2][row + x] = sum_b[x] / sum_w[x];
+					dst[3][row + x] = sum_v[x] / (sum_w[x] * sum_w[x]);
+				}
+			}
+		});
+
+		for (int c = 0; c < 4; c++) std::swap(src[c], dst[c]);
+	}
+
+	// remodulate
+	pool.parallelFor(n, 4096, priority, 0, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			for (int c = 0; c < 3; c++) {
+				float a = fb.plane(aov_albedo, c)[i];
+				out[i * out_stride + c] = (a > min_demodulate_albedo) ? src[c][i] * a : src[c][i];
+			}
+		}
+	});
+}
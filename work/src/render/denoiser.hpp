@@ -0,0 +1,35 @@
+#pragma once
+
+// project
+#include "framebuffer.hpp"
+#include "render_pool.hpp"
+
+
+// Edge-avoiding a-trous wavelet denoiser (Dammertz et al. 2010) with
+// variance guided color weights (Schied et al. 2017). Lighting is
+// demodulated by the albedo, then smoothed by repeatedly applying a 5x5
+// B3-spline kernel with holes that double in size each iteration.
+// Neighbours are weighted down by their difference in normal, depth and
+// albedo, and by their difference in luminance relative to the estimated
+// noise, so edges and converged detail are preserved.
+// Rows are processed in parallel on a render pool (sharing its threads
+// with any render) and the inner loops run over contiguous channel planes
+// so they vectorize.
+class Denoiser {
+public:
+	int m_iterations = 5;
+	float m_sigma_luminance = 4; // in standard deviations of the noise
+	float m_sigma_normal = 0.3f;
+	float m_sigma_depth = 0.05f; // relative to depth, per pixel of step
+	float m_sigma_albedo = 0.1f;
+
+	// aovs the denoiser needs from the framebuffer
+	static constexpr unsigned features = aovBit(aov_albedo) | aovBit(aov_normal) | aovBit(aov_depth) | aovBit(aov_moments);
+
+	// denoise an image of rgb color the size of the framebuffer, with stride
+	// floats between pixels, averaged from samples samples per pixel into out
+	// (which may be color), on pool at priority. does nothing if the
+	// features are not enabled
+	void denoise(const Framebuffer &fb, int samples, const float *color, int stride, float *out, int out_stride,
+		RenderPool &pool, int priority) const;
+};
@@ -0,0 +1,358 @@
+// std
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// posix
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+#endif // _WIN32
+
+// project
+#include "distributed.hpp"
+#include "socket.hpp"
+#include "scene/scene.hpp"
+
+
+#ifndef _WIN32
+extern char **environ;
+#endif // _WIN32
+
+
+using namespace std;
+
+
+namespace {
+
+	void putSettings(Message &m, const RenderSettings &s) {
+		m.putString(s.m_scene);
+		m.putString(s.m_pathtracer);
+		m.putInt(s.m_width);
+		m.putInt(s.m_height);
+		m.putInt(s.m_samples);
+		m.putInt(s.m_ray_depth);
+		m.putFloats(&s.m_camera_position[0], 3);
+		m.putFloat(s.m_camera_yaw);
+		m.putFloat(s.m_camera_pitch);
+		m.putInt(s.m_aovs);
+		m.putInt(s.m_seed);
+		m.putInt(s.m_sort_rays);
+		m.putString(s.m_environment);
+		m.putFloat(s.m_shutter_open);
+		m.putFloat(s.m_shutter_close);
+		m.putInt(uint32_t(s.m_object_motion.size()));
+		for (const pair<int, Track<Pose>> &motion : s.m_object_motion) {
+			m.putInt(uint32_t(motion.first));
+			m.putInt(uint32_t(motion.second.keys().size()));
+			for (const pair<float, Pose> &key : motion.second.keys()) {
+				m.putFloat(key.first);
+				m.putFloats(&key.second.m_position[0], 3);
+				m.putFloat(key.second.m_yaw);
+				m.putFloat(key.second.m_pitch);
+				m.putFloat(key.second.m_roll);
+			}
+		}
+		m.putInt(uint32_t(s.m_bvh_format));
+		m.putInt(uint32_t(s.m_bvh_quality));
+		m.putFloat(s.m_split_budget);
+	}
+
+	RenderSettings getSettings(Message &m) {
+		RenderSettings s;
+		s.m_scene = m.getString();
+		s.m_pathtracer = m.getString();
+		s.m_width = int(m.getInt());
+		s.m_height = int(m.getInt());
+		s.m_samples = int(m.getInt());
+		s.m_ray_depth = int(m.getInt());
+		m.getFloats(&s.m_camera_position[0], 3);
+		s.m_camera_yaw = m.getFloat();
+		s.m_camera_pitch = m.getFloat();
+		s.m_aovs = m.getInt();
+		s.m_seed = m.getInt();
+		s.m_sort_rays = m.getInt() != 0;
+		s.m_environment = m.getString();
+		s.m_shutter_open = m.getFloat();
+		s.m_shutter_close = m.getFloat();
+		s.m_object_motion.resize(m.getInt());
+		for (pair<int, Track<Pose>> &motion : s.m_object_motion) {
+			motion.first = int(m.getInt());
+			for (uint32_t keys = m.getInt(); keys > 0; keys--) {
+				const float time = m.getFloat();
+				Pose pose;
+				m.getFloats(&pose.m_position[0], 3);
+				pose.m_yaw = m.getFloat();
+				pose.m_pitch = m.getFloat();
+				pose.m_roll = m.getFloat();
+				motion.second.add(time, pose);
+			}
+		}
+		const uint32_t format = m.getInt();
+		if (format >= uint32_t(bvh_format_count)) throw runtime_error("Unknown BVH format");
+		s.m_bvh_format = BVHFormat(format);
+		const uint32_t quality = m.getInt();
+		if (quality >= uint32_t(bvh_quality_count)) throw runtime_error("Unknown BVH build quality");
+		s.m_bvh_quality = BVHQuality(quality);
+		s.m_split_budget = m.getFloat();
+		return s;
+	}
+
+	void putUnit(Message &m, const WorkUnit &u) {
+		for (int v : { u.m_id, u.m_tile, u.m_x0, u.m_y0, u.m_x1, u.m_y1, u.m_s0, u.m_s1 }) m.putInt(uint32_t(v));
+	}
+
+	WorkUnit getUnit(Message &m) {
+		WorkUnit u;
+		for (int *v : { &u.m_id, &u.m_tile, &u.m_x0, &u.m_y0, &u.m_x1, &u.m_y1, &u.m_s0, &u.m_s1 }) *v = int(m.getInt());
+		return u;
+	}
+
+	// every plane of every enabled aov in order
+	void putPlanes(Message &m, const Framebuffer &fb) {
+		for (int a = 0; a < aov_count; a++) {
+			for (int c = 0; c < fb.channels(AOV(a)); c++) m.putFloats(fb.plane(AOV(a), c), fb.width() * fb.height());
+		}
+	}
+
+	void getPlanes(Message &m, Framebuffer &fb) {
+		for (int a = 0; a < aov_count; a++) {
+			for (int c = 0; c < fb.channels(AOV(a)); c++) m.getFloats(fb.plane(AOV(a), c), fb.width() * fb.height());
+		}
+	}
+
+	// start a4 --headless --worker 127.0.0.1:port, returns the process id or -1
+	int spawnWorker(const string &executable, int port) {
+#ifndef _WIN32
+		string address = "127.0.0.1:" + to_string(port);
+		vector<string> args = { executable, "--headless", "--worker", address };
+		vector<char *> argv;
+		for (string &a : args) argv.push_back(&a[0]);
+		argv.push_back(nullptr);
+		pid_t pid;
+		if (posix_spawnp(&pid, executable.c_str(), nullptr, nullptr, argv.data(), environ) != 0) return -1;
+		return int(pid);
+#else
+		(void) executable;
+		(void) port;
+		return -1;
+#endif // _WIN32
+	}
+
+	void waitWorker(int pid) {
+#ifndef _WIN32
+		if (pid > 0) waitpid(pid_t(pid), nullptr, 0);
+#else
+		(void) pid;
+#endif // _WIN32
+	}
+}
+
+
+bool Coordinator::render(const RenderSettings &settings, Framebuffer &frame) {
+	// the scene is only loaded for the number of lights (of the light aovs)
+	Scene scene = settings.scene();
+	const int light_count = int(scene.lights().size());
+	frame.configure(settings.m_width, settings.m_height, settings.m_aovs, light_count);
+
+	const vector<WorkUnit> units = splitFrame(settings, m_tile_size, m_unit_samples);
+	if (units.empty()) return true;
+
+	Socket listener = Socket::listen(m_port);
+	const int port = listener.port();
+	cout << "Listening for workers on port " << port << endl;
+
+	// shared state, guarded by the mutex
+	mutex state_mutex;
+	condition_variable state_changed;
+	deque<int> pending;
+	vector<int> attempts(units.size(), 0);
+	size_t merged_units = 0;
+	bool failed = false;
+	int active_workers = 0;
+	auto last_active = chrono::steady_clock::now();
+
+	// units finished out of order, and per tile the next unit
+	// to merge and the number of samples merged so far
+	map<int, unique_ptr<Framebuffer>> finished;
+	vector<int> tile_next(units.back().m_tile + 1, 0), tile_samples(units.back().m_tile + 1, 0);
+	for (int i = int(units.size()) - 1; i >= 0; i--) tile_next[units[i].m_tile] = i;
+	for (const WorkUnit &u : units) pending.push_back(u.m_id);
+
+	auto done = [&]() { return failed || merged_units == units.size(); };
+
+	auto serve = [&](Socket socket) {
+		Message settings_message(message_settings);
+		putSettings(settings_message, settings);
+		bool alive = sendMessage(socket, settings_message);
+
+		while (alive) {
+			int id;
+			{
+				unique_lock<mutex> lock(state_mutex);
+				state_changed.wait(lock, [&]() { return done() || !pending.empty(); });
+				if (done()) break;
+				id = pending.front();
+				pending.pop_front();
+				attempts[id]++;
+			}
+
+			const WorkUnit &unit = units[id];
+			Message request(message_unit), reply;
+			putUnit(request, unit);
+			unique_ptr<Framebuffer> tile = make_unique<Framebuffer>();
+			tile->configure(unit.width(), unit.height(), settings.m_aovs, light_count);
+			string error = "lost connection";
+			try {
+				alive = sendMessage(socket, request) && receiveMessage(socket, reply, m_unit_timeout_ms);
+				if (alive && reply.m_type == message_error) {
+					error = reply.getString();
+					alive = false;
+				}
+				else if (alive) {
+					alive = reply.m_type == message_result && int(reply.getInt()) == id;
+					if (alive) getPlanes(reply, *tile);
+				}
+			}
+			catch (exception &e) {
+				error = e.what();
+				alive = false;
+			}
+
+			lock_guard<mutex> lock(state_mutex);
+			if (!alive) {
+				// give the unit to another worker and drop this one
+				cerr << endl << "Worker failed on unit " << id << " (" << error << ")";
+				if (attempts[id] >= m_max_attempts) {
+					cerr << ", giving up after " << attempts[id] << " attempts" << endl;
+					failed = true;
+				} else {
+					cerr << ", reissuing" << endl;
+					pending.push_front(id);
+				}
+				state_changed.notify_all();
+				break;
+			}
+
+			// merge in sample order for each tile, so the result does not
+			// depend on which worker finishes first
+			finished.emplace(id, move(tile));
+			const int t = unit.m_tile;
+			for (auto it = finished.find(tile_next[t]); it != finished.end(); it = finished.find(tile_next[t])) {
+				const WorkUnit &u = units[it->first];
+				mergeWorkUnit(frame, tile_samples[t], u, *it->second);
+				tile_samples[t] += u.samples();
+				merged_units++;
+				finished.erase(it);
+				if (++tile_next[t] >= int(units.size()) || units[tile_next[t]].m_tile != t) break;
+			}
+			state_changed.notify_all();
+		}
+
+		if (alive) sendMessage(socket, Message(message_quit));
+		lock_guard<mutex> lock(state_mutex);
+		active_workers--;
+		last_active = chrono::steady_clock::now();
+		state_changed.notify_all();
+	};
+
+	vector<int> processes;
+	for (int i = 0; i < m_local_workers; i++) {
+		int pid = spawnWorker(m_executable, port);
+		if (pid < 0) cerr << "Failed to start worker " << m_executable << endl;
+		else processes.push_back(pid);
+	}
+
+	// accept workers until the frame is done
+	vector<thread> threads;
+	size_t reported = size_t(-1);
+	while (true) {
+		{
+			lock_guard<mutex> lock(state_mutex);
+			if (merged_units != reported) {
+				reported = merged_units;
+				cout << "\rUnits " << merged_units << "/" << units.size() << " (" << active_workers << " workers)" << flush;
+			}
+			if (done()) break;
+			if (active_workers == 0 && chrono::steady_clock::now() - last_active > chrono::milliseconds(m_idle_timeout_ms)) {
+				cerr << endl << "No workers connected, giving up" << endl;
+				failed = true;
+				state_changed.notify_all();
+				break;
+			}
+		}
+
+		Socket socket = listener.accept(100);
+		if (socket.valid()) {
+			lock_guard<mutex> lock(state_mutex);
+			active_workers++;
+			threads.emplace_back(serve, move(socket));
+		}
+	}
+	cout << endl;
+
+	for (thread &t : threads) t.join();
+	for (int pid : processes) waitWorker(pid);
+	return !failed;
+}
+
+
+int runWorker(const string &host, int port) {
+	Socket socket;
+	Message message;
+	try {
+		socket = Socket::connect(host, port);
+		if (!receiveMessage(socket, message, -1) || message.m_type != message_settings) {
+			cerr << "Error: Expected render settings from " << host << ":" << port << endl;
+			return 1;
+		}
+	}
+	catch (exception &e) {
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	Scene scene;
+	unique_ptr<PathTracer> pathtracer;
+	RenderSettings settings;
+	try {
+		settings = getSettings(message);
+		scene = settings.scene();
+		pathtracer = makePathTracer(settings.m_pathtracer, &scene);
+	}
+	catch (exception &e) {
+		Message error(message_error);
+		error.putString(e.what());
+		sendMessage(socket, error);
+		return 1;
+	}
+	Camera camera = settings.camera();
+
+	// the coordinator closing the connection also ends the worker
+	while (receiveMessage(socket, message, -1)) {
+		if (message.m_type == message_quit) return 0;
+
+		Message reply(message_result);
+		try {
+			if (message.m_type != message_unit) throw runtime_error("Unexpected message");
+			WorkUnit unit = getUnit(message);
+			Framebuffer tile;
+			renderWorkUnit(settings, *pathtracer, camera, unit, tile);
+			reply.putInt(uint32_t(unit.m_id));
+			putPlanes(reply, tile);
+		}
+		catch (exception &e) {
+			reply = Message(message_error);
+			reply.putString(e.what());
+		}
+		if (!sendMessage(socket, reply)) return 1;
+	}
+	return 0;
+}
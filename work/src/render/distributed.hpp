@@ -0,0 +1,36 @@
+#pragma once
+
+// std
+#include <string>
+
+// project
+#include "framebuffer.hpp"
+#include "work_unit.hpp"
+
+
+// Renders a frame across worker processes (a4 --headless --worker host:port)
+// that connect to it, either spawned locally or started on other hosts.
+// The frame is split into work units (tiles of a range of samples) handed
+// out one at a time. Results are merged by sample count in a fixed order
+// and every sample is seeded by its pixel and index, so the image is the
+// same whatever the number of workers or the order they finish in.
+// Units that fail or time out are reissued to another worker.
+class Coordinator {
+public:
+	int m_port = 0; // 0 picks a free port
+	int m_local_workers = 0; // subprocesses to spawn
+	std::string m_executable = "a4"; // for local workers
+	int m_tile_size = 64;
+	int m_unit_samples = 4;
+	int m_unit_timeout_ms = 60000; // a worker taking longer is dropped
+	int m_max_attempts = 3; // times a unit is issued before giving up
+	int m_idle_timeout_ms = 30000; // give up if no worker is connected for this long
+
+	// render the frame (configured for the settings), false on failure
+	bool render(const RenderSettings &settings, Framebuffer &frame);
+};
+
+
+// connect to a coordinator and render the units it sends until told to quit
+// returns the exit code for the process
+int runWorker(const std::string &host, int port);
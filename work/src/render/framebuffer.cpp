@@ -0,0 +1,114 @@
+// std
+#include <algorithm>
+#include <stdexcept>
+
+// project
+#include "framebuffer.hpp"
+
+
+namespace {
+	const char * aov_names[aov_count] = {
+		"color", "albedo", "normal", "depth", "position", "direct", "indirect", "lights", "object", "moments"
+	};
+
+	inline void mixPlanes(float *const *planes, int idx, const glm::vec3 &v, float mix) {
+		for (int c = 0; c < 3; c++) planes[c][idx] = glm::mix(v[c], planes[c][idx], mix);
+	}
+}
+
+
+const char * aovName(AOV a) {
+	return aov_names[a];
+}
+
+
+AOV aovFromName(const std::string &name) {
+	for (int a = 0; a < aov_count; a++) {
+		if (name == aov_names[a]) return AOV(a);
+	}
+	throw std::invalid_argument("Unknown AOV " + name);
+}
+
+
+void Framebuffer::configure(int w, int h, unsigned aovs, int light_count, bool clear) {
+	m_width = w;
+	m_height = h;
+	m_enabled = aovs;
+	m_light_count = std::min(std::max(light_count, 0), SampleRecord::max_lights);
+
+	int planes = 0;
+	for (int a = 0; a < aov_count; a++) {
+		m_first[a] = enabled(AOV(a)) ? planes : -1;
+		planes += channels(AOV(a));
+	}
+	m_planes.resize(planes);
+	for (Plane &p : m_planes) {
+		// new storage, so its pages are untouched
+		if (!clear) p = Plane();
+		p.resize(w * h);
+	}
+	if (clear) this->clear(0, w * h);
+}
+
+
+void Framebuffer::clear(int begin, int end) {
+	for (Plane &p : m_planes) std::fill(p.begin() + begin, p.begin() + end, 0.f);
+
+	// misses until written
+	if (enabled(aov_object)) std::fill(m_planes[m_first[aov_object]].begin() + begin, m_planes[m_first[aov_object]].begin() + end, -1.f);
+}
+
+
+int Framebuffer::channels(AOV a) const {
+	if (!enabled(a)) return 0;
+	switch (a) {
+	case aov_depth:
+	case aov_object:
+		return 1;
+	case aov_moments:
+		return 2;
+	case aov_lights:
+		return 3 * m_light_count;
+	default:
+		return 3;
+	}
+}
+
+
+void Framebuffer::accumulate(int idx, const glm::vec3 &color, const SampleRecord &record, float mix) {
+	float *p[3];
+	auto planes = [&](AOV a, int first = 0) {
+		for (int c = 0; c < 3; c++) p[c] = m_planes[m_first[a] + first + c].data();
+		return p;
+	};
+
+	if (enabled(aov_color)) mixPlanes(planes(aov_color), idx, color, mix);
+	if (enabled(aov_albedo)) mixPlanes(planes(aov_albedo), idx, record.m_albedo, mix);
+	if (enabled(aov_normal)) mixPlanes(planes(aov_normal), idx, record.m_normal, mix);
+	if (enabled(aov_position)) mixPlanes(planes(aov_position), idx, record.m_position, mix);
+	if (enabled(aov_direct)) mixPlanes(planes(aov_direct), idx, record.m_direct, mix);
+	if (enabled(aov_indirect)) mixPlanes(planes(aov_indirect), idx, record.m_indirect, mix);
+	if (enabled(aov_lights)) {
+		for (int l = 0; l < m_light_count; l++) mixPlanes(planes(aov_lights, 3 * l), idx, record.m_lights[l], mix);
+	}
+
+	if (enabled(aov_depth)) {
+		float &d = m_planes[m_first[aov_depth]][idx];
+		d = glm::mix(record.m_depth, d, mix);
+	}
+
+	if (enabled(aov_object) && mix == 0) {
+		m_planes[m_first[aov_object]][idx] = float(record.m_object);
+	}
+
+	if (enabled(aov_moments)) {
+		float l = luminance(
+			demodulate(color.r, record.m_albedo.r),
+			demodulate(color.g, record.m_albedo.g),
+			demodulate(color.b, record.m_albedo.b));
+		float &m0 = m_planes[m_first[aov_moments]][idx];
+		float &m1 = m_planes[m_first[aov_moments] + 1][idx];
+		m0 = glm::mix(l, m0, mix);
+		m1 = glm::mix(l * l, m1, mix);
+	}
+}
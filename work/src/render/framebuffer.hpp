@@ -0,0 +1,96 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// glm
+#include <glm.hpp>
+
+// project
+#include "numa.hpp"
+#include "scene/path_tracer.hpp"
+
+
+// Arbitrary output variables, the images a render can produce
+enum AOV : int {
+	aov_color,    // rgb, final color
+	aov_albedo,   // rgb, diffuse color of the first hit
+	aov_normal,   // xyz, normal of the first hit
+	aov_depth,    // distance to the first hit (0 for a miss)
+	aov_position, // xyz, world position of the first hit
+	aov_direct,   // rgb, light arriving directly from the lights
+	aov_indirect, // rgb, ambient and reflected light
+	aov_lights,   // rgb per light, direct light from each light
+	aov_object,   // index of the object hit (-1 for a miss)
+	aov_moments,  // mean and mean square of the demodulated luminance
+	aov_count
+};
+
+// bitmask of a single aov
+constexpr unsigned aovBit(AOV a) { return 1u << a; }
+
+// name of an aov
+const char * aovName(AOV a);
+
+// find an aov by name, throws std::invalid_argument for an unknown name
+AOV aovFromName(const std::string &name);
+
+// albedo below this is not divided out when demodulating lighting
+constexpr float min_demodulate_albedo = 0.01f;
+
+inline float demodulate(float v, float albedo) { return (albedo > min_demodulate_albedo) ? v / albedo : v; }
+
+inline float luminance(float r, float g, float b) { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+
+
+// Framebuffer of the enabled AOVs, stored as one plane of floats per
+// channel (structure of arrays) so disabled AOVs cost nothing.
+// All enabled AOVs are written from one SampleRecord per sample, as a
+// running mean, except the object index which is kept from the first
+// sample (the one closest to the pixel center).
+class Framebuffer {
+public:
+	// left uninitialized until cleared, see clear()
+	using Plane = std::vector<float, UninitializedAllocator<float>>;
+
+private:
+	int m_width = 0;
+	int m_height = 0;
+	unsigned m_enabled = 0;
+	int m_light_count = 0;
+
+	// index of the first plane of each aov, or -1 if disabled
+	int m_first[aov_count];
+	std::vector<Plane> m_planes;
+
+public:
+	Framebuffer() { std::fill(m_first, m_first + aov_count, -1); }
+
+	// (re)allocate and clear the planes for the aovs in the mask
+	// light_count is the number of lights split out by aov_lights.
+	// without clearing, the pixels must be cleared before they are used
+	void configure(int w, int h, unsigned aovs, int light_count = 0, bool clear = true);
+
+	// clear pixels [begin, end) of every plane. clearing a new buffer in
+	// a node local loop places each range's pages on the node rendering it
+	void clear(int begin, int end);
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+	int lightCount() const { return m_light_count; }
+	unsigned enabledMask() const { return m_enabled; }
+	bool enabled(AOV a) const { return (m_enabled & aovBit(a)) != 0; }
+
+	// number of channels (planes) of an aov, 0 if disabled
+	int channels(AOV a) const;
+
+	// plane of one channel of an enabled aov
+	float * plane(AOV a, int channel = 0) { return m_planes[m_first[a] + channel].data(); }
+	const float * plane(AOV a, int channel = 0) const { return m_planes[m_first[a] + channel].data(); }
+
+	// mix a sample into pixel idx, mix being the weight of the
+	// existing value (as used for the color running mean)
+	void accumulate(int idx, const glm::vec3 &color, const SampleRecord &record, float mix);
+};
@@ -0,0 +1,297 @@
+// std
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+// project
+#include "hdr_image.hpp"
+
+
+// implemented by stb_image_write (ext/stb, compiled as c) but not in its header
+extern "C" unsigned char * stbi_zlib_compress(unsigned char *data, int data_len, int *out_len, int quality);
+
+
+using namespace std;
+
+
+namespace {
+
+	// nearest (ties to even) half precision float, overflowing to infinity
+	uint16_t toHalf(float f) {
+		uint32_t x;
+		memcpy(&x, &f, 4);
+		uint32_t sign = (x >> 16) & 0x8000;
+		x &= 0x7fffffff;
+
+		// inf and nan (keeping nan a nan)
+		if (x >= 0x7f800000) return uint16_t(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0));
+		// rounds to above 65504
+		if (x >= 0x477ff000) return uint16_t(sign | 0x7c00);
+
+		// normal, rebias the exponent and round off 13 bits of mantissa
+		if (x >= 0x38800000) {
+			uint32_t h = (x - 0x38000000) >> 13;
+			uint32_t rem = x & 0x1fff;
+			if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+			return uint16_t(sign | h);
+		}
+
+		// subnormal (or zero), in units of 2^-24
+		if (x < 0x33000000) return uint16_t(sign);
+		uint32_t m = (x & 0x7fffff) | 0x800000;
+		uint32_t shift = 126 - (x >> 23);
+		uint32_t h = m >> shift;
+		uint32_t rem = m & ((1u << shift) - 1);
+		uint32_t half = 1u << (shift - 1);
+		if (rem > half || (rem == half && (h & 1))) h++;
+		return uint16_t(sign | h);
+	}
+
+	// little endian output
+	void put8(vector<unsigned char> &out, unsigned v) { out.push_back((unsigned char)(v)); }
+	void put16(vector<unsigned char> &out, unsigned v) { put8(out, v); put8(out, v >> 8); }
+	void put32(vector<unsigned char> &out, uint32_t v) { put16(out, v); put16(out, v >> 16); }
+	void put64(vector<unsigned char> &out, uint64_t v) { put32(out, uint32_t(v)); put32(out, uint32_t(v >> 32)); }
+	void putFloat(vector<unsigned char> &out, float f) { uint32_t v; memcpy(&v, &f, 4); put32(out, v); }
+	void putString(vector<unsigned char> &out, const string &s) { out.insert(out.end(), s.begin(), s.end()); put8(out, 0); }
+
+	void putAttribute(vector<unsigned char> &out, const string &name, const string &type, const vector<unsigned char> &value) {
+		putString(out, name);
+		putString(out, type);
+		put32(out, uint32_t(value.size()));
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	void putBox(vector<unsigned char> &out, int w, int h) {
+		put32(out, 0);
+		put32(out, 0);
+		put32(out, uint32_t(w - 1));
+		put32(out, uint32_t(h - 1));
+	}
+
+	// the byte reordering and delta predictor applied before rle and zip
+	// compression, splits even and odd bytes then stores differences
+	void predict(const unsigned char *in, int size, unsigned char *out) {
+		unsigned char *t1 = out, *t2 = out + (size + 1) / 2;
+		for (int i = 0; i < size; i++) {
+			if (i & 1) *t2++ = in[i];
+			else *t1++ = in[i];
+		}
+		int p = out[0];
+		for (int i = 1; i < size; i++) {
+			int d = int(out[i]) - p + (128 + 256);
+			p = out[i];
+			out[i] = (unsigned char)(d);
+		}
+	}
+
+	// runs of 3 to 128 bytes as (count - 1, byte) and
+	// literals as (-count, bytes...), as in OpenEXR
+	void runLengthEncode(const unsigned char *in, int size, vector<unsigned char> &out) {
+		const int min_run = 3, max_run = 127;
+		const unsigned char *start = in, *end = in + size;
+		while (start < end) {
+			const unsigned char *run = start + 1;
+			while (run < end && *start == *run && run - start - 1 < max_run) ++run;
+			if (run - start >= min_run) {
+				out.push_back((unsigned char)(run - start - 1));
+				out.push_back(*start);
+				start = run;
+			}
+			else {
+				while (run < end && (run + 1 >= end || run[0] != run[1] || run + 2 >= end || run[1] != run[2]) && run - start < max_run) ++run;
+				out.push_back((unsigned char)(start - run));
+				out.insert(out.end(), start, run);
+				start = run;
+			}
+		}
+	}
+
+	bool hasExtension(const string &filename, const string &ext) {
+		return filename.size() >= ext.size() && equal(ext.rbegin(), ext.rend(), filename.rbegin(),
+			[](char a, char b) { return tolower(a) == tolower(b); });
+	}
+}
+
+
+ImageView framebufferImage(const Framebuffer &fb, unsigned aovs) {
+	ImageView image;
+	image.m_width = fb.width();
+	image.m_height = fb.height();
+
+	auto want = [&](AOV a) { return (aovs & aovBit(a)) && fb.enabled(a); };
+	auto add3 = [&](AOV a, const string &prefix, const char *names, int first = 0) {
+		for (int c = 0; c < 3; c++) image.add(prefix + names[c], fb.plane(a, first + c));
+	};
+
+	if (want(aov_color)) add3(aov_color, "", "RGB");
+	if (want(aov_albedo)) add3(aov_albedo, "albedo.", "RGB");
+	if (want(aov_normal)) add3(aov_normal, "normal.", "XYZ");
+	if (want(aov_depth)) image.add("Z", fb.plane(aov_depth));
+	if (want(aov_position)) add3(aov_position, "P.", "XYZ");
+	if (want(aov_direct)) add3(aov_direct, "direct.", "RGB");
+	if (want(aov_indirect)) add3(aov_indirect, "indirect.", "RGB");
+	if (want(aov_lights)) {
+		for (int l = 0; l < fb.lightCount(); l++) add3(aov_lights, "light" + to_string(l) + ".", "RGB", 3 * l);
+	}
+	if (want(aov_object)) image.add("object.id", fb.plane(aov_object));
+	return image;
+}
+
+
+bool writePFM(const string &filename, const ImageView &image) {
+	const int w = image.m_width, h = image.m_height;
+	const int n = int(image.m_channels.size());
+	if (n != 1 && n != 3) return false;
+
+	ofstream file(filename, ios::binary);
+	if (!file) return false;
+
+	// negative scale for little endian, rows are stored bottom up
+	file << (n == 3 ? "PF" : "Pf") << "\n" << w << " " << h << "\n-1.0\n";
+
+	vector<unsigned char> row;
+	row.reserve(w * n * 4);
+	for (int y = 0; y < h && file; y++) {
+		row.clear();
+		for (int x = 0; x < w; x++) {
+			for (const ImageChannel &c : image.m_channels) putFloat(row, c.m_data[(y * w + x) * c.m_stride]);
+		}
+		file.write(reinterpret_cast<const char *>(row.data()), row.size());
+	}
+	return bool(file);
+}
+
+
+bool writeEXR(const string &filename, const ImageView &image, ExrPixelType type, ExrCompression compression) {
+	const int w = image.m_width, h = image.m_height;
+	if (w <= 0 || h <= 0 || image.m_channels.empty()) return false;
+
+	// channels must be stored in alphabetical order
+	vector<const ImageChannel *> channels;
+	for (const ImageChannel &c : image.m_channels) channels.push_back(&c);
+	sort(channels.begin(), channels.end(), [](const ImageChannel *a, const ImageChannel *b) { return a->m_name < b->m_name; });
+
+	// header
+	vector<unsigned char> header, value;
+	put32(header, 20000630); // magic
+	put32(header, 2); // version, single part scanline
+
+	for (const ImageChannel *c : channels) {
+		putString(value, c->m_name);
+		put32(value, type);
+		put32(value, 0); // linear and reserved
+		put32(value, 1); // x sampling
+		put32(value, 1); // y sampling
+	}
+	put8(value, 0);
+	putAttribute(header, "channels", "chlist", value);
+
+	value.clear();
+	put8(value, compression);
+	putAttribute(header, "compression", "compression", value);
+
+	value.clear();
+	putBox(value, w, h);
+	putAttribute(header, "dataWindow", "box2i", value);
+	putAttribute(header, "displayWindow", "box2i", value);
+
+	value.clear();
+	put8(value, 0); // increasing y
+	putAttribute(header, "lineOrder", "lineOrder", value);
+
+	value.clear();
+	putFloat(value, 1);
+	putAttribute(header, "pixelAspectRatio", "float", value);
+	putAttribute(header, "screenWindowWidth", "float", value);
+
+	value.clear();
+	putFloat(value, 0);
+	putFloat(value, 0);
+	putAttribute(header, "screenWindowCenter", "v2f", value);
+	put8(header, 0);
+
+	ofstream file(filename, ios::binary);
+	if (!file) return false;
+	file.write(reinterpret_cast<const char *>(header.data()), header.size());
+
+	// offset table, filled in once the chunk sizes are known
+	const int lines = (compression == exr_zip) ? 16 : 1;
+	const int chunks = (h + lines - 1) / lines;
+	const streamoff table = file.tellp();
+	vector<uint64_t> offsets(chunks, 0);
+	file.write(reinterpret_cast<const char *>(offsets.data()), chunks * sizeof(uint64_t));
+
+	// one chunk of lines at a time
+	const int value_size = (type == exr_half) ? 2 : 4;
+	vector<unsigned char> raw, predicted, packed;
+	raw.reserve(size_t(w) * lines * channels.size() * value_size);
+	predicted.resize(raw.capacity());
+
+	for (int k = 0; k < chunks && file; k++) {
+		const int y0 = k * lines;
+		const int y1 = min(h, y0 + lines);
+
+		// scanlines are top down, each a run of every pixel for each channel
+		raw.clear();
+		for (int y = y0; y < y1; y++) {
+			const int row = (h - 1 - y) * w;
+			for (const ImageChannel *c : channels) {
+				const float *data = c->m_data + row * c->m_stride;
+				if (type == exr_half) {
+					for (int x = 0; x < w; x++) put16(raw, toHalf(data[x * c->m_stride]));
+				}
+				else {
+					for (int x = 0; x < w; x++) putFloat(raw, data[x * c->m_stride]);
+				}
+			}
+		}
+
+		// compressed data is only used if it is smaller
+		const int size = int(raw.size());
+		const unsigned char *data = raw.data();
+		int data_size = size;
+		if (compression != exr_none) {
+			predict(raw.data(), size, predicted.data());
+			packed.clear();
+			if (compression == exr_rle) {
+				runLengthEncode(predicted.data(), size, packed);
+			}
+			else {
+				int len = 0;
+				unsigned char *z = stbi_zlib_compress(predicted.data(), size, &len, 8);
+				if (z) packed.assign(z, z + len);
+				free(z);
+			}
+			if (!packed.empty() && int(packed.size()) < size) {
+				data = packed.data();
+				data_size = int(packed.size());
+			}
+		}
+
+		offsets[k] = uint64_t(file.tellp());
+		vector<unsigned char> chunk_header;
+		put32(chunk_header, uint32_t(y0));
+		put32(chunk_header, uint32_t(data_size));
+		file.write(reinterpret_cast<const char *>(chunk_header.data()), chunk_header.size());
+		file.write(reinterpret_cast<const char *>(data), data_size);
+	}
+
+	vector<unsigned char> table_data;
+	for (uint64_t offset : offsets) put64(table_data, offset);
+	file.seekp(table);
+	file.write(reinterpret_cast<const char *>(table_data.data()), table_data.size());
+	return bool(file);
+}
+
+
+future<bool> writeHDRAsync(const string &filename, const ImageView &image, ExrPixelType type, ExrCompression compression) {
+	return async(launch::async, [=]() {
+		if (hasExtension(filename, ".pfm")) return writePFM(filename, image);
+		if (hasExtension(filename, ".exr")) return writeEXR(filename, image, type, compression);
+		return false;
+	});
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// std
+#include <future>
+#include <string>
+#include <vector>
+
+// project
+#include "framebuffer.hpp"
+
+
+// A channel of an image to write, a pointer to the value of the bottom
+// left pixel and the number of floats between consecutive pixels
+// (rows are stored bottom up without padding)
+class ImageChannel {
+public:
+	std::string m_name;
+	const float *m_data = nullptr;
+	int m_stride = 1;
+};
+
+
+// An image to write, referencing (not owning) the data of its channels
+// which must stay alive and unchanged until writing has finished
+class ImageView {
+public:
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<ImageChannel> m_channels;
+
+	void add(const std::string &name, const float *data, int stride = 1) {
+		m_channels.push_back({ name, data, stride });
+	}
+};
+
+
+// Channels of the enabled aovs (in the mask) of a framebuffer, named
+// as in exr layers : albedo.R, normal.X, light0.R, Z (depth), object.id.
+// Color is named R, G, B. The luminance moments are never included
+ImageView framebufferImage(const Framebuffer &fb, unsigned aovs);
+
+
+enum ExrPixelType { exr_half = 1, exr_float = 2 };
+enum ExrCompression { exr_none = 0, exr_rle = 1, exr_zips = 2, exr_zip = 3 };
+
+// Portable float map of a 1 (grey) or 3 (rgb) channel image
+bool writePFM(const std::string &filename, const ImageView &image);
+
+// OpenEXR scanline image with every channel of the image, as half or
+// float, with no, run length or zlib (1 or 16 scanline) compression.
+// Converts and writes a block of scanlines at a time straight from the
+// channel data, so no copy of the image is ever made
+bool writeEXR(const std::string &filename, const ImageView &image, ExrPixelType type = exr_half, ExrCompression compression = exr_zip);
+
+// write a .pfm or .exr (by extension, other names fail) on a background thread
+std::future<bool> writeHDRAsync(const std::string &filename, const ImageView &image, ExrPixelType type = exr_half, ExrCompression compression = exr_zip);
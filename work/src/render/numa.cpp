@@ -0,0 +1,94 @@
+// std
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// posix
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+// project
+#include "numa.hpp"
+
+
+using namespace std;
+
+
+namespace {
+	// parse a sysfs list like "0-3,8-11"
+	vector<int> parseList(const string &list) {
+		vector<int> values;
+		istringstream in(list);
+		for (string range; getline(in, range, ',');) {
+			if (range.empty()) continue;
+			size_t dash = range.find('-');
+			int first = stoi(range.substr(0, dash));
+			int last = (dash == string::npos) ? first : stoi(range.substr(dash + 1));
+			for (int v = first; v <= last; v++) values.push_back(v);
+		}
+		return values;
+	}
+
+	string readLine(const string &filename) {
+		ifstream file(filename);
+		string line;
+		getline(file, line);
+		return line;
+	}
+
+	vector<vector<int>> readNodes() {
+		vector<vector<int>> nodes;
+#ifdef __linux__
+		try {
+			const string dir = "/sys/devices/system/node/";
+			for (int node : parseList(readLine(dir + "online"))) {
+				vector<int> cpus = parseList(readLine(dir + "node" + to_string(node) + "/cpulist"));
+				if (!cpus.empty()) nodes.push_back(cpus);
+			}
+		}
+		catch (...) {
+			nodes.clear();
+		}
+#endif // __linux__
+		if (nodes.empty()) {
+			vector<int> cpus(max(int(thread::hardware_concurrency()), 1));
+			for (int cpu = 0; cpu < int(cpus.size()); cpu++) cpus[cpu] = cpu;
+			nodes.push_back(cpus);
+		}
+		return nodes;
+	}
+}
+
+
+const NumaTopology & NumaTopology::system() {
+	static const NumaTopology topology = []() {
+		NumaTopology t;
+		t.m_nodes = readNodes();
+		return t;
+	}();
+	return topology;
+}
+
+
+int NumaTopology::cpuCount() const {
+	int count = 0;
+	for (const vector<int> &cpus : m_nodes) count += int(cpus.size());
+	return count;
+}
+
+
+bool pinThread(int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void) cpu;
+	return false;
+#endif // __linux__
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// std
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// The cpus of each numa node, read from sysfs on linux. Elsewhere (or
+// without numa) all of the cpus are one node.
+class NumaTopology {
+private:
+	std::vector<std::vector<int>> m_nodes;
+
+public:
+	// the topology of this machine, read once
+	static const NumaTopology & system();
+
+	int nodeCount() const { return int(m_nodes.size()); }
+	const std::vector<int> & cpus(int node) const { return m_nodes[node]; }
+	int cpuCount() const;
+};
+
+
+// pin the calling thread to a cpu, false if that isn't supported
+bool pinThread(int cpu);
+
+
+// Allocator leaving trivially constructible values uninitialized, so the
+// pages of a new buffer are only placed (on the numa node of the thread
+// that first writes them) once they are filled in by their users.
+template <typename T>
+class UninitializedAllocator : public std::allocator<T> {
+public:
+	template <typename U>
+	struct rebind { using other = UninitializedAllocator<U>; };
+
+	UninitializedAllocator() { }
+	template <typename U>
+	UninitializedAllocator(const UninitializedAllocator<U> &) { }
+
+	template <typename U>
+	void construct(U *p) {
+		if (std::is_trivially_default_constructible<U>::value) ::new(static_cast<void *>(p)) U;
+		else ::new(static_cast<void *>(p)) U();
+	}
+
+	template <typename U, typename... Args>
+	void construct(U *p, Args&&... args) { ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+};
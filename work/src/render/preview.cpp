@@ -0,0 +1,91 @@
+// std
+#include <algorithm>
+#include <cmath>
+
+// project
+#include "preview.hpp"
+
+
+int PreviewController::next(int width, int height, bool moving) {
+	const int scale = m_scale;
+	const float rate = m_rate;
+	if (!moving) {
+		m_scale = std::max(scale / 2, 1);
+		return m_scale;
+	}
+	if (rate <= 0) {
+		m_scale = m_max_scale;
+		return m_scale;
+	}
+
+	// finest scale that fits the budget, only getting finer with some
+	// headroom so noise in the rate doesn't flip between two scales
+	const float budget = rate * m_target_frame_time;
+	int s = 1;
+	for (; s < m_max_scale; s++) {
+		const float samples = float((width + s - 1) / s) * float((height + s - 1) / s);
+		if (samples <= ((s < scale) ? 0.8f : 1.f) * budget) break;
+	}
+	m_scale = s;
+	return s;
+}
+
+
+void PreviewController::record(long samples, float seconds) {
+	if (samples <= 0 || seconds <= 0) return;
+	const float rate = samples / seconds;
+	const float last = m_rate;
+	m_rate = (last > 0) ? glm::mix(last, rate, 0.3f) : rate;
+}
+
+
+void upsamplePreview(int width, int height, int scale, const glm::vec3 *color, const float *depth, float *out, int out_stride,
+	RenderPool &pool, int priority, float sigma_depth)
+{
+	const int lw = (width + scale - 1) / scale;
+	const int lh = (height + scale - 1) / scale;
+	const float inv_scale = 1.f / scale;
+
+	pool.parallelFor(height, 16, priority, 0, [&](int begin, int end) {
+		for (int y = begin; y < end; y++) {
+			// samples are taken as at the centre of their block
+			const float v = (y + 0.5f) * inv_scale - 0.5f;
+			const int y0 = glm::clamp(int(std::floor(v)), 0, lh - 1);
+			const int y1 = std::min(y0 + 1, lh - 1);
+			const float fy = glm::clamp(v - y0, 0.f, 1.f);
+
+			for (int x = 0; x < width; x++) {
+				const float u = (x + 0.5f) * inv_scale - 0.5f;
+				const int x0 = glm::clamp(int(std::floor(u)), 0, lw - 1);
+				const int x1 = std::min(x0 + 1, lw - 1);
+				const float fx = glm::clamp(u - x0, 0.f, 1.f);
+
+				const float ref = depth[(y / scale) * lw + x / scale];
+				const int taps[4] = { y0 * lw + x0, y0 * lw + x1, y1 * lw + x0, y1 * lw + x1 };
+				const float bilinear[4] = { (1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy };
+
+				glm::vec3 sum{ 0 };
+				float weight = 0;
+				for (int k = 0; k < 4; k++) {
+					const float d = depth[taps[k]];
+					// misses only blend with misses
+					float w = 0;
+					if ((d > 0) == (ref > 0)) {
+						const float e = (ref > 0) ? (d - ref) / (sigma_depth * ref) : 0;
+						w = bilinear[k] * std::exp(-e * e) + 1e-6f;
+					}
+					sum += w * color[taps[k]];
+					weight += w;
+				}
+
+				// the block's own sample is always one of the four and matches
+				// itself, so the weight is never zero
+				const glm::vec3 c = sum / weight;
+				float *p = out + size_t(y * width + x) * out_stride;
+				p[0] = c.r;
+				p[1] = c.g;
+				p[2] = c.b;
+			}
+		}
+	});
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// std
+#include <atomic>
+
+// glm
+#include <glm.hpp>
+
+// project
+#include "render_pool.hpp"
+
+
+// Picks the resolution of interactive preview frames. While the view is
+// changing every frame is traced at 1/scale of the render size (in each
+// direction), with the scale chosen from the measured rate of camera
+// samples so a frame takes about the target time. Once the view stops
+// the scale is halved every frame back to full resolution.
+// Frames are measured and scaled by the render thread while the gui sets
+// the target and shows the scale and rate, so those are atomic.
+class PreviewController {
+private:
+	std::atomic<float> m_rate{ 0 }; // smoothed camera samples per second, 0 until measured
+	std::atomic<int> m_scale{ 1 };
+
+public:
+	std::atomic<float> m_target_frame_time{ 1 / 30.f }; // seconds
+	int m_max_scale = 8;
+
+	// current scale (1 is full resolution)
+	int scale() const { return m_scale; }
+	float samplesPerSecond() const { return m_rate; }
+
+	// scale of the next frame of a width x height render, for a changing
+	// view (coarsest until a rate is measured) or a refining one
+	int next(int width, int height, bool moving);
+
+	// measure a frame (or pass) of samples that took seconds
+	void record(long samples, float seconds);
+};
+
+
+// Upsample an image traced with one sample per scale x scale block (of
+// ceil(width / scale) x ceil(height / scale) samples) to width x height
+// into out, with stride floats between pixels. Pixels interpolate the
+// nearest samples weighted by their difference in first hit depth (0 for
+// a miss) from the sample of their own block, so edges stay sharp.
+// Rows are upsampled in parallel on pool at priority.
+void upsamplePreview(int width, int height, int scale, const glm::vec3 *color, const float *depth, float *out, int out_stride,
+	RenderPool &pool, int priority, float sigma_depth = 0.05f);
@@ -0,0 +1,124 @@
+// project
+#include "render_job.hpp"
+
+
+using namespace std;
+
+
+RenderJob::RenderJob(Body body, int priority, RenderPool &pool)
+	: m_pool(pool), m_priority(priority), m_start_time(chrono::steady_clock::now())
+{
+	auto promise = make_shared<std::promise<void>>();
+	m_finished = promise->get_future().share();
+	m_thread = thread([this, body = move(body), promise]() {
+		exception_ptr error;
+		try {
+			body(*this);
+		}
+		catch (...) {
+			error = current_exception();
+		}
+
+		// done before the future is ready, so waiting implies done()
+		m_seconds = float((chrono::steady_clock::now() - m_start_time) / 1.0s);
+		m_done = true;
+		if (error) promise->set_exception(error);
+		else promise->set_value();
+	});
+}
+
+
+RenderJob::~RenderJob() {
+	cancel();
+	if (m_thread.joinable()) m_thread.join();
+}
+
+
+RenderProgress RenderJob::progress() const {
+	RenderProgress p;
+	p.m_passes = m_passes;
+	p.m_total_passes = m_total_passes;
+	const int count = m_loop_count;
+	p.m_pass_fraction = (count > 0) ? float(m_loop_finished) / count : 0;
+	p.m_done = m_done;
+	p.m_cancelled = m_cancelled;
+	p.m_seconds = p.m_done ? float(m_seconds) : float((chrono::steady_clock::now() - m_start_time) / 1.0s);
+	return p;
+}
+
+
+
+void PathTracerReplicas::update(PathTracer &pathtracer, RenderPool &pool) {
+	if (m_source == &pathtracer) return;
+	clear();
+	m_source = &pathtracer;
+	if (pool.nodes() < 2 || pathtracer.m_scene->bytes() > m_max_bytes) return;
+
+	// one item per node
+	const int nodes = pool.nodes();
+	m_scenes.resize(nodes);
+	m_pathtracers.resize(nodes);
+	pool.parallelFor(nodes, 1, render_priority_interactive, 0, [&](int begin, int end) {
+		for (int node = begin; node < end; node++) {
+			m_scenes[node] = std::make_unique<Scene>(pathtracer.m_scene->replicate());
+			m_pathtracers[node] = pathtracer.clone(m_scenes[node].get());
+		}
+	}, true);
+}
+
+
+void PathTracerReplicas::clear() {
+	m_pathtracers.clear();
+	m_scenes.clear();
+	m_source = nullptr;
+}
+
+
+
+FrameJob::FrameJob(const RenderSettings &settings, PathTracer &pathtracer, int light_count, int priority, RenderPool &pool)
+	: m_settings(settings), m_pathtracer(pathtracer)
+{
+	// cleared by the job, on the nodes rendering each part
+	m_framebuffer.configure(settings.m_width, settings.m_height, settings.m_aovs, light_count, false);
+	m_job = make_unique<RenderJob>([this](RenderJob &job) { run(job); }, priority, pool);
+}
+
+
+void FrameJob::run(RenderJob &job) {
+	const RenderSettings &s = m_settings;
+	const int w = s.m_width, h = s.m_height;
+	Camera camera = s.camera();
+	job.setPasses(0, s.m_samples);
+	m_replicas.update(m_pathtracer, job.pool());
+	job.parallelFor(w * h, [&](int idx) { m_framebuffer.clear(idx, idx + 1); }, 0, 4096, true);
+
+	for (int pass = 0; pass < s.m_samples; pass++) {
+		const float mix = pass / float(pass + 1);
+		bool complete = job.parallelForBatches(w * h, [&](int begin, int end) {
+			SampleBatch batch(end - begin);
+			traceSamples(s, m_replicas.local(), camera, 0, 0, w, begin, end, pass, batch);
+			for (int idx = begin; idx < end; idx++) m_framebuffer.accumulate(idx, batch.m_colors[idx - begin], batch.m_records[idx - begin], mix);
+		}, 0, 256);
+
+		if (!complete) return;
+		if (m_snapshot_requested.exchange(false)) {
+			lock_guard<mutex> lock(m_snapshot_mutex);
+			m_snapshot = m_framebuffer;
+		}
+		job.setPasses(pass + 1, s.m_samples);
+	}
+}
+
+
+Framebuffer FrameJob::snapshot() const {
+	if (m_job->done()) return m_framebuffer;
+	m_snapshot_requested = true;
+	lock_guard<mutex> lock(m_snapshot_mutex);
+	return m_snapshot;
+}
+
+
+const Framebuffer & FrameJob::result() {
+	m_job->finished().get();
+	return m_framebuffer;
+}
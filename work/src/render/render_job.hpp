@@ -0,0 +1,185 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// project
+#include "framebuffer.hpp"
+#include "render_pool.hpp"
+#include "work_unit.hpp"
+#include "scene/arena.hpp"
+
+
+// priorities of the renders sharing a pool
+const int render_priority_background = 0;
+const int render_priority_interactive = 10;
+
+
+// Snapshot of how far a render job has got
+class RenderProgress {
+public:
+	int m_passes = 0; // completed
+	int m_total_passes = 0; // 0 if open ended
+	float m_pass_fraction = 0; // of the pass being rendered
+	float m_seconds = 0; // since it started, until it ended
+	bool m_done = false; // finished, failed or cancelled
+	bool m_cancelled = false;
+};
+
+
+// A render running in the background that can be waited on or cancelled.
+// The body runs on a thread of its own that only coordinates, every
+// parallel loop it runs goes to the pool at the job's priority. Bodies
+// report their passes for progress and return early once cancelled.
+class RenderJob {
+public:
+	using Body = std::function<void(RenderJob &)>;
+
+private:
+	RenderPool &m_pool;
+	std::atomic<int> m_priority;
+	std::atomic<bool> m_cancelled{ false };
+	std::atomic<bool> m_done{ false };
+
+	// progress, written by the body
+	std::atomic<int> m_passes{ 0 };
+	std::atomic<int> m_total_passes{ 0 };
+	std::atomic<int> m_loop_count{ 0 };
+	std::atomic<int> m_loop_finished{ 0 };
+	std::chrono::steady_clock::time_point m_start_time;
+	std::atomic<float> m_seconds{ 0 }; // set once done
+
+	std::shared_future<void> m_finished;
+	std::thread m_thread;
+
+public:
+	// start body straight away
+	RenderJob(Body body, int priority = render_priority_background, RenderPool &pool = RenderPool::shared());
+
+	// cancels and waits for the body
+	~RenderJob();
+
+	RenderJob(const RenderJob &) = delete;
+	RenderJob & operator=(const RenderJob &) = delete;
+
+	// for the body
+
+	// run loop(i) for i in [0, count) on the pool, on at most max_threads
+	// (<= 0 for all of the pool). returns false if the job was cancelled,
+	// in which case the rest of the loop is skipped. the scratch arena of
+	// each thread is reset for every chunk. loop is only referenced, so
+	// nothing is allocated however much it captures. a node local loop
+	// only runs each partition of the pool on its own numa node
+	template <typename Loop>
+	bool parallelFor(int count, const Loop &loop, int max_threads = 0, int chunk_size = 64, bool node_local = false) {
+		return parallelForBatches(count, [&loop](int begin, int end) {
+			for (int i = begin; i < end; i++) loop(i);
+		}, max_threads, chunk_size, node_local);
+	}
+
+	// parallelFor calling batch(begin, end) once per chunk instead, for
+	// loops that trace the rays of a chunk together
+	template <typename Batch>
+	bool parallelForBatches(int count, const Batch &batch, int max_threads = 0, int chunk_size = 64, bool node_local = false) {
+		m_loop_count = count;
+		m_loop_finished = 0;
+		m_pool.parallelFor(count, chunk_size, m_priority, max_threads, [this, &batch](int begin, int end) {
+			if (m_cancelled) return;
+			scratchArena().reset();
+			batch(begin, end);
+			m_loop_finished += end - begin;
+		}, node_local);
+		return !m_cancelled;
+	}
+
+	RenderPool & pool() { return m_pool; }
+
+	void setPasses(int passes, int total_passes) { m_passes = passes; m_total_passes = total_passes; }
+
+	// for the owner
+
+	void cancel() { m_cancelled = true; }
+	bool cancelled() const { return m_cancelled; }
+	bool done() const { return m_done; }
+
+	// used for the loops the body runs from now on
+	void setPriority(int priority) { m_priority = priority; }
+	int priority() const { return m_priority; }
+
+	// ready once the body has returned, get() rethrows anything it threw
+	std::shared_future<void> finished() const { return m_finished; }
+	void wait() const { m_finished.wait(); }
+
+	RenderProgress progress() const;
+};
+
+
+// Copies of a pathtracer and its scene on each numa node of a pool, made
+// by a thread on the node so the bvh and primitives every ray reads are
+// in its local memory. Nothing is copied for a pool on a single node, or
+// for scenes over m_max_bytes, which are shared by all of the nodes.
+// Replicas are of the scene as it was, update again once it changes.
+class PathTracerReplicas {
+private:
+	PathTracer *m_source = nullptr;
+	std::vector<std::unique_ptr<Scene>> m_scenes; // per node
+	std::vector<std::unique_ptr<PathTracer>> m_pathtracers;
+
+public:
+	size_t m_max_bytes = size_t(256) << 20;
+
+	// replicate pathtracer over the nodes of pool, unless already done
+	void update(PathTracer &pathtracer, RenderPool &pool);
+	void clear();
+
+	// the replica for the node of the calling thread, or the source
+	PathTracer & local() {
+		if (m_pathtracers.empty()) return *m_source;
+		return *m_pathtracers[RenderPool::currentNode()];
+	}
+};
+
+
+// Renders every sample of a frame with the given settings (as a headless
+// or distributed render would) as a job. The framebuffer is only copied
+// out for progress snapshots once one has been asked for, at the end of
+// the next pass, so nothing is copied while nobody watches.
+// The pathtracer (and its scene) must outlive the job, and the scene is
+// replicated over the numa nodes of the pool when it starts.
+class FrameJob {
+private:
+	RenderSettings m_settings;
+	PathTracer &m_pathtracer;
+	PathTracerReplicas m_replicas;
+	Framebuffer m_framebuffer; // being rendered, the result once done
+	mutable std::mutex m_snapshot_mutex;
+	mutable std::atomic<bool> m_snapshot_requested{ false };
+	Framebuffer m_snapshot; // as of the last pass that ended after a request
+	std::unique_ptr<RenderJob> m_job; // last, so it stops first
+
+	void run(RenderJob &job);
+
+public:
+	FrameJob(const RenderSettings &settings, PathTracer &pathtracer, int light_count,
+		int priority = render_priority_background, RenderPool &pool = RenderPool::shared());
+
+	RenderJob & job() { return *m_job; }
+	const RenderJob & job() const { return *m_job; }
+
+	// the framebuffer once the job is done, otherwise as of the end of the
+	// last pass since the previous call (empty until a pass has ended after
+	// the first call), and asks for another at the end of the current pass
+	Framebuffer snapshot() const;
+
+	// wait for the job and return the final framebuffer (if it was cancelled
+	// the pixels of the pass it was in may have one more sample than the
+	// rest). rethrows anything the render threw
+	const Framebuffer & result();
+};
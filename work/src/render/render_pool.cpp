@@ -0,0 +1,180 @@
+// std
+#include <algorithm>
+#include <exception>
+
+// project
+#include "numa.hpp"
+#include "render_pool.hpp"
+
+
+using namespace std;
+
+
+namespace {
+	thread_local int current_node = 0;
+
+	// options of the shared pool
+	mutex shared_mutex;
+	bool shared_created = false;
+	int shared_threads = 0;
+	bool shared_pin = false;
+}
+
+
+struct RenderPool::Loop {
+	const function<void(int, int)> *body;
+	int count, chunk_size;
+	int priority, max_threads;
+	bool node_local;
+	long order;
+	int partitions;
+	int next[max_partitions]; // start of the next chunk of each partition
+	int end[max_partitions];
+	int running = 0; // threads in a chunk
+	int finished = 0; // items done
+	exception_ptr error; // the first thrown by the body
+
+	// partition a thread of node takes its next chunk from: its own while
+	// that has chunks left, then the one with the most left. -1 for none
+	int partitionFor(int node) const {
+		if (next[node] < end[node]) return node;
+		if (node_local) return -1;
+		int best = -1;
+		for (int p = 0; p < partitions; p++) {
+			if (next[p] < end[p] && (best < 0 || end[p] - next[p] > end[best] - next[best])) best = p;
+		}
+		return best;
+	}
+
+	bool started() const {
+		for (int p = 0; p < partitions; p++) {
+			if (next[p] < end[p]) return false;
+		}
+		return true;
+	}
+};
+
+
+RenderPool::RenderPool(int threads, bool pin) {
+	const NumaTopology &topology = NumaTopology::system();
+	if (threads <= 0) threads = pin ? topology.cpuCount() : max(int(thread::hardware_concurrency()), 1);
+	m_loops.reserve(16); // so submitting a loop doesn't allocate
+
+	// thread i goes to node i % nodes, so every partition has a thread
+	if (pin) m_nodes = max(min({ topology.nodeCount(), threads, max_partitions }), 1);
+	for (int i = 0; i < threads; i++) {
+		const int node = i % m_nodes;
+		int cpu = -1;
+		if (pin) {
+			const vector<int> &cpus = topology.cpus(node);
+			cpu = cpus[(i / m_nodes) % cpus.size()];
+		}
+		m_threads.emplace_back([this, node, cpu]() {
+			if (cpu >= 0) pinThread(cpu);
+			current_node = node;
+			run(node);
+		});
+	}
+}
+
+
+RenderPool::~RenderPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_work.notify_all();
+	for (thread &t : m_threads) t.join();
+}
+
+
+void RenderPool::parallelFor(int count, int chunk_size, int priority, int max_threads, const function<void(int, int)> &body, bool node_local) {
+	if (count <= 0) return;
+	Loop loop;
+	loop.body = &body;
+	loop.count = count;
+	loop.chunk_size = max(chunk_size, 1);
+	loop.priority = priority;
+	loop.max_threads = (max_threads > 0) ? max_threads : size();
+	loop.node_local = node_local;
+	loop.partitions = m_nodes;
+	for (int p = 0; p < m_nodes; p++) partition(count, p, loop.next[p], loop.end[p]);
+
+	unique_lock<mutex> lock(m_mutex);
+	loop.order = m_next_order++;
+	m_loops.push_back(&loop);
+	m_work.notify_all();
+	m_done.wait(lock, [&]() { return loop.finished == loop.count; });
+	if (loop.error) rethrow_exception(loop.error);
+}
+
+
+void RenderPool::run(int node) {
+	unique_lock<mutex> lock(m_mutex);
+	while (true) {
+		// highest priority loop this thread may join
+		Loop *loop = nullptr;
+		int part = -1;
+		m_work.wait(lock, [&]() {
+			loop = nullptr;
+			for (Loop *l : m_loops) {
+				if (l->running >= l->max_threads) continue;
+				if (loop && (l->priority < loop->priority || (l->priority == loop->priority && l->order > loop->order))) continue;
+				const int p = l->partitionFor(node);
+				if (p < 0) continue;
+				loop = l;
+				part = p;
+			}
+			return m_stop || loop;
+		});
+		if (m_stop) return;
+
+		const int begin = loop->next[part];
+		const int end = min(begin + loop->chunk_size, loop->end[part]);
+		loop->next[part] = end;
+		loop->running++;
+		if (loop->started()) m_loops.erase(find(m_loops.begin(), m_loops.end(), loop));
+
+		lock.unlock();
+		exception_ptr error;
+		try {
+			(*loop->body)(begin, end);
+		}
+		catch (...) {
+			error = current_exception();
+		}
+		lock.lock();
+		if (error && !loop->error) loop->error = error;
+
+		// the loop may be gone as soon as the last chunk is counted
+		loop->running--;
+		loop->finished += end - begin;
+		if (loop->finished == loop->count) m_done.notify_all();
+		else if (m_nodes > 1) m_work.notify_all(); // only some may take the rest
+		else m_work.notify_one();
+	}
+}
+
+
+int RenderPool::currentNode() {
+	return current_node;
+}
+
+
+RenderPool & RenderPool::shared() {
+	static RenderPool pool = []() {
+		lock_guard<mutex> lock(shared_mutex);
+		shared_created = true;
+		return RenderPool(shared_threads, shared_pin);
+	}();
+	return pool;
+}
+
+
+bool RenderPool::configureShared(int threads, bool pin) {
+	lock_guard<mutex> lock(shared_mutex);
+	if (shared_created) return false;
+	shared_threads = threads;
+	shared_pin = pin;
+	return true;
+}
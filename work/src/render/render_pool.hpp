@@ -0,0 +1,78 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of render threads shared by every render in the process.
+// Work is submitted as parallel loops split into chunks, and an idle
+// thread always takes the next chunk of the highest priority loop (the
+// oldest on ties), so a background render only gets the cores that an
+// interactive one leaves idle and the two never oversubscribe them.
+// Priorities take effect between chunks, a running chunk is never
+// interrupted.
+//
+// A pinned pool spreads its threads over the numa nodes, pinning each to
+// a core. Loops are then partitioned into a contiguous range per node,
+// which the node's threads work through before helping the others, so
+// buffers indexed like the loop are mostly written from one node. Their
+// pages are placed there by first touching each partition in a node
+// local loop (see UninitializedAllocator).
+class RenderPool {
+public:
+	static constexpr int max_partitions = 16;
+
+private:
+	struct Loop;
+
+	std::mutex m_mutex;
+	std::condition_variable m_work; // a loop was added or a thread freed up
+	std::condition_variable m_done; // a loop finished
+	std::vector<Loop *> m_loops; // with chunks left to start
+	std::vector<std::thread> m_threads;
+	int m_nodes = 1; // partitions of every loop
+	long m_next_order = 0;
+	bool m_stop = false;
+
+	void run(int node);
+
+public:
+	// threads <= 0 uses one thread per core
+	explicit RenderPool(int threads = 0, bool pin = false);
+	~RenderPool();
+
+	RenderPool(const RenderPool &) = delete;
+	RenderPool & operator=(const RenderPool &) = delete;
+
+	int size() const { return int(m_threads.size()); }
+
+	// numa nodes the threads are spread over, 1 unless pinned
+	int nodes() const { return m_nodes; }
+
+	// range of the partition of node in a loop of count items
+	void partition(int count, int node, int &begin, int &end) const {
+		begin = int(long(count) * node / m_nodes);
+		end = int(long(count) * (node + 1) / m_nodes);
+	}
+
+	// run body(begin, end) over [0, count) in chunks of chunk_size on at
+	// most max_threads of the pool at once (<= 0 for all of them), and
+	// return once every chunk is done. the calling thread only waits.
+	// a node local loop only runs each partition on its own node.
+	// rethrows the first exception thrown by body (after every chunk)
+	void parallelFor(int count, int chunk_size, int priority, int max_threads,
+		const std::function<void(int, int)> &body, bool node_local = false);
+
+	// node of the pool thread calling this, 0 for any other thread
+	static int currentNode();
+
+	// the pool every render uses unless given another
+	static RenderPool & shared();
+
+	// set up the shared pool, only before its first use. false if too late
+	static bool configureShared(int threads, bool pin);
+};
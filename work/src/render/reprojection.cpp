@@ -0,0 +1,91 @@
+// std
+#include <algorithm>
+#include <cmath>
+
+// project
+#include "reprojection.hpp"
+
+
+void TemporalHistory::store(const Camera &camera, const Framebuffer &fb, const float *color, int stride, const float *samples) {
+	m_valid = (fb.enabledMask() & features) == features;
+	if (!m_valid) return;
+
+	const int n = fb.width() * fb.height();
+	m_camera = camera;
+	m_framebuffer = fb;
+	m_color.resize(3 * n);
+	m_samples.assign(samples, samples + n);
+	for (int i = 0; i < n; i++) {
+		for (int c = 0; c < 3; c++) m_color[3 * i + c] = color[i * stride + c];
+	}
+}
+
+
+float TemporalHistory::reproject(const SampleRecord &record, const glm::vec3 &eye, int idx, Framebuffer &fb, float *color, int stride) const {
+	const int w = m_framebuffer.width(), h = m_framebuffer.height();
+	if (!m_valid || record.m_object < 0 || fb.width() != w || fb.height() != h || fb.enabledMask() != m_framebuffer.enabledMask()) return 0;
+
+	glm::vec2 pixel;
+	if (!m_camera.project(record.m_position, pixel)) return 0;
+
+	// bilinear taps around the old pixel centers
+	const float u = pixel.x - 0.5f, v = pixel.y - 0.5f;
+	const int x0 = int(std::floor(u)), y0 = int(std::floor(v));
+	const float fx = u - x0, fy = v - y0;
+
+	const float *nx = m_framebuffer.plane(aov_normal, 0);
+	const float *ny = m_framebuffer.plane(aov_normal, 1);
+	const float *nz = m_framebuffer.plane(aov_normal, 2);
+	const float *px = m_framebuffer.plane(aov_position, 0);
+	const float *py = m_framebuffer.plane(aov_position, 1);
+	const float *pz = m_framebuffer.plane(aov_position, 2);
+	const float *object = m_framebuffer.plane(aov_object);
+	const float max_distance = m_max_plane_distance * record.m_depth;
+
+	int taps[4];
+	float weights[4];
+	int count = 0;
+	float total = 0;
+	for (int k = 0; k < 4; k++) {
+		const int x = x0 + (k & 1), y = y0 + (k >> 1);
+		if (x < 0 || y < 0 || x >= w || y >= h) continue;
+		const int t = y * w + x;
+
+		// the same surface, seen by the first sample of the old pixel
+		if (object[t] != float(record.m_object)) continue;
+		if (glm::dot(glm::vec3(nx[t], ny[t], nz[t]), record.m_normal) < m_min_normal) continue;
+		if (std::abs(glm::dot(glm::vec3(px[t], py[t], pz[t]) - record.m_position, record.m_normal)) > max_distance) continue;
+
+		const float weight = ((k & 1) ? fx : 1 - fx) * ((k >> 1) ? fy : 1 - fy);
+		if (weight <= 0) continue;
+		taps[count] = t;
+		weights[count++] = weight;
+		total += weight;
+	}
+	if (total < 1e-3f) return 0;
+
+	// blend every plane, including the color
+	float samples = 0;
+	for (int k = 0; k < count; k++) samples += weights[k] * m_samples[taps[k]];
+	samples = std::min(samples / total, m_max_samples);
+
+	// a phong lobe falls off as cos^n, about exp(-n (1 - cos)) for small angles
+	const float cos_view = glm::dot(glm::normalize(m_camera.position() - record.m_position), glm::normalize(eye - record.m_position));
+	samples *= 1 - record.m_specular * (1 - std::exp(-record.m_shininess * (1 - cos_view)));
+	if (samples < 0.5f) return 0;
+
+	for (int a = 0; a < aov_count; a++) {
+		for (int c = 0; c < fb.channels(AOV(a)); c++) {
+			const float *src = m_framebuffer.plane(AOV(a), c);
+			float sum = 0;
+			for (int k = 0; k < count; k++) sum += weights[k] * src[taps[k]];
+			fb.plane(AOV(a), c)[idx] = sum / total;
+		}
+	}
+	for (int c = 0; c < 3; c++) {
+		float sum = 0;
+		for (int k = 0; k < count; k++) sum += weights[k] * m_color[3 * taps[k] + c];
+		color[idx * stride + c] = sum / total;
+	}
+	return samples;
+}
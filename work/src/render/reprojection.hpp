@@ -0,0 +1,51 @@
+#pragma once
+
+// std
+#include <vector>
+
+// project
+#include "framebuffer.hpp"
+#include "scene/camera.hpp"
+#include "scene/path_tracer.hpp"
+
+
+// The accumulated render of a previous view, kept so its samples can be
+// reused after the camera moves. Each new pixel's first hit is projected
+// into the old view and blends the (bilinear) neighbouring pixels that
+// saw the same surface, ie. the same object at a similar normal and on
+// the same plane. Anything else, like a disocclusion, starts over.
+// Reused samples are weighted down by the view dependent share of the
+// surface's reflectance, as far as the direction it is seen from has
+// moved across its specular lobe, since highlights and reflections move
+// with the view.
+class TemporalHistory {
+private:
+	Camera m_camera;
+	Framebuffer m_framebuffer;
+	std::vector<float> m_color; // rgb
+	std::vector<float> m_samples;
+	bool m_valid = false;
+
+public:
+	float m_max_samples = 64; // reused samples per pixel at most
+	float m_min_normal = 0.9f; // cosine between normals
+	float m_max_plane_distance = 0.02f; // relative to depth
+
+	// aovs the framebuffer needs to store and reproject a render
+	static constexpr unsigned features = aovBit(aov_normal) | aovBit(aov_position) | aovBit(aov_object);
+
+	bool valid() const { return m_valid; }
+	void clear() { m_valid = false; }
+
+	// keep a render of the camera's view, the framebuffer and rgb color
+	// (with stride floats between pixels) accumulated from samples per
+	// pixel. does nothing if the features are not enabled
+	void store(const Camera &camera, const Framebuffer &fb, const float *color, int stride, const float *samples);
+
+	// reproject the history of the surface a sample first hit (seen from
+	// eye) into pixel idx of the framebuffer and color (of the same size
+	// and aovs).
+	// returns the number of samples the pixel now holds, or 0 (leaving
+	// it untouched) if there is no usable history
+	float reproject(const SampleRecord &record, const glm::vec3 &eye, int idx, Framebuffer &fb, float *color, int stride) const;
+};
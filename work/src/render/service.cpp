@@ -0,0 +1,432 @@
+// std
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <stdexcept>
+
+// project
+#include "service.hpp"
+#include "render_job.hpp"
+#include "render_pool.hpp"
+#include "scene/arena.hpp"
+
+
+// implemented by stb_image_write (ext/stb, compiled as c) but not in its header
+extern "C" unsigned char * stbi_write_png_to_mem(unsigned char *pixels, int stride_bytes, int x, int y, int n, int *out_len);
+
+
+using namespace std;
+
+
+namespace {
+
+	const char * status_names[] = { "queued", "rendering", "done", "cancelled" };
+
+	bool ended(const RenderService::Job &job) {
+		return job.m_status == RenderService::status_done || job.m_status == RenderService::status_cancelled;
+	}
+
+	struct Request {
+		string method;
+		string path;
+		map<string, string> query;
+	};
+
+	string urlDecode(const string &s) {
+		string out;
+		for (size_t i = 0; i < s.size(); i++) {
+			if (s[i] == '+') out += ' ';
+			else if (s[i] == '%' && i + 2 < s.size()) {
+				out += char(strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+				i += 2;
+			}
+			else out += s[i];
+		}
+		return out;
+	}
+
+	vector<string> split(const string &s, char delim) {
+		vector<string> parts;
+		istringstream in(s);
+		for (string part; getline(in, part, delim);) {
+			if (!part.empty()) parts.push_back(part);
+		}
+		return parts;
+	}
+
+	// read the request line and headers, the body is ignored
+	bool readRequest(Socket &socket, Request &request) {
+		string data;
+		char buffer[4096];
+		while (data.find("\r\n\r\n") == string::npos) {
+			if (data.size() > 65536) return false;
+			size_t n = socket.receiveSome(buffer, sizeof(buffer), 10000);
+			if (n == 0) return false;
+			data.append(buffer, n);
+		}
+
+		istringstream line(data.substr(0, data.find("\r\n")));
+		string target;
+		line >> request.method >> target;
+		if (target.empty()) return false;
+
+		size_t q = target.find('?');
+		request.path = urlDecode(target.substr(0, q));
+		if (q != string::npos) {
+			for (const string &param : split(target.substr(q + 1), '&')) {
+				size_t eq = param.find('=');
+				request.query[urlDecode(param.substr(0, eq))] = (eq == string::npos) ? "" : urlDecode(param.substr(eq + 1));
+			}
+		}
+		return true;
+	}
+
+	bool respond(Socket &socket, int code, const string &reason, const string &type, const string &body) {
+		ostringstream head;
+		head << "HTTP/1.1 " << code << " " << reason << "\r\n";
+		head << "Content-Type: " << type << "\r\n";
+		head << "Content-Length: " << body.size() << "\r\n";
+		head << "Connection: close\r\n\r\n";
+		string h = head.str();
+		return socket.send(h.data(), h.size()) && socket.send(body.data(), body.size());
+	}
+
+	// same tonemapping as display.glsl, rows are stored bottom up
+	string encodePNG(const vector<glm::vec3> &image, int w, int h, float exposure) {
+		vector<unsigned char> data(w * h * 3);
+		for (int i = 0; i < w * h; i++) {
+			glm::vec3 c = glm::pow(1.f - glm::exp(-exposure * image[i]), glm::vec3(0.45f));
+			c = glm::clamp(c, glm::vec3(0), glm::vec3(1));
+			for (int k = 0; k < 3; k++) data[i * 3 + k] = (unsigned char)(c[k] * 255 + 0.5f);
+		}
+		int len = 0;
+		unsigned char *png = stbi_write_png_to_mem(data.data() + (h - 1) * w * 3, -w * 3, w, h, 3, &len);
+		string s(reinterpret_cast<char *>(png), png ? len : 0);
+		free(png);
+		return s;
+	}
+
+	// little endian, rows bottom up
+	string encodePFM(const vector<glm::vec3> &image, int w, int h) {
+		ostringstream head;
+		head << "PF\n" << w << " " << h << "\n-1.0\n";
+		string s = head.str();
+		s.reserve(s.size() + image.size() * 12);
+		for (const glm::vec3 &c : image) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t v;
+				memcpy(&v, &c[k], 4);
+				for (int b = 0; b < 4; b++) s += char((v >> (8 * b)) & 0xff);
+			}
+		}
+		return s;
+	}
+
+	string describe(const RenderService::Job &job) {
+		ostringstream out;
+		out << job.m_id << " " << status_names[job.m_status] << " " << job.m_passes << "/" << job.m_settings.m_samples
+			<< " priority " << job.m_priority << " " << job.m_settings.m_scene;
+		return out.str();
+	}
+
+	// settings of a new job from the query parameters
+	void parseJob(const map<string, string> &query, RenderService::Job &job) {
+		RenderSettings &s = job.m_settings;
+		s.m_width = s.m_height = 256;
+		for (const auto &param : query) {
+			const string &key = param.first, &value = param.second;
+			if (key == "scene") s.m_scene = value;
+			else if (key == "pathtracer") s.m_pathtracer = value;
+			else if (key == "width") s.m_width = stoi(value);
+			else if (key == "height") s.m_height = stoi(value);
+			else if (key == "samples") s.m_samples = stoi(value);
+			else if (key == "depth") s.m_ray_depth = stoi(value);
+			else if (key == "seed") s.m_seed = uint32_t(stoul(value));
+			else if (key == "sort") s.m_sort_rays = stoi(value) != 0;
+			else if (key == "priority") job.m_priority = stoi(value);
+			else if (key == "exposure") job.m_exposure = stof(value);
+			else if (key == "camera") {
+				vector<string> v = split(value, ',');
+				if (v.size() != 5) throw invalid_argument("camera needs x,y,z,yaw,pitch");
+				for (int k = 0; k < 3; k++) s.m_camera_position[k] = stof(v[k]);
+				s.m_camera_yaw = stof(v[3]);
+				s.m_camera_pitch = stof(v[4]);
+			}
+			else throw invalid_argument("Unknown parameter " + key);
+		}
+		if (s.m_width <= 0 || s.m_height <= 0 || s.m_samples <= 0) throw invalid_argument("Size and samples must be positive");
+		if (s.m_width > 16384 || s.m_height > 16384) throw invalid_argument("Size is too large");
+	}
+}
+
+
+shared_ptr<Scene> RenderService::scene(const string &name) {
+	lock_guard<mutex> lock(m_scene_mutex);
+	shared_ptr<Scene> &s = m_scenes[name];
+	if (!s) {
+		try {
+			s = make_shared<Scene>(Scene::fromName(name));
+		}
+		catch (...) {
+			m_scenes.erase(name);
+			throw;
+		}
+	}
+	return s;
+}
+
+
+bool RenderService::renderPass(Job &job) {
+	const RenderSettings &s = job.m_settings;
+	const int w = s.m_width, h = s.m_height;
+	if (job.m_passes == 0) job.m_framebuffer.configure(w, h, s.m_aovs);
+
+	Camera camera = s.camera();
+	const int pass = job.m_passes;
+	const float mix = pass / float(pass + 1);
+	RenderPool::shared().parallelFor(w * h, 256, render_priority_background, 0, [&](int begin, int end) {
+		scratchArena().reset();
+		SampleBatch batch(end - begin);
+		traceSamples(s, *job.m_pathtracer, camera, 0, 0, w, begin, end, pass, batch);
+		for (int idx = begin; idx < end; idx++) job.m_framebuffer.accumulate(idx, batch.m_colors[idx - begin], batch.m_records[idx - begin], mix);
+	});
+	return pass + 1 >= s.m_samples;
+}
+
+
+void RenderService::renderLoop() {
+	while (true) {
+		shared_ptr<Job> job;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			auto next = [&]() {
+				job = nullptr;
+				for (auto &j : m_jobs) {
+					bool runnable = j.second->m_status == status_queued || j.second->m_status == status_rendering;
+					if (runnable && (!job || j.second->m_priority > job->m_priority)) job = j.second;
+				}
+				return m_stop || job;
+			};
+			m_changed.wait(lock, next);
+			if (m_stop) return;
+			job->m_status = status_rendering;
+		}
+
+		// only this thread touches the render state of a job
+		bool last = renderPass(*job);
+		vector<glm::vec3> image(job->m_framebuffer.width() * job->m_framebuffer.height());
+		for (int c = 0; c < 3; c++) {
+			const float *p = job->m_framebuffer.plane(aov_color, c);
+			for (size_t i = 0; i < image.size(); i++) image[i][c] = p[i];
+		}
+
+		lock_guard<mutex> lock(m_mutex);
+		job->m_passes++;
+		job->m_image.swap(image);
+		job->m_image_version++;
+		if (last && job->m_status == status_rendering) job->m_status = status_done;
+		if (ended(*job)) {
+			job->m_pathtracer.reset();
+			job->m_scene.reset();
+			job->m_framebuffer = Framebuffer();
+			forgetJobs();
+		}
+		m_changed.notify_all();
+	}
+}
+
+
+void RenderService::forgetJobs() {
+	size_t count = 0;
+	for (auto &j : m_jobs) count += ended(*j.second);
+	for (auto it = m_jobs.begin(); it != m_jobs.end() && count > m_max_finished_jobs;) {
+		if (ended(*it->second)) {
+			it = m_jobs.erase(it);
+			count--;
+		}
+		else ++it;
+	}
+}
+
+
+void RenderService::stream(Socket &socket, shared_ptr<Job> job) {
+	const string head = "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+		"Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+	if (!socket.send(head.data(), head.size())) return;
+
+	int version = 0;
+	while (true) {
+		vector<glm::vec3> image;
+		bool last;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_changed.wait(lock, [&]() { return m_stop || job->m_image_version != version || ended(*job); });
+			if (m_stop) return;
+			last = ended(*job);
+			if (job->m_image_version != version) image = job->m_image;
+			version = job->m_image_version;
+		}
+
+		if (!image.empty()) {
+			string png = encodePNG(image, job->m_settings.m_width, job->m_settings.m_height, job->m_exposure);
+			ostringstream part;
+			part << "--frame\r\nContent-Type: image/png\r\nContent-Length: " << png.size() << "\r\n\r\n";
+			string p = part.str();
+			if (!socket.send(p.data(), p.size()) || !socket.send(png.data(), png.size()) || !socket.send("\r\n", 2)) return;
+		}
+		if (last) break;
+	}
+	const string end = "--frame--\r\n";
+	socket.send(end.data(), end.size());
+}
+
+
+void RenderService::serve(Socket socket) {
+	Request request;
+	if (!readRequest(socket, request)) return;
+
+	try {
+		vector<string> path = split(request.path, '/');
+		const string &method = request.method;
+
+		if (path.size() == 1 && path[0] == "jobs") {
+			if (method == "POST") {
+				shared_ptr<Job> job = make_shared<Job>();
+				parseJob(request.query, *job);
+				job->m_scene = scene(job->m_settings.m_scene);
+				job->m_pathtracer = makePathTracer(job->m_settings.m_pathtracer, job->m_scene.get());
+
+				lock_guard<mutex> lock(m_mutex);
+				job->m_id = m_next_id++;
+				m_jobs[job->m_id] = job;
+				m_changed.notify_all();
+				respond(socket, 201, "Created", "text/plain", to_string(job->m_id) + "\n");
+			}
+			else if (method == "GET") {
+				string body;
+				{
+					lock_guard<mutex> lock(m_mutex);
+					for (auto &j : m_jobs) body += describe(*j.second) + "\n";
+				}
+				respond(socket, 200, "OK", "text/plain", body);
+			}
+			else respond(socket, 405, "Method Not Allowed", "text/plain", "");
+			return;
+		}
+
+		if (path.size() == 1 && path[0] == "shutdown" && method == "POST") {
+			respond(socket, 200, "OK", "text/plain", "");
+			lock_guard<mutex> lock(m_mutex);
+			m_stop = true;
+			m_changed.notify_all();
+			return;
+		}
+
+		if (path.size() < 2 || path.size() > 3 || path[0] != "jobs") {
+			respond(socket, 404, "Not Found", "text/plain", "");
+			return;
+		}
+
+		shared_ptr<Job> job;
+		{
+			lock_guard<mutex> lock(m_mutex);
+			auto it = m_jobs.find(stoi(path[1]));
+			if (it != m_jobs.end()) job = it->second;
+		}
+		if (!job) {
+			respond(socket, 404, "Not Found", "text/plain", "No such job\n");
+			return;
+		}
+
+		if (path.size() == 2 && method == "GET") {
+			lock_guard<mutex> lock(m_mutex);
+			respond(socket, 200, "OK", "text/plain", describe(*job) + "\n");
+		}
+		else if (path.size() == 2 && method == "DELETE") {
+			{
+				lock_guard<mutex> lock(m_mutex);
+				if (!ended(*job)) {
+					// a job being rendered is released after its current pass
+					if (job->m_status == status_queued) {
+						job->m_pathtracer.reset();
+						job->m_scene.reset();
+					}
+					job->m_status = status_cancelled;
+					m_changed.notify_all();
+				}
+			}
+			respond(socket, 200, "OK", "text/plain", "");
+		}
+		else if (path.size() == 3 && path[2] == "image" && method == "GET") {
+			vector<glm::vec3> image;
+			{
+				unique_lock<mutex> lock(m_mutex);
+				if (request.query.count("wait")) m_changed.wait(lock, [&]() { return m_stop || ended(*job); });
+				image = job->m_image;
+			}
+			const int w = job->m_settings.m_width, h = job->m_settings.m_height;
+			if (image.empty()) respond(socket, 404, "Not Found", "text/plain", "No pass completed yet\n");
+			else if (request.query["format"] == "pfm") respond(socket, 200, "OK", "image/x-portable-floatmap", encodePFM(image, w, h));
+			else respond(socket, 200, "OK", "image/png", encodePNG(image, w, h, job->m_exposure));
+		}
+		else if (path.size() == 3 && path[2] == "stream" && method == "GET") {
+			stream(socket, job);
+		}
+		else respond(socket, 404, "Not Found", "text/plain", "");
+	}
+	catch (exception &e) {
+		respond(socket, 400, "Bad Request", "text/plain", string(e.what()) + "\n");
+	}
+}
+
+
+int RenderService::run() {
+	Socket listener;
+	try {
+		listener = Socket::listen(m_port, m_loopback);
+	}
+	catch (exception &e) {
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	cout << "Render service listening on port " << listener.port() << endl;
+
+	thread render_thread([this]() { renderLoop(); });
+
+	// a thread per connection, joined once finished
+	list<pair<thread, shared_ptr<atomic<bool>>>> connections;
+	while (true) {
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if (m_stop) break;
+		}
+
+		for (auto it = connections.begin(); it != connections.end();) {
+			if (*it->second) {
+				it->first.join();
+				it = connections.erase(it);
+			}
+			else ++it;
+		}
+
+		Socket socket = listener.accept(100);
+		if (socket.valid()) {
+			shared_ptr<atomic<bool>> finished = make_shared<atomic<bool>>(false);
+			thread t([this, finished](Socket s) {
+				serve(move(s));
+				*finished = true;
+			}, move(socket));
+			connections.emplace_back(move(t), finished);
+		}
+	}
+
+	for (auto &c : connections) c.first.join();
+	render_thread.join();
+	cout << "Render service stopped" << endl;
+	return 0;
+}
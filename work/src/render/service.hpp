@@ -0,0 +1,93 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// glm
+#include <glm.hpp>
+
+// project
+#include "framebuffer.hpp"
+#include "socket.hpp"
+#include "work_unit.hpp"
+#include "scene/scene.hpp"
+
+
+// Long running render service with a small HTTP API (on localhost by default)
+//
+//   POST   /jobs?scene=cornell&width=128&height=128&samples=64&priority=1
+//          queue a job (also pathtracer, depth, seed, exposure, sort=1
+//          and camera=x,y,z,yaw,pitch), responds with the job id
+//   GET    /jobs                  list jobs, one per line
+//   GET    /jobs/<id>             status and completed passes of a job
+//   GET    /jobs/<id>/image       latest image (?format=pfm for linear
+//                                 color, ?wait=1 to wait for the last pass)
+//   GET    /jobs/<id>/stream      a png after each pass until the job ends
+//                                 (multipart/x-mixed-replace)
+//   DELETE /jobs/<id>             cancel a job
+//   POST   /shutdown              stop the service
+//
+// Jobs are rendered a pass at a time, always the highest priority (then
+// oldest) job, so a higher priority job takes over between passes.
+// Passes run on the shared render pool at background priority.
+// Scenes (and their acceleration structures) are built once and shared
+// by every job using them.
+class RenderService {
+public:
+	enum Status { status_queued, status_rendering, status_done, status_cancelled };
+
+	class Job {
+	public:
+		int m_id = 0;
+		int m_priority = 0;
+		float m_exposure = 1;
+		RenderSettings m_settings;
+
+		Status m_status = status_queued;
+		int m_passes = 0; // completed
+
+		// render state, released when the job ends
+		std::shared_ptr<Scene> m_scene;
+		std::unique_ptr<PathTracer> m_pathtracer;
+		Framebuffer m_framebuffer;
+
+		// color after the last completed pass (what clients see)
+		std::vector<glm::vec3> m_image;
+		int m_image_version = 0;
+	};
+
+	int m_port = 8080;
+	bool m_loopback = true; // only accept local connections
+	size_t m_max_finished_jobs = 256; // older ended jobs are forgotten
+
+	// serve until a client requests /shutdown, returns the exit code
+	int run();
+
+private:
+	// guards the jobs and m_stop
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+	std::map<int, std::shared_ptr<Job>> m_jobs;
+	int m_next_id = 1;
+	bool m_stop = false;
+
+	std::mutex m_scene_mutex;
+	std::map<std::string, std::shared_ptr<Scene>> m_scenes;
+
+	// scene by name, built on first use
+	std::shared_ptr<Scene> scene(const std::string &name);
+
+	void renderLoop();
+	bool renderPass(Job &job);
+	void forgetJobs();
+
+	// handle one http request (or stream) on a connection
+	void serve(Socket socket);
+	void stream(Socket &socket, std::shared_ptr<Job> job);
+};
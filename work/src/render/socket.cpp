@@ -0,0 +1,239 @@
+// std
+#include <cstring>
+#include <stdexcept>
+
+// posix
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // _WIN32
+
+// project
+#include "socket.hpp"
+
+
+namespace {
+	// largest payload accepted, guards against garbage lengths
+	const uint32_t max_message_size = 1u << 30;
+
+	const uint32_t message_magic = 0x34616763; // "cga4"
+}
+
+
+#ifndef _WIN32
+
+Socket & Socket::operator=(Socket &&other) {
+	if (this != &other) {
+		close();
+		m_fd = other.m_fd;
+		other.m_fd = -1;
+	}
+	return *this;
+}
+
+
+Socket Socket::listen(int port, bool loopback) {
+	Socket s(::socket(AF_INET, SOCK_STREAM, 0));
+	if (!s.valid()) throw std::runtime_error("Could not create socket");
+
+	int yes = 1;
+	setsockopt(s.m_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+	addr.sin_port = htons(uint16_t(port));
+	if (::bind(s.m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(s.m_fd, 64) != 0) {
+		throw std::runtime_error("Could not listen on port " + std::to_string(port));
+	}
+	return s;
+}
+
+
+Socket Socket::connect(const std::string &host, int port) {
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *result = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+		throw std::runtime_error("Could not resolve host " + host);
+	}
+
+	Socket s;
+	for (addrinfo *a = result; a && !s.valid(); a = a->ai_next) {
+		s = Socket(::socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+		if (s.valid() && ::connect(s.m_fd, a->ai_addr, a->ai_addrlen) != 0) s.close();
+	}
+	freeaddrinfo(result);
+	if (!s.valid()) throw std::runtime_error("Could not connect to " + host + ":" + std::to_string(port));
+
+	// messages are sent whole, don't wait to coalesce them
+	int yes = 1;
+	setsockopt(s.m_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	return s;
+}
+
+
+Socket Socket::accept(int timeout_ms) const {
+	pollfd p{ m_fd, POLLIN, 0 };
+	if (::poll(&p, 1, timeout_ms) <= 0) return Socket();
+	Socket s(::accept(m_fd, nullptr, nullptr));
+	if (s.valid()) {
+		int yes = 1;
+		setsockopt(s.m_fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	}
+	return s;
+}
+
+
+int Socket::port() const {
+	sockaddr_in addr{};
+	socklen_t len = sizeof(addr);
+	if (getsockname(m_fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) return -1;
+	return ntohs(addr.sin_port);
+}
+
+
+void Socket::close() {
+	if (m_fd >= 0) ::close(m_fd);
+	m_fd = -1;
+}
+
+
+bool Socket::send(const void *data, size_t size) {
+	const char *p = static_cast<const char *>(data);
+	while (size > 0) {
+#ifdef MSG_NOSIGNAL
+		ssize_t n = ::send(m_fd, p, size, MSG_NOSIGNAL);
+#else
+		ssize_t n = ::send(m_fd, p, size, 0);
+#endif
+		if (n <= 0) return false;
+		p += n;
+		size -= size_t(n);
+	}
+	return true;
+}
+
+
+bool Socket::receive(void *data, size_t size, int timeout_ms) {
+	char *p = static_cast<char *>(data);
+	while (size > 0) {
+		pollfd pfd{ m_fd, POLLIN, 0 };
+		if (::poll(&pfd, 1, timeout_ms) <= 0) return false;
+		ssize_t n = ::recv(m_fd, p, size, 0);
+		if (n <= 0) return false;
+		p += n;
+		size -= size_t(n);
+	}
+	return true;
+}
+
+
+size_t Socket::receiveSome(void *data, size_t size, int timeout_ms) {
+	pollfd pfd{ m_fd, POLLIN, 0 };
+	if (::poll(&pfd, 1, timeout_ms) <= 0) return 0;
+	ssize_t n = ::recv(m_fd, data, size, 0);
+	return (n > 0) ? size_t(n) : 0;
+}
+
+#else
+
+Socket & Socket::operator=(Socket &&other) {
+	std::swap(m_fd, other.m_fd);
+	return *this;
+}
+
+Socket Socket::listen(int, bool) { throw std::runtime_error("Sockets are not supported on this platform"); }
+Socket Socket::connect(const std::string &, int) { throw std::runtime_error("Sockets are not supported on this platform"); }
+Socket Socket::accept(int) const { return Socket(); }
+int Socket::port() const { return -1; }
+void Socket::close() { m_fd = -1; }
+bool Socket::send(const void *, size_t) { return false; }
+bool Socket::receive(void *, size_t, int) { return false; }
+size_t Socket::receiveSome(void *, size_t, int) { return 0; }
+
+#endif // _WIN32
+
+
+void Message::putInt(uint32_t v) {
+	for (int i = 0; i < 4; i++) m_data.push_back((unsigned char)(v >> (8 * i)));
+}
+
+
+void Message::putFloat(float f) {
+	uint32_t v;
+	std::memcpy(&v, &f, 4);
+	putInt(v);
+}
+
+
+void Message::putFloats(const float *f, size_t n) {
+	m_data.reserve(m_data.size() + 4 * n);
+	for (size_t i = 0; i < n; i++) putFloat(f[i]);
+}
+
+
+void Message::putString(const std::string &s) {
+	putInt(uint32_t(s.size()));
+	m_data.insert(m_data.end(), s.begin(), s.end());
+}
+
+
+uint32_t Message::getInt() {
+	if (m_read + 4 > m_data.size()) throw std::runtime_error("Message too short");
+	uint32_t v = 0;
+	for (int i = 0; i < 4; i++) v |= uint32_t(m_data[m_read++]) << (8 * i);
+	return v;
+}
+
+
+float Message::getFloat() {
+	uint32_t v = getInt();
+	float f;
+	std::memcpy(&f, &v, 4);
+	return f;
+}
+
+
+void Message::getFloats(float *f, size_t n) {
+	if (m_read + 4 * n > m_data.size()) throw std::runtime_error("Message too short");
+	for (size_t i = 0; i < n; i++) f[i] = getFloat();
+}
+
+
+std::string Message::getString() {
+	uint32_t n = getInt();
+	if (m_read + n > m_data.size()) throw std::runtime_error("Message too short");
+	std::string s(m_data.begin() + m_read, m_data.begin() + m_read + n);
+	m_read += n;
+	return s;
+}
+
+
+bool sendMessage(Socket &socket, const Message &message) {
+	Message header;
+	header.putInt(message_magic);
+	header.putInt(message.m_type);
+	header.putInt(uint32_t(message.m_data.size()));
+	return socket.send(header.m_data.data(), header.m_data.size())
+		&& socket.send(message.m_data.data(), message.m_data.size());
+}
+
+
+bool receiveMessage(Socket &socket, Message &message, int timeout_ms) {
+	Message header;
+	header.m_data.resize(12);
+	if (!socket.receive(header.m_data.data(), 12, timeout_ms)) return false;
+	if (header.getInt() != message_magic) return false;
+
+	message = Message(header.getInt());
+	uint32_t size = header.getInt();
+	if (size > max_message_size) return false;
+	message.m_data.resize(size);
+	return socket.receive(message.m_data.data(), size, timeout_ms);
+}
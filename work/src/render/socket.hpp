@@ -0,0 +1,88 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Blocking TCP socket, closed on destruction (move only).
+// Only implemented for posix systems, elsewhere opening one throws.
+class Socket {
+private:
+	int m_fd = -1;
+
+public:
+	Socket() { }
+	explicit Socket(int fd) : m_fd(fd) { }
+	Socket(Socket &&other) : m_fd(other.m_fd) { other.m_fd = -1; }
+	Socket & operator=(Socket &&other);
+	~Socket() { close(); }
+
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	// listen on all interfaces (or only loopback), port 0 picks a free
+	// port. throws std::runtime_error on failure
+	static Socket listen(int port, bool loopback = false);
+
+	// connect to host:port, throws std::runtime_error on failure
+	static Socket connect(const std::string &host, int port);
+
+	// wait up to timeout_ms (negative waits forever) for a connection,
+	// returns an invalid socket on timeout
+	Socket accept(int timeout_ms) const;
+
+	bool valid() const { return m_fd >= 0; }
+	int port() const;
+	void close();
+
+	// send or receive exactly size bytes, false on error, disconnection
+	// or (for receive) if nothing arrives for timeout_ms
+	bool send(const void *data, size_t size);
+	bool receive(void *data, size_t size, int timeout_ms);
+
+	// receive what has arrived (up to size bytes), waiting up to timeout_ms
+	// for anything. returns the number of bytes, 0 on error or disconnection
+	size_t receiveSome(void *data, size_t size, int timeout_ms);
+};
+
+
+enum MessageType : uint32_t {
+	message_settings = 1,
+	message_unit,
+	message_result,
+	message_error,
+	message_quit
+};
+
+
+// A typed message sent over a socket, with a payload built from little
+// endian values. Reading past the end of the payload throws std::runtime_error.
+class Message {
+private:
+	size_t m_read = 0;
+
+public:
+	uint32_t m_type = 0;
+	std::vector<unsigned char> m_data;
+
+	Message() { }
+	explicit Message(uint32_t type) : m_type(type) { }
+
+	void putInt(uint32_t v);
+	void putFloat(float f);
+	void putFloats(const float *f, size_t n);
+	void putString(const std::string &s);
+
+	uint32_t getInt();
+	float getFloat();
+	void getFloats(float *f, size_t n);
+	std::string getString();
+};
+
+// send a message, false on failure
+bool sendMessage(Socket &socket, const Message &message);
+
+// receive a message, false on failure or if nothing arrives for timeout_ms
+bool receiveMessage(Socket &socket, Message &message, int timeout_ms);
@@ -0,0 +1,145 @@
+// std
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// project
+#include "work_unit.hpp"
+#include "render_job.hpp"
+#include "render_pool.hpp"
+#include "scene/arena.hpp"
+#include "scene/light.hpp"
+#include "scene/sampling.hpp"
+
+
+namespace {
+	// pixels traced together by renderWorkUnit
+	const int sample_batch_size = 64;
+}
+
+
+Camera RenderSettings::camera() const {
+	Camera camera;
+	camera.setImageSize({ m_width, m_height });
+	camera.setPositionOrientation(m_camera_position, m_camera_yaw, m_camera_pitch);
+	return camera;
+}
+
+
+Scene RenderSettings::scene() const {
+	Scene scene = Scene::fromName(m_scene);
+	if (!m_environment.empty()) scene.setEnvironment(std::make_shared<EnvironmentLight>(std::make_shared<Texture>(m_environment), 1.f, glm::vec3(0)));
+	BVHOptions bvh_options = scene.bvhOptions();
+	bvh_options.format = m_bvh_format;
+	bvh_options.quality = m_bvh_quality;
+	if (m_split_budget >= 0) bvh_options.split_budget = m_split_budget;
+	scene.setBVHOptions(bvh_options);
+	for (const std::pair<int, Track<Pose>> &motion : m_object_motion) {
+		if (motion.first < 0 || motion.first >= int(scene.objects().size())) throw std::invalid_argument("No object " + std::to_string(motion.first));
+		scene.setMotion(motion.first, motion.second);
+	}
+	scene.setShutter(m_shutter_open, m_shutter_close);
+	return scene;
+}
+
+
+glm::vec2 sampleJitter(uint32_t seed, int idx, int s) {
+	uint32_t key = hashBits(seed ^ hashBits(uint32_t(idx) ^ hashBits(uint32_t(s))));
+	glm::vec2 rand(toUnit(hashBits(key)), toUnit(hashBits(key ^ 0x9e3779b9)));
+	return (rand - 0.5f) * (1.f - std::exp(float(s) * -0.4f)) + 0.5f;
+}
+
+
+float sampleTime(uint32_t seed, int idx, int s) {
+	const float start = toUnit(hashBits(seed ^ hashBits(uint32_t(idx) ^ 0x85ebca6b)));
+	const float t = start + s * 0.618034f;
+	return t - std::floor(t);
+}
+
+
+SampleBatch::SampleBatch(int count) {
+	Arena &arena = scratchArena();
+	m_colors = arena.allocate<glm::vec3>(count);
+	m_records = arena.allocate<SampleRecord>(count);
+	std::uninitialized_default_construct_n(m_records, count);
+}
+
+
+void traceSamples(const RenderSettings &settings, PathTracer &pathtracer, Camera &camera,
+	int x0, int y0, int w, int begin, int end, int s, SampleBatch &batch)
+{
+	Ray *rays = scratchArena().allocate<Ray>(end - begin);
+	for (int i = begin; i < end; i++) {
+		const int x = x0 + i % w, y = y0 + i / w;
+		glm::vec2 jitter = sampleJitter(settings.m_seed, y * settings.m_width + x, s);
+		Ray &ray = rays[i - begin];
+		ray = camera.generateRay(glm::vec2(x, y) + jitter);
+		ray.time = sampleTime(settings.m_seed, y * settings.m_width + x, s);
+	}
+	pathtracer.sampleRays(rays, end - begin, settings.m_ray_depth, batch.m_colors, batch.m_records, settings.m_sort_rays);
+}
+
+
+std::vector<WorkUnit> splitFrame(const RenderSettings &settings, int tile_size, int unit_samples) {
+	tile_size = std::max(tile_size, 1);
+	unit_samples = std::max(unit_samples, 1);
+
+	std::vector<WorkUnit> units;
+	int tile = 0;
+	for (int y = 0; y < settings.m_height; y += tile_size) {
+		for (int x = 0; x < settings.m_width; x += tile_size, tile++) {
+			for (int s = 0; s < settings.m_samples; s += unit_samples) {
+				WorkUnit unit;
+				unit.m_id = int(units.size());
+				unit.m_tile = tile;
+				unit.m_x0 = x;
+				unit.m_y0 = y;
+				unit.m_x1 = std::min(x + tile_size, settings.m_width);
+				unit.m_y1 = std::min(y + tile_size, settings.m_height);
+				unit.m_s0 = s;
+				unit.m_s1 = std::min(s + unit_samples, settings.m_samples);
+				units.push_back(unit);
+			}
+		}
+	}
+	return units;
+}
+
+
+void renderWorkUnit(const RenderSettings &settings, PathTracer &pathtracer, Camera &camera, const WorkUnit &unit, Framebuffer &tile) {
+	const int w = unit.width(), h = unit.height();
+	tile.configure(w, h, settings.m_aovs, int(pathtracer.m_scene->lights().size()));
+
+	for (int s = unit.m_s0; s < unit.m_s1; s++) {
+		const float mix = (s - unit.m_s0) / float(s - unit.m_s0 + 1);
+		RenderPool::shared().parallelFor(w * h, sample_batch_size, render_priority_background, 0, [&](int begin, int end) {
+			scratchArena().reset();
+			SampleBatch batch(end - begin);
+			traceSamples(settings, pathtracer, camera, unit.m_x0, unit.m_y0, w, begin, end, s, batch);
+			for (int idx = begin; idx < end; idx++) tile.accumulate(idx, batch.m_colors[idx - begin], batch.m_records[idx - begin], mix);
+		});
+	}
+}
+
+
+void mergeWorkUnit(Framebuffer &frame, int merged, const WorkUnit &unit, const Framebuffer &tile) {
+	const float mix = merged / float(merged + unit.samples());
+	const int w = unit.width();
+
+	for (int a = 0; a < aov_count; a++) {
+		// the object hit is that of the first sample
+		if (a == aov_object && merged > 0) continue;
+		for (int c = 0; c < std::min(frame.channels(AOV(a)), tile.channels(AOV(a))); c++) {
+			float *dst = frame.plane(AOV(a), c);
+			const float *src = tile.plane(AOV(a), c);
+			for (int y = unit.m_y0; y < unit.m_y1; y++) {
+				for (int x = unit.m_x0; x < unit.m_x1; x++) {
+					float &d = dst[y * frame.width() + x];
+					d = glm::mix(src[(y - unit.m_y0) * w + (x - unit.m_x0)], d, mix);
+				}
+			}
+		}
+	}
+}
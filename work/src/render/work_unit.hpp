@@ -0,0 +1,110 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// glm
+#include <glm.hpp>
+
+// project
+#include "framebuffer.hpp"
+#include "scene/animation.hpp"
+#include "scene/camera.hpp"
+#include "scene/path_tracer.hpp"
+
+
+// Everything needed to reproduce a render of a frame, shared by
+// the headless renderer and the processes of a distributed render
+class RenderSettings {
+public:
+	std::string m_scene = "simple";
+	std::string m_pathtracer = "core";
+	int m_width = 800;
+	int m_height = 600;
+	int m_samples = 16;
+	int m_ray_depth = 2;
+	glm::vec3 m_camera_position{ 0 };
+	float m_camera_yaw = 0;
+	float m_camera_pitch = 0;
+	unsigned m_aovs = aovBit(aov_color);
+	uint32_t m_seed = 0;
+	bool m_sort_rays = false; // reorder batches of secondary rays before tracing them
+	std::string m_environment; // hdr image lighting the scene from all around, if any
+
+	// shutter interval in seconds, and the objects (by index) keyframed to
+	// move over it
+	float m_shutter_open = 0;
+	float m_shutter_close = 0;
+	std::vector<std::pair<int, Track<Pose>>> m_object_motion;
+
+	// acceleration structure of the scene
+	BVHFormat m_bvh_format = bvh_wide;
+	BVHQuality m_bvh_quality = bvh_sah;
+	float m_split_budget = -1; // of spatial splits, the scene's own if negative
+
+	// camera for the settings image size, position and orientation
+	Camera camera() const;
+
+	// the named scene, lit by the environment image if there is one, with
+	// the bvh options, object motion and shutter set (throws
+	// std::invalid_argument or std::runtime_error)
+	Scene scene() const;
+};
+
+
+// A part of a frame to render, the pixels [x0, x1) * [y0, y1) of
+// a tile and the samples [s0, s1) of each of them
+class WorkUnit {
+public:
+	int m_id = 0;
+	int m_tile = 0;
+	int m_x0 = 0, m_y0 = 0, m_x1 = 0, m_y1 = 0;
+	int m_s0 = 0, m_s1 = 0;
+
+	int width() const { return m_x1 - m_x0; }
+	int height() const { return m_y1 - m_y0; }
+	int samples() const { return m_s1 - m_s0; }
+};
+
+
+// jitter within the pixel for sample s of pixel idx, a hash of the
+// seed, pixel and sample so any split of the work gives the same samples
+// (less jitter for the first samples, as in the interactive renderer)
+glm::vec2 sampleJitter(uint32_t seed, int idx, int s);
+
+// time in the shutter interval for sample s of pixel idx, successive
+// samples of a pixel are spread evenly over it (a golden ratio sequence
+// from a hashed start) so few samples already cover the motion
+float sampleTime(uint32_t seed, int idx, int s);
+
+// colors and records of a batch of samples, in the scratch arena
+class SampleBatch {
+public:
+	glm::vec3 *m_colors;
+	SampleRecord *m_records;
+
+	explicit SampleBatch(int count);
+};
+
+// trace sample s of the pixels [begin, end) of the w wide region at
+// (x0, y0), in row major order, filling in the colors and records of the
+// batch. the camera rays are traced together, as are the rays they spawn
+// (sorted if the settings say so). the scratch arena is left for the
+// caller to reset, and must not be reset while the batch is in use
+void traceSamples(const RenderSettings &settings, PathTracer &pathtracer, Camera &camera,
+	int x0, int y0, int w, int begin, int end, int s, SampleBatch &batch);
+
+// split a frame into tiles of tile_size pixels square, and each tile into
+// units of unit_samples samples. units are ordered by tile then samples
+std::vector<WorkUnit> splitFrame(const RenderSettings &settings, int tile_size, int unit_samples);
+
+// render a unit into a framebuffer the size of the unit, with the settings aovs,
+// on the shared render pool at background priority
+void renderWorkUnit(const RenderSettings &settings, PathTracer &pathtracer, Camera &camera, const WorkUnit &unit, Framebuffer &tile);
+
+// merge a rendered unit into the frame, weighting the mean by sample counts
+// where the frame has merged samples for the tile of the unit already
+void mergeWorkUnit(Framebuffer &frame, int merged, const WorkUnit &unit, const Framebuffer &tile);
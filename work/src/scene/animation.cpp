@@ -0,0 +1,63 @@
+// glm
+#include <gtc/matrix_transform.hpp>
+
+// project
+#include "animation.hpp"
+
+
+RigidTransform::RigidTransform(const Pose &pose, const glm::vec3 &pivot) {
+	m_rotation = glm::mat3(
+		glm::rotate(glm::mat4(1), pose.m_yaw, glm::vec3(0, 1, 0)) *
+		glm::rotate(glm::mat4(1), pose.m_pitch, glm::vec3(1, 0, 0)) *
+		glm::rotate(glm::mat4(1), pose.m_roll, glm::vec3(0, 0, 1)));
+	m_translation = pivot + pose.m_position - m_rotation * pivot;
+}
+
+
+Bounds RigidTransform::bounds(const Bounds &b) const {
+	if (b.empty() || !b.finite()) return b;
+	Bounds result;
+	for (int corner = 0; corner < 8; corner++) {
+		result.extend(point(glm::vec3(b[corner & 1].x, b[(corner >> 1) & 1].y, b[corner >> 2].z)));
+	}
+	return result;
+}
+
+
+glm::vec3 RigidTransform::error(const glm::vec3 &p, const glm::vec3 &p_error) const {
+	// the error carried through the rotation, plus the rounding of the
+	// transform itself (3 products and 3 sums per component)
+	const glm::mat3 abs_rotation(glm::abs(m_rotation[0]), glm::abs(m_rotation[1]), glm::abs(m_rotation[2]));
+	return (1 + errorGamma(3)) * (abs_rotation * p_error) + errorGamma(4) * (abs_rotation * glm::abs(p) + glm::abs(m_translation));
+}
+
+
+MotionTransform::MotionTransform(const Pose &open, const Pose &close, const glm::vec3 &pivot)
+	: m_open(open, pivot), m_pivot(pivot), m_position_open(open.m_position), m_position_close(close.m_position)
+{
+	m_rotating = open.m_yaw != close.m_yaw || open.m_pitch != close.m_pitch || open.m_roll != close.m_roll;
+	m_moving = m_rotating || open.m_position != close.m_position;
+	if (m_rotating) {
+		m_rotation_open = glm::quat_cast(m_open.m_rotation);
+		m_rotation_close = glm::quat_cast(RigidTransform(close, pivot).m_rotation);
+		if (glm::dot(m_rotation_open, m_rotation_close) < 0) m_rotation_close = -m_rotation_close;
+	}
+}
+
+
+void MotionTransform::bounds(const Bounds &b, Bounds &open, Bounds &close) const {
+	if (!m_rotating || b.empty() || !b.finite()) {
+		// a translation moves every corner along the same line
+		open = m_open.bounds(b);
+		close = at(1).bounds(b);
+		return;
+	}
+
+	// the object stays within its bounding sphere about the pivot, whose
+	// center moves linearly between the two positions
+	const glm::vec3 radius(glm::length(glm::max(glm::abs(b.min - m_pivot), glm::abs(b.max - m_pivot))) * (1 + errorGamma(4)));
+	const glm::vec3 center_open = m_pivot + m_position_open;
+	const glm::vec3 center_close = m_pivot + m_position_close;
+	open = Bounds(center_open - radius, center_open + radius);
+	close = Bounds(center_close - radius, center_close + radius);
+}
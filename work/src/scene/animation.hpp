@@ -0,0 +1,140 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// glm
+#include <glm.hpp>
+#include <gtc/quaternion.hpp>
+
+// project
+#include "bounds.hpp"
+#include "ray.hpp"
+
+
+// Position and orientation (in radians, yaw about y then pitch about x
+// then roll about z) keyframed by a Track. For the camera the position
+// is absolute (roll is ignored), for objects it is an offset from where
+// the object was defined and the rotation is about its center.
+class Pose {
+public:
+	glm::vec3 m_position{ 0 };
+	float m_yaw = 0;
+	float m_pitch = 0;
+	float m_roll = 0;
+};
+
+inline Pose mix(const Pose &a, const Pose &b, float t) {
+	Pose p;
+	p.m_position = glm::mix(a.m_position, b.m_position, t);
+	p.m_yaw = glm::mix(a.m_yaw, b.m_yaw, t);
+	p.m_pitch = glm::mix(a.m_pitch, b.m_pitch, t);
+	p.m_roll = glm::mix(a.m_roll, b.m_roll, t);
+	return p;
+}
+
+
+// A value keyed at points in time, linearly interpolated between keys
+// and held before the first and after the last.
+template <typename T>
+class Track {
+private:
+	std::vector<std::pair<float, T>> m_keys; // sorted by time
+
+public:
+	// add a key, replacing any existing key at the same time
+	void add(float time, const T &value) {
+		auto it = std::lower_bound(m_keys.begin(), m_keys.end(), time,
+			[](const std::pair<float, T> &k, float t) { return k.first < t; });
+		if (it != m_keys.end() && it->first == time) it->second = value;
+		else m_keys.insert(it, { time, value });
+	}
+
+	bool empty() const { return m_keys.empty(); }
+	const std::vector<std::pair<float, T>> & keys() const { return m_keys; }
+
+	// value at time, the track must not be empty
+	T at(float time) const {
+		auto it = std::upper_bound(m_keys.begin(), m_keys.end(), time,
+			[](float t, const std::pair<float, T> &k) { return t < k.first; });
+		if (it == m_keys.begin()) return m_keys.front().second;
+		if (it == m_keys.end()) return m_keys.back().second;
+		const std::pair<float, T> &a = *(it - 1), &b = *it;
+		return mix(a.second, b.second, (time - a.first) / (b.first - a.first));
+	}
+};
+
+
+// Rotation followed by a translation, mapping from where an object was
+// defined to where it is in the world.
+class RigidTransform {
+public:
+	glm::mat3 m_rotation{ 1 };
+	glm::vec3 m_translation{ 0 };
+
+	RigidTransform() { }
+
+	// the transform of a pose of an object centered on pivot
+	RigidTransform(const Pose &pose, const glm::vec3 &pivot);
+
+	glm::vec3 point(const glm::vec3 &p) const { return m_rotation * p + m_translation; }
+	glm::vec3 vector(const glm::vec3 &v) const { return m_rotation * v; }
+
+	// the ray in the objects own space, distances along it are unchanged
+	Ray inverse(const Ray &ray) const {
+		const glm::mat3 inv = glm::transpose(m_rotation);
+		return Ray(inv * (ray.origin - m_translation), inv * ray.direction, ray.tmin, ray.tmax, ray.time);
+	}
+
+	// world bounds of bounds in the objects own space
+	Bounds bounds(const Bounds &b) const;
+
+	// world error bound of a point p (in the objects own space) with an error bound
+	glm::vec3 error(const glm::vec3 &p, const glm::vec3 &p_error) const;
+};
+
+
+// The motion of an object while the shutter is open, moving linearly from
+// its pose at open to its pose at close (with the rotation interpolated as
+// a normalized quaternion) over the times 0 to 1 of the rays.
+class MotionTransform {
+private:
+	RigidTransform m_open;
+	glm::vec3 m_pivot{ 0 };
+	glm::vec3 m_position_open{ 0 };
+	glm::vec3 m_position_close{ 0 };
+	glm::quat m_rotation_open;
+	glm::quat m_rotation_close;
+	bool m_moving = false;
+	bool m_rotating = false;
+
+public:
+	MotionTransform() { }
+
+	// the motion between two poses of an object centered on pivot
+	MotionTransform(const Pose &open, const Pose &close, const glm::vec3 &pivot);
+
+	// false if the object holds still while the shutter is open
+	bool moving() const { return m_moving; }
+
+	// the transform at a time in the shutter interval
+	RigidTransform at(float time) const {
+		if (!m_moving) return m_open;
+		RigidTransform transform;
+		if (m_rotating) {
+			// the quaternions are on the same side so this takes the short way
+			transform.m_rotation = glm::mat3_cast(glm::normalize(glm::lerp(m_rotation_open, m_rotation_close, time)));
+		} else {
+			transform.m_rotation = m_open.m_rotation;
+		}
+		transform.m_translation = m_pivot + glm::mix(m_position_open, m_position_close, time) - transform.m_rotation * m_pivot;
+		return transform;
+	}
+
+	// world bounds at open and close, of bounds in the objects own space,
+	// such that interpolating between them bounds it at any time between.
+	// a rotating object is bounded by the sphere it turns in
+	void bounds(const Bounds &b, Bounds &open, Bounds &close) const;
+};
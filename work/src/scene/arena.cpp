@@ -0,0 +1,61 @@
+// std
+#include <algorithm>
+
+// project
+#include "arena.hpp"
+
+
+void * Arena::allocate(size_t bytes, size_t alignment) {
+	while (true) {
+		if (m_current < m_blocks.size()) {
+			Block &block = m_blocks[m_current];
+			const size_t start = (reinterpret_cast<size_t>(block.m_data.get()) + m_offset + alignment - 1) & ~(alignment - 1);
+			const size_t offset = start - reinterpret_cast<size_t>(block.m_data.get());
+			if (offset + bytes <= block.m_size) {
+				m_offset = offset + bytes;
+				return block.m_data.get() + offset;
+			}
+
+			// move on to the next block, reusing blocks kept over a reset
+			m_used += m_offset;
+			m_offset = 0;
+			m_current++;
+			if (m_current < m_blocks.size()) continue;
+		}
+
+		// big enough for the allocation however it is aligned
+		Block block;
+		block.m_size = std::max(m_block_size, bytes + alignment);
+		block.m_data.reset(new char[block.m_size]);
+		m_blocks.push_back(std::move(block));
+		m_current = m_blocks.size() - 1;
+		m_offset = 0;
+	}
+}
+
+
+void Arena::reset() {
+	m_current = 0;
+	m_offset = 0;
+	m_used = 0;
+}
+
+
+size_t Arena::capacity() const {
+	size_t size = 0;
+	for (const Block &block : m_blocks) size += block.m_size;
+	return size;
+}
+
+
+size_t SceneArena::used() const {
+	size_t size = 0;
+	for (const auto &pool : m_pools) size += pool.second->used();
+	return size;
+}
+
+
+Arena & scratchArena() {
+	static thread_local Arena arena;
+	return arena;
+}
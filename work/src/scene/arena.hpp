@@ -0,0 +1,108 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <typeindex>
+#include <vector>
+
+
+// Monotonic arena handing out memory from large blocks. Nothing is freed
+// on its own, reset() makes all of the memory reusable at once (without
+// running destructors) and keeps the blocks, so an arena that is reset
+// regularly stops allocating once it has grown to fit. Not thread safe.
+class Arena {
+private:
+	struct Block {
+		std::unique_ptr<char[]> m_data;
+		size_t m_size = 0;
+	};
+
+	std::vector<Block> m_blocks;
+	size_t m_block_size;
+	size_t m_current = 0; // block being allocated from
+	size_t m_offset = 0; // within the current block
+	size_t m_used = 0; // in earlier blocks
+
+public:
+	explicit Arena(size_t block_size = 64 * 1024) : m_block_size(block_size) { }
+
+	Arena(const Arena &) = delete;
+	Arena & operator=(const Arena &) = delete;
+
+	void * allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	template <typename T>
+	T * allocate(size_t count) { return static_cast<T *>(allocate(count * sizeof(T), alignof(T))); }
+
+	void reset();
+
+	// bytes handed out since the last reset, and held in blocks
+	size_t used() const { return m_used + m_offset; }
+	size_t capacity() const;
+};
+
+
+// Standard allocator drawing from an arena, deallocation does nothing.
+// The arena must outlive everything allocated from it, unless an owner
+// is given to keep alive along with the allocator (and its copies).
+template <typename T>
+class ArenaAllocator {
+public:
+	using value_type = T;
+
+	Arena *m_arena;
+	std::shared_ptr<void> m_owner;
+
+	ArenaAllocator(Arena *arena, std::shared_ptr<void> owner = nullptr) : m_arena(arena), m_owner(std::move(owner)) { }
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.m_arena), m_owner(other.m_owner) { }
+
+	T * allocate(size_t n) { return m_arena->allocate<T>(n); }
+	void deallocate(T *, size_t) { }
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> &other) const { return m_arena == other.m_arena; }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return m_arena != other.m_arena; }
+};
+
+
+// Arena for the data of a scene, with a pool per type so objects of the
+// same type (shapes of one kind, materials, scene objects) are contiguous
+// in memory rather than scattered across the heap. Objects are made as
+// shared pointers that keep the arena alive, so they can be used like
+// any other. Scenes are built on one thread.
+class SceneArena : public std::enable_shared_from_this<SceneArena> {
+private:
+	std::map<std::type_index, std::unique_ptr<Arena>> m_pools;
+
+	template <typename T>
+	Arena & pool() {
+		std::unique_ptr<Arena> &arena = m_pools[std::type_index(typeid(T))];
+		if (!arena) arena = std::make_unique<Arena>(16 * 1024);
+		return *arena;
+	}
+
+public:
+	static std::shared_ptr<SceneArena> create() { return std::shared_ptr<SceneArena>(new SceneArena()); }
+
+	template <typename T, typename... Args>
+	std::shared_ptr<T> make(Args&&... args) {
+		return std::allocate_shared<T>(ArenaAllocator<T>(&pool<T>(), shared_from_this()), std::forward<Args>(args)...);
+	}
+
+	// bytes used over every pool
+	size_t used() const;
+
+private:
+	SceneArena() { }
+};
+
+
+// arena for short lived scratch memory of the calling thread, reset
+// by the render loops at the start of every tile (or chunk of pixels).
+// anything allocated from it is gone by the next one
+Arena & scratchArena();
@@ -0,0 +1,99 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <limits>
+
+// glm
+#include <glm.hpp>
+
+// project
+#include "ray.hpp"
+
+
+// Axis aligned bounding volume used by the acceleration structures.
+// Default constructed bounds are empty, unbounded shapes (like planes)
+// report infinite bounds.
+class Bounds {
+public:
+	glm::vec3 min{ std::numeric_limits<float>::infinity() };
+	glm::vec3 max{ -std::numeric_limits<float>::infinity() };
+
+	Bounds() { }
+	Bounds(const glm::vec3 &p) : min(p), max(p) { }
+	Bounds(const glm::vec3 &a, const glm::vec3 &b) : min(glm::min(a, b)), max(glm::max(a, b)) { }
+
+	static Bounds infinite() {
+		return Bounds(glm::vec3(-std::numeric_limits<float>::infinity()), glm::vec3(std::numeric_limits<float>::infinity()));
+	}
+
+	void extend(const glm::vec3 &p) { min = glm::min(min, p); max = glm::max(max, p); }
+	void extend(const Bounds &b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+
+	// overlap of two bounds, empty if they are disjoint
+	Bounds intersection(const Bounds &b) const {
+		Bounds r;
+		r.min = glm::max(min, b.min);
+		r.max = glm::min(max, b.max);
+		return r;
+	}
+
+	bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+	bool finite() const { return glm::all(glm::lessThan(glm::abs(min), glm::vec3(std::numeric_limits<float>::max())))
+		&& glm::all(glm::lessThan(glm::abs(max), glm::vec3(std::numeric_limits<float>::max()))); }
+
+	glm::vec3 centroid() const { return (min + max) * 0.5f; }
+	glm::vec3 extent() const { return max - min; }
+
+	float surfaceArea() const {
+		if (empty()) return 0;
+		glm::vec3 e = extent();
+		return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	int maxDimension() const {
+		glm::vec3 e = extent();
+		return (e.x > e.y) ? ((e.x > e.z) ? 0 : 2) : ((e.y > e.z) ? 1 : 2);
+	}
+
+	const glm::vec3 & operator[](int i) const { return i ? max : min; }
+
+	// morton code of p on a grid of 2^10 cells per axis over the bounds,
+	// x in the highest of every three bits
+	unsigned mortonCode(const glm::vec3 &p) const {
+		// spread the low 10 bits of v to every third bit
+		auto expand = [](unsigned v) {
+			v = (v * 0x00010001u) & 0xFF0000FFu;
+			v = (v * 0x00000101u) & 0x0F00F00Fu;
+			v = (v * 0x00000011u) & 0xC30C30C3u;
+			v = (v * 0x00000005u) & 0x49249249u;
+			return v;
+		};
+		const glm::vec3 scale = 1024.f / glm::max(extent(), glm::vec3(std::numeric_limits<float>::min()));
+		const glm::ivec3 cell = glm::clamp(glm::ivec3((p - min) * scale), 0, 1023);
+		return expand(unsigned(cell.x)) << 2 | expand(unsigned(cell.y)) << 1 | expand(unsigned(cell.z));
+	}
+
+	// division-free slab test clipping the rays interval, on a hit t0 and
+	// t1 hold the entry and exit distances within it. the exit distances
+	// are padded for rounding (Pharr et al.), so a ray through an edge
+	// shared by two boxes never misses both
+	bool intersect(const Ray &ray, float &t0, float &t1) const {
+		const float pad = 1 + 2 * errorGamma(3);
+		t0 = ray.tmin;
+		t1 = ray.tmax;
+		for (int a = 0; a < 3; a++) {
+			const float near = ((*this)[ray.sign[a]][a] - ray.origin[a]) * ray.inv_direction[a];
+			const float far = ((*this)[1 - ray.sign[a]][a] - ray.origin[a]) * ray.inv_direction[a] * pad;
+			// written so NaNs (0 * inf) never tighten the interval
+			if (near > t0) t0 = near;
+			if (far < t1) t1 = far;
+		}
+		return t0 <= t1;
+	}
+
+	bool intersect(const Ray &ray) const {
+		float t0, t1;
+		return intersect(ray, t0, t1);
+	}
+};
@@ -0,0 +1,593 @@
+// std
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+// project
+#include "bvh.hpp"
+
+
+namespace {
+	const int bin_count = 16;
+	const int max_leaf_size = 4;
+	const int max_depth = 60; // keeps traversal within its fixed size stack
+	const float traversal_cost = 0.125f; // relative to a primitive test
+	const int spatial_bin_count = 32;
+	const float min_split_overlap = 1e-5f; // relative to the root area, to try a spatial split
+	const int min_task_size = 4096; // primitives in a subtree to build it as a task
+	const int min_parallel_size = 65536; // primitives per chunk of a parallel reduction
+
+	const char *quality_names[bvh_quality_count] = { "fast", "sah" };
+
+	int buildThreads() {
+		static const int threads = std::max(int(std::thread::hardware_concurrency()), 1);
+		return threads;
+	}
+
+	// subtrees are built as tasks down to this depth, a few per core
+	int taskDepth() {
+		static const int depth = []() {
+			int d = 2;
+			for (int n = 1; n < buildThreads(); n *= 2) d++;
+			return d;
+		}();
+		return depth;
+	}
+
+	// chunks to reduce a node of count primitives over, the cores being
+	// shared by the nodes at its depth
+	int reduceTasks(int count, int depth) {
+		const int cores = (depth < 31) ? std::max(buildThreads() >> depth, 1) : 1;
+		return std::max(std::min(cores, count / min_parallel_size), 1);
+	}
+
+	// reduce(begin, end) over tasks chunks of [begin, end), one per thread,
+	// combining the results in order with merge(a, b)
+	template <typename Reduce, typename Merge>
+	auto parallelReduce(int begin, int end, int tasks, Reduce &&reduce, Merge &&merge) -> decltype(reduce(begin, end)) {
+		using T = decltype(reduce(begin, end));
+		if (tasks <= 1) return reduce(begin, end);
+		auto split = [&](int t) { return begin + int(int64_t(end - begin) * t / tasks); };
+		std::vector<std::future<T>> rest;
+		for (int t = 1; t < tasks; t++) {
+			rest.push_back(std::async(std::launch::async, [&reduce, b = split(t), e = split(t + 1)]() { return reduce(b, e); }));
+		}
+		T result = reduce(begin, split(1));
+		for (std::future<T> &f : rest) result = merge(result, f.get());
+		return result;
+	}
+
+	template <typename Body>
+	void parallelFor(int begin, int end, int tasks, Body &&body) {
+		parallelReduce(begin, end, tasks, [&](int b, int e) { body(b, e); return 0; }, [](int, int) { return 0; });
+	}
+
+	// sort chunks on tasks threads, then merge them pairwise
+	template <typename T>
+	void parallelSort(std::vector<T> &values, int tasks) {
+		std::vector<int> splits(tasks + 1);
+		for (int t = 0; t <= tasks; t++) splits[t] = int(int64_t(values.size()) * t / tasks);
+		auto at = [&](int t) { return values.begin() + splits[t]; };
+		parallelFor(0, tasks, tasks, [&](int begin, int end) {
+			for (int t = begin; t < end; t++) std::sort(at(t), at(t + 1));
+		});
+		for (int width = 1; width < tasks; width *= 2) {
+			const int merges = (tasks - width + 2 * width - 1) / (2 * width);
+			parallelFor(0, merges, merges, [&](int begin, int end) {
+				for (int m = begin; m < end; m++) {
+					const int first = 2 * width * m;
+					std::inplace_merge(at(first), at(first + width), at(std::min(first + 2 * width, tasks)));
+				}
+			});
+		}
+	}
+
+	Bounds merged(Bounds a, const Bounds &b) {
+		a.extend(b);
+		return a;
+	}
+
+	// bounds of the primitives in [begin, end) and of their centroids
+	template <typename Prims>
+	std::pair<Bounds, Bounds> primBounds(const Prims &prims, int begin, int end, int depth) {
+		return parallelReduce(begin, end, reduceTasks(end - begin, depth), [&](int b, int e) {
+			std::pair<Bounds, Bounds> result;
+			for (int i = b; i < e; i++) {
+				result.first.extend(prims[i].bounds);
+				result.second.extend(prims[i].centroid);
+			}
+			return result;
+		}, [](const std::pair<Bounds, Bounds> &a, const std::pair<Bounds, Bounds> &b) {
+			return std::make_pair(merged(a.first, b.first), merged(a.second, b.second));
+		});
+	}
+}
+
+
+const char * bvhQualityName(BVHQuality q) {
+	return quality_names[q];
+}
+
+
+BVHQuality bvhQualityFromName(const std::string &name) {
+	for (int q = 0; q < bvh_quality_count; q++) {
+		if (name == quality_names[q]) return BVHQuality(q);
+	}
+	throw std::invalid_argument("Unknown BVH build " + name);
+}
+
+
+struct BVH::BuildPrim {
+	Bounds bounds;
+	glm::vec3 centroid;
+	int index;
+};
+
+
+struct BVH::SplitBuild {
+	const Clip &clip;
+	float root_area;
+	int budget; // extra references left
+};
+
+
+struct BVH::Subtree {
+	std::vector<Node> nodes;
+	std::vector<int> indices;
+};
+
+
+void BVH::collect(const std::vector<Bounds> &prim_bounds, std::vector<BuildPrim> &prims) {
+	m_nodes.clear();
+	m_close.clear();
+	m_indices.clear();
+	m_unbounded.clear();
+
+	prims.reserve(prim_bounds.size());
+	for (int i = 0; i < int(prim_bounds.size()); i++) {
+		if (prim_bounds[i].empty()) {
+			continue;
+		} else if (prim_bounds[i].finite()) {
+			prims.push_back({ prim_bounds[i], prim_bounds[i].centroid(), i });
+		} else {
+			m_unbounded.push_back(i);
+		}
+	}
+}
+
+
+void BVH::assign(Subtree &tree) {
+	m_nodes = std::move(tree.nodes);
+	m_indices = std::move(tree.indices);
+}
+
+
+void BVH::build(const std::vector<Bounds> &prim_bounds, BVHQuality quality) {
+	std::vector<BuildPrim> prims;
+	collect(prim_bounds, prims);
+	if (prims.empty()) return;
+	const int count = int(prims.size());
+	Subtree tree;
+	tree.nodes.reserve(2 * prims.size());
+	tree.indices.reserve(prims.size());
+	if (quality == bvh_sah) {
+		buildRecursive(tree, prims, 0, count, 0);
+		assign(tree);
+		return;
+	}
+
+	// sort by the morton codes of the centroids within their bounds, with
+	// the primitive in the low bits to keep the order deterministic
+	const int tasks = reduceTasks(count, 0);
+	const Bounds centroid_bounds = primBounds(prims, 0, count, 0).second;
+	std::vector<uint64_t> keys(count);
+	parallelFor(0, count, tasks, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) keys[i] = uint64_t(centroid_bounds.mortonCode(prims[i].centroid)) << 32 | unsigned(i);
+	});
+	parallelSort(keys, tasks);
+
+	std::vector<BuildPrim> sorted(count);
+	std::vector<unsigned> codes(count);
+	parallelFor(0, count, tasks, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			sorted[i] = prims[keys[i] & 0xffffffffu];
+			codes[i] = unsigned(keys[i] >> 32);
+		}
+	});
+	buildMorton(tree, sorted, codes, 0, count, 0);
+	assign(tree);
+}
+
+
+void BVH::build(const std::vector<Bounds> &prim_bounds, const Clip &clip, float duplication_budget) {
+	std::vector<BuildPrim> prims;
+	collect(prim_bounds, prims);
+	if (prims.empty()) return;
+	Subtree tree;
+	tree.nodes.reserve(2 * prims.size());
+	tree.indices.reserve(prims.size());
+	const Bounds root = primBounds(prims, 0, int(prims.size()), 0).first;
+	SplitBuild build{ clip, root.surfaceArea(), int(duplication_budget * prims.size()) };
+	buildSplit(tree, prims, build, 0);
+	assign(tree);
+}
+
+
+void BVH::build(const std::vector<Bounds> &open, const std::vector<Bounds> &close) {
+	// split by where the primitives are over the whole interval
+	std::vector<Bounds> swept = open;
+	for (size_t i = 0; i < swept.size(); i++) swept[i].extend(close[i]);
+	build(swept);
+	if (m_nodes.empty()) return;
+	m_close.resize(m_nodes.size());
+	refit(open, close);
+}
+
+
+void BVH::refit(const std::vector<Bounds> &open, const std::vector<Bounds> &close) {
+	refit(open);
+	if (m_close.empty()) return;
+	for (int i = int(m_nodes.size()) - 1; i >= 0; i--) {
+		const Node &node = m_nodes[i];
+		m_close[i] = Bounds();
+		if (node.count > 0) {
+			for (int j = node.offset; j < node.offset + node.count; j++) m_close[i].extend(close[m_indices[j]]);
+		} else {
+			m_close[i].extend(m_close[i + 1]);
+			m_close[i].extend(m_close[node.offset]);
+		}
+	}
+}
+
+
+void BVH::refit(const std::vector<Bounds> &prim_bounds) {
+	// children always come after their parent
+	for (int i = int(m_nodes.size()) - 1; i >= 0; i--) {
+		Node &node = m_nodes[i];
+		node.bounds = Bounds();
+		if (node.count > 0) {
+			for (int j = node.offset; j < node.offset + node.count; j++) node.bounds.extend(prim_bounds[m_indices[j]]);
+		} else {
+			node.bounds.extend(m_nodes[i + 1].bounds);
+			node.bounds.extend(m_nodes[node.offset].bounds);
+		}
+	}
+}
+
+
+float BVH::cost() const {
+	if (m_nodes.empty() || bounds(0, 0.5f).surfaceArea() <= 0) return 0;
+	float area = 0;
+	for (int i = 0; i < int(m_nodes.size()); i++) area += bounds(i, 0.5f).surfaceArea();
+	return area / bounds(0, 0.5f).surfaceArea();
+}
+
+
+template <typename First, typename Second>
+void BVH::buildChildren(Subtree &tree, int node_index, bool task, First &&first, Second &&second) {
+	if (!task) {
+		first(tree);
+		tree.nodes[node_index].offset = second(tree);
+		return;
+	}
+	// build the first child on a thread of its own meanwhile, and append
+	// both once done so the first still directly follows its parent
+	std::future<Subtree> first_task = std::async(std::launch::async, [&first]() {
+		Subtree subtree;
+		first(subtree);
+		return subtree;
+	});
+	Subtree second_subtree;
+	second(second_subtree);
+	append(tree, first_task.get());
+	tree.nodes[node_index].offset = append(tree, second_subtree);
+}
+
+
+int BVH::append(Subtree &tree, const Subtree &subtree) {
+	const int node_base = int(tree.nodes.size());
+	const int index_base = int(tree.indices.size());
+	for (Node node : subtree.nodes) {
+		node.offset += (node.count > 0) ? index_base : node_base;
+		tree.nodes.push_back(node);
+	}
+	tree.indices.insert(tree.indices.end(), subtree.indices.begin(), subtree.indices.end());
+	return node_base;
+}
+
+
+int BVH::makeLeaf(Subtree &tree, int node_index, const std::vector<BuildPrim> &prims, int begin, int end) {
+	tree.nodes[node_index].offset = int(tree.indices.size());
+	tree.nodes[node_index].count = (unsigned short)(end - begin);
+	for (int i = begin; i < end; i++) tree.indices.push_back(prims[i].index);
+	return node_index;
+}
+
+
+float BVH::objectSplit(const std::vector<BuildPrim> &prims, int begin, int end, const Bounds &bounds,
+	const Bounds &centroid_bounds, int axis, int depth, int &best, Bounds &left, Bounds &right)
+{
+	// bin the centroids along the axis
+	const float extent = centroid_bounds.extent()[axis];
+	struct Bin { Bounds bounds; int count = 0; };
+	using Bins = std::array<Bin, bin_count>;
+	const Bins bins = parallelReduce(begin, end, reduceTasks(end - begin, depth), [&](int b, int e) {
+		Bins chunk;
+		for (int i = b; i < e; i++) {
+			int bin = std::min(int(bin_count * (prims[i].centroid[axis] - centroid_bounds.min[axis]) / extent), bin_count - 1);
+			chunk[bin].bounds.extend(prims[i].bounds);
+			chunk[bin].count++;
+		}
+		return chunk;
+	}, [](Bins a, const Bins &b) {
+		for (int i = 0; i < bin_count; i++) {
+			a[i].bounds.extend(b[i].bounds);
+			a[i].count += b[i].count;
+		}
+		return a;
+	});
+
+	// sweep from both sides to evaluate the SAH at each bin boundary
+	float cost[bin_count - 1];
+	Bounds lefts[bin_count - 1];
+	int left_count = 0;
+	for (int i = 0; i < bin_count - 1; i++) {
+		lefts[i] = (i > 0) ? lefts[i - 1] : Bounds();
+		lefts[i].extend(bins[i].bounds);
+		left_count += bins[i].count;
+		cost[i] = left_count * lefts[i].surfaceArea();
+	}
+	Bounds rights[bin_count - 1];
+	int right_count = 0;
+	for (int i = bin_count - 1; i > 0; i--) {
+		rights[i - 1] = (i < bin_count - 1) ? rights[i] : Bounds();
+		rights[i - 1].extend(bins[i].bounds);
+		right_count += bins[i].count;
+		cost[i - 1] += right_count * rights[i - 1].surfaceArea();
+	}
+
+	best = int(std::min_element(cost, cost + bin_count - 1) - cost);
+	left = lefts[best];
+	right = rights[best];
+	return traversal_cost + cost[best] / bounds.surfaceArea();
+}
+
+
+float BVH::spatialSplit(const std::vector<BuildPrim> &prims, const Bounds &bounds, int axis, const SplitBuild &build, int depth, float &plane) {
+	const float min = bounds.min[axis];
+	const float extent = bounds.extent()[axis];
+	if (!(extent > 0)) return std::numeric_limits<float>::infinity();
+
+	// bin the clipped references, counting where each starts and ends
+	struct Bin { Bounds bounds; int entry = 0, exit = 0; };
+	using Bins = std::array<Bin, spatial_bin_count>;
+	auto bin_of = [&](float x) { return std::min(std::max(int(spatial_bin_count * (x - min) / extent), 0), spatial_bin_count - 1); };
+	auto boundary = [&](int b) { return min + extent * b / spatial_bin_count; };
+	const Bins bins = parallelReduce(0, int(prims.size()), reduceTasks(int(prims.size()), depth), [&](int begin, int end) {
+		Bins chunk;
+		for (int i = begin; i < end; i++) {
+			const BuildPrim &p = prims[i];
+			const int first = bin_of(p.bounds.min[axis]), last = bin_of(p.bounds.max[axis]);
+			chunk[first].entry++;
+			chunk[last].exit++;
+			if (first == last) {
+				chunk[first].bounds.extend(p.bounds);
+				continue;
+			}
+			for (int b = first; b <= last; b++) {
+				Bounds slab = p.bounds;
+				if (b > first) slab.min[axis] = boundary(b);
+				if (b < last) slab.max[axis] = boundary(b + 1);
+				chunk[b].bounds.extend(build.clip(p.index, slab));
+			}
+		}
+		return chunk;
+	}, [](Bins a, const Bins &b) {
+		for (int i = 0; i < spatial_bin_count; i++) {
+			a[i].bounds.extend(b[i].bounds);
+			a[i].entry += b[i].entry;
+			a[i].exit += b[i].exit;
+		}
+		return a;
+	});
+
+	float cost[spatial_bin_count - 1];
+	Bounds left;
+	int left_count = 0;
+	for (int i = 0; i < spatial_bin_count - 1; i++) {
+		left.extend(bins[i].bounds);
+		left_count += bins[i].entry;
+		cost[i] = left_count * left.surfaceArea();
+	}
+	Bounds right;
+	int right_count = 0;
+	for (int i = spatial_bin_count - 1; i > 0; i--) {
+		right.extend(bins[i].bounds);
+		right_count += bins[i].exit;
+		cost[i - 1] += right_count * right.surfaceArea();
+	}
+
+	const int best = int(std::min_element(cost, cost + spatial_bin_count - 1) - cost);
+	plane = boundary(best + 1);
+	return traversal_cost + cost[best] / bounds.surfaceArea();
+}
+
+
+int BVH::buildRecursive(Subtree &tree, std::vector<BuildPrim> &prims, int begin, int end, int depth) {
+	int node_index = int(tree.nodes.size());
+	tree.nodes.emplace_back();
+
+	Bounds bounds, centroid_bounds;
+	std::tie(bounds, centroid_bounds) = primBounds(prims, begin, end, depth);
+	tree.nodes[node_index].bounds = bounds;
+
+	int count = end - begin;
+	if (count == 1) return makeLeaf(tree, node_index, prims, begin, end);
+
+	int axis = centroid_bounds.maxDimension();
+	float extent = centroid_bounds.extent()[axis];
+	int mid = (begin + end) / 2;
+
+	if (extent > 0 && depth < max_depth) {
+		int best;
+		Bounds left, right;
+		float split_cost = objectSplit(prims, begin, end, bounds, centroid_bounds, axis, depth, best, left, right);
+		if (count <= max_leaf_size && split_cost >= count) return makeLeaf(tree, node_index, prims, begin, end);
+
+		mid = int(std::partition(prims.begin() + begin, prims.begin() + end, [&](const BuildPrim &p) {
+			return std::min(int(bin_count * (p.centroid[axis] - centroid_bounds.min[axis]) / extent), bin_count - 1) <= best;
+		}) - prims.begin());
+		if (mid == begin || mid == end) mid = (begin + end) / 2;
+	} else if (count <= max_leaf_size || depth >= max_depth) {
+		return makeLeaf(tree, node_index, prims, begin, end);
+	}
+
+	// the children partition disjoint ranges of prims, so can be built at once
+	buildChildren(tree, node_index, count >= min_task_size && depth < taskDepth(),
+		[&](Subtree &t) { return buildRecursive(t, prims, begin, mid, depth + 1); },
+		[&](Subtree &t) { return buildRecursive(t, prims, mid, end, depth + 1); });
+	tree.nodes[node_index].axis = (unsigned short)(axis);
+	return node_index;
+}
+
+
+int BVH::buildSplit(Subtree &tree, std::vector<BuildPrim> &prims, SplitBuild &build, int depth) {
+	int node_index = int(tree.nodes.size());
+	tree.nodes.emplace_back();
+
+	const int count = int(prims.size());
+	Bounds bounds, centroid_bounds;
+	std::tie(bounds, centroid_bounds) = primBounds(prims, 0, count, depth);
+	tree.nodes[node_index].bounds = bounds;
+
+	if (count == 1 || depth >= max_depth) return makeLeaf(tree, node_index, prims, 0, count);
+
+	// object split, as buildRecursive
+	int axis = centroid_bounds.maxDimension();
+	int object_bin = -1;
+	float object_cost = std::numeric_limits<float>::infinity();
+	Bounds left_bounds, right_bounds;
+	if (centroid_bounds.extent()[axis] > 0) {
+		object_cost = objectSplit(prims, 0, count, bounds, centroid_bounds, axis, depth, object_bin, left_bounds, right_bounds);
+	}
+
+	// spatial split, only tried where the object split children overlap
+	int spatial_axis = -1;
+	float spatial_cost = std::numeric_limits<float>::infinity();
+	float plane = 0;
+	if (build.budget > 0 && (object_bin < 0 || left_bounds.intersection(right_bounds).surfaceArea() > min_split_overlap * build.root_area)) {
+		for (int a = 0; a < 3; a++) {
+			float p;
+			float c = spatialSplit(prims, bounds, a, build, depth, p);
+			if (c < spatial_cost) {
+				spatial_cost = c;
+				spatial_axis = a;
+				plane = p;
+			}
+		}
+	}
+
+	const float split_cost = std::min(object_cost, spatial_cost);
+	if (count <= max_leaf_size && split_cost >= count) return makeLeaf(tree, node_index, prims, 0, count);
+
+	std::vector<BuildPrim> left, right;
+	if (spatial_cost < object_cost) {
+		// references straddling the plane go to both sides, clipped
+		axis = spatial_axis;
+		for (const BuildPrim &p : prims) {
+			if (p.bounds.max[axis] <= plane) {
+				left.push_back(p);
+			} else if (p.bounds.min[axis] >= plane) {
+				right.push_back(p);
+			} else if (build.budget > 0) {
+				Bounds l = p.bounds, r = p.bounds;
+				l.max[axis] = plane;
+				r.min[axis] = plane;
+				l = build.clip(p.index, l);
+				r = build.clip(p.index, r);
+				if (!l.empty()) left.push_back({ l, l.centroid(), p.index });
+				if (!r.empty()) right.push_back({ r, r.centroid(), p.index });
+				if (l.empty() && r.empty()) left.push_back(p);
+				else if (!l.empty() && !r.empty()) build.budget--;
+			} else {
+				(p.centroid[axis] < plane ? left : right).push_back(p);
+			}
+		}
+	} else if (object_bin >= 0) {
+		const float extent = centroid_bounds.extent()[axis];
+		for (const BuildPrim &p : prims) {
+			const int b = std::min(int(bin_count * (p.centroid[axis] - centroid_bounds.min[axis]) / extent), bin_count - 1);
+			(b <= object_bin ? left : right).push_back(p);
+		}
+	}
+
+	// split in half if neither split separates anything
+	if (left.empty() || right.empty()) {
+		if (count <= max_leaf_size) return makeLeaf(tree, node_index, prims, 0, count);
+		left.assign(prims.begin(), prims.begin() + count / 2);
+		right.assign(prims.begin() + count / 2, prims.end());
+	}
+	prims.clear();
+	prims.shrink_to_fit();
+
+	auto first = [&](Subtree &t, SplitBuild &b) { return buildSplit(t, left, b, depth + 1); };
+	auto second = [&](Subtree &t, SplitBuild &b) { return buildSplit(t, right, b, depth + 1); };
+	if (count >= min_task_size) {
+		// large nodes give the children shares of the budget by their
+		// references, so neither subtree depends on which is built first
+		const int left_budget = int(int64_t(build.budget) * left.size() / (left.size() + right.size()));
+		SplitBuild left_build{ build.clip, build.root_area, left_budget };
+		SplitBuild right_build{ build.clip, build.root_area, build.budget - left_budget };
+		buildChildren(tree, node_index, depth < taskDepth(),
+			[&](Subtree &t) { return first(t, left_build); },
+			[&](Subtree &t) { return second(t, right_build); });
+	} else {
+		buildChildren(tree, node_index, false,
+			[&](Subtree &t) { return first(t, build); },
+			[&](Subtree &t) { return second(t, build); });
+	}
+	tree.nodes[node_index].axis = (unsigned short)(axis);
+	return node_index;
+}
+
+
+int BVH::buildMorton(Subtree &tree, const std::vector<BuildPrim> &prims, const std::vector<unsigned> &codes,
+	int begin, int end, int depth)
+{
+	int node_index = int(tree.nodes.size());
+	tree.nodes.emplace_back();
+
+	const int count = end - begin;
+	if (count <= max_leaf_size || depth >= max_depth) {
+		for (int i = begin; i < end; i++) tree.nodes[node_index].bounds.extend(prims[i].bounds);
+		return makeLeaf(tree, node_index, prims, begin, end);
+	}
+
+	// split where the highest bit that differs over the (sorted) range
+	// changes, halving the cell it spans along one axis, or in the middle
+	// of primitives with the same code
+	int mid = (begin + end) / 2;
+	int axis = 0;
+	const unsigned diff = codes[begin] ^ codes[end - 1];
+	if (diff != 0) {
+		int bit = 31;
+		while (!((diff >> bit) & 1)) bit--;
+		mid = int(std::partition_point(codes.begin() + begin, codes.begin() + end, [bit](unsigned c) { return !((c >> bit) & 1); }) - codes.begin());
+		axis = 2 - bit % 3;
+	}
+
+	// bounds are merged up from the children once built
+	buildChildren(tree, node_index, count >= min_task_size && depth < taskDepth(),
+		[&](Subtree &t) { return buildMorton(t, prims, codes, begin, mid, depth + 1); },
+		[&](Subtree &t) { return buildMorton(t, prims, codes, mid, end, depth + 1); });
+	Node &node = tree.nodes[node_index];
+	node.bounds = merged(tree.nodes[node_index + 1].bounds, tree.nodes[node.offset].bounds);
+	node.axis = (unsigned short)(axis);
+	return node_index;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+// std
+#include <functional>
+#include <string>
+#include <vector>
+
+// project
+#include "bounds.hpp"
+#include "ray.hpp"
+
+
+// how a BVH is built
+enum BVHQuality : int {
+	bvh_fast, // split along a morton curve (LBVH), quick to build but slower to trace
+	bvh_sah,  // binned SAH
+	bvh_quality_count
+};
+
+// name of a build quality, and the quality by name (throws std::invalid_argument)
+const char * bvhQualityName(BVHQuality q);
+BVHQuality bvhQualityFromName(const std::string &name);
+
+
+// Binary bounding volume hierarchy over a set of primitive bounds, built
+// with binned SAH, or for a fast build by sorting the primitives along a
+// morton curve and splitting at the bits of their codes. Nodes are
+// flattened depth first so the first child of an interior node directly
+// follows it. Primitives with infinite bounds (ie. planes) are kept aside
+// and tested for every ray, primitives with empty bounds are left out.
+// A motion BVH is built over bounds at shutter open and close, keeping
+// both per node and testing rays against the bounds interpolated to
+// their time. The tree is shared so a ray visits as many nodes as in a
+// BVH over the bounds at that time, only looser.
+// A split BVH (SBVH) may also split primitives between children by a
+// plane, referencing them from more than one leaf with their bounds clipped
+// to each side, where the SAH says that beats the overlap of an object
+// split (as for large primitives next to small ones).
+class BVH {
+public:
+	// bounds of the part of primitive prim inside box
+	using Clip = std::function<Bounds(int prim, const Bounds &box)>;
+
+	struct Node {
+		Bounds bounds;
+		int offset = 0; // first primitive (leaf) or second child (interior)
+		unsigned short count = 0; // number of primitives, 0 for interior nodes
+		unsigned short axis = 0; // split axis of interior nodes
+	};
+
+private:
+	std::vector<Node> m_nodes;
+	std::vector<Bounds> m_close; // per node for motion, node bounds are at open
+	std::vector<int> m_indices;
+	std::vector<int> m_unbounded;
+
+	struct BuildPrim;
+	struct SplitBuild;
+	struct Subtree; // nodes and leaf indices being built, offsets within it
+	void collect(const std::vector<Bounds> &prim_bounds, std::vector<BuildPrim> &prims);
+	void assign(Subtree &tree);
+	static int buildRecursive(Subtree &tree, std::vector<BuildPrim> &prims, int begin, int end, int depth);
+	static int buildSplit(Subtree &tree, std::vector<BuildPrim> &prims, SplitBuild &build, int depth);
+	static int buildMorton(Subtree &tree, const std::vector<BuildPrim> &prims, const std::vector<unsigned> &codes,
+		int begin, int end, int depth);
+	template <typename First, typename Second>
+	static void buildChildren(Subtree &tree, int node_index, bool task, First &&first, Second &&second);
+	static int append(Subtree &tree, const Subtree &subtree);
+	static int makeLeaf(Subtree &tree, int node_index, const std::vector<BuildPrim> &prims, int begin, int end);
+	static float objectSplit(const std::vector<BuildPrim> &prims, int begin, int end, const Bounds &bounds,
+		const Bounds &centroid_bounds, int axis, int depth, int &best, Bounds &left, Bounds &right);
+	static float spatialSplit(const std::vector<BuildPrim> &prims, const Bounds &bounds, int axis,
+		const SplitBuild &build, int depth, float &plane);
+
+public:
+	BVH() { }
+	BVH(const std::vector<Bounds> &prim_bounds, BVHQuality quality = bvh_sah) { build(prim_bounds, quality); }
+
+	void build(const std::vector<Bounds> &prim_bounds, BVHQuality quality = bvh_sah);
+
+	// build a split BVH, clipping primitives with clip. duplication_budget
+	// is the number of extra references allowed, relative to the number of
+	// primitives. it can't be refit
+	void build(const std::vector<Bounds> &prim_bounds, const Clip &clip, float duplication_budget);
+
+	// build a motion BVH, the primitives bounds at open and close must be
+	// empty, finite or infinite alike
+	void build(const std::vector<Bounds> &open, const std::vector<Bounds> &close);
+
+	// update the node bounds for primitives that moved, keeping the tree.
+	// prim_bounds must be empty, finite or infinite for the same primitives
+	// as when built
+	void refit(const std::vector<Bounds> &prim_bounds);
+	void refit(const std::vector<Bounds> &open, const std::vector<Bounds> &close);
+
+	// surface area of all nodes relative to the root, the expected number of
+	// nodes a ray through the root visits. grows as refitting loosens the tree
+	// (and for motion, as the primitives move further apart). taken halfway
+	// through the shutter for motion
+	float cost() const;
+
+	bool motion() const { return !m_close.empty(); }
+
+	const std::vector<Node> & nodes() const { return m_nodes; }
+	const std::vector<int> & indices() const { return m_indices; } // of the leaves
+	const std::vector<int> & unbounded() const { return m_unbounded; }
+
+	// memory used by the tree
+	size_t bytes() const {
+		return m_nodes.size() * sizeof(Node) + m_close.size() * sizeof(Bounds)
+			+ (m_indices.size() + m_unbounded.size()) * sizeof(int);
+	}
+
+	// bounds of node i at a time in the shutter interval
+	Bounds bounds(int i, float time) const {
+		if (m_close.empty()) return m_nodes[i].bounds;
+		return Bounds(glm::mix(m_nodes[i].bounds.min, m_close[i].min, time), glm::mix(m_nodes[i].bounds.max, m_close[i].max, time));
+	}
+
+	// Calls visit(prim) for the primitives whose bounds the ray passes through,
+	// visiting the near child first based on the rays direction sign.
+	// visit may shrink the tmax of the given ray (by holding a reference to it)
+	// to cull the rest of the traversal, and returns true to stop early.
+	template <typename Visit>
+	void traverse(const Ray &ray, Visit &&visit) const {
+		for (int prim : m_unbounded) {
+			if (visit(prim)) return;
+		}
+		if (m_nodes.empty()) return;
+
+		const bool motion = !m_close.empty();
+		int stack[64];
+		int top = 0;
+		int current = 0;
+		while (true) {
+			const Node &node = m_nodes[current];
+			if (motion ? bounds(current, ray.time).intersect(ray) : node.bounds.intersect(ray)) {
+				if (node.count > 0) {
+					for (int i = node.offset; i < node.offset + node.count; i++) {
+						if (visit(m_indices[i])) return;
+					}
+				} else if (ray.sign[node.axis]) {
+					stack[top++] = current + 1;
+					current = node.offset;
+					continue;
+				} else {
+					stack[top++] = node.offset;
+					current = current + 1;
+					continue;
+				}
+			}
+			if (top == 0) break;
+			current = stack[--top];
+		}
+	}
+};
@@ -44,4 +44,18 @@ Ray Camera::generateRay(const glm::vec2 &pixel) {
 	
 	Ray ray(m_position, worldDir);
 	return ray;
-}
\ No newline at end of file
+}
+
+bool Camera::project(const glm::vec3 &position, glm::vec2 &pixel) const {
+	// into view space, where the camera looks down -z
+	glm::vec3 view(glm::transpose(m_rotation) * glm::vec4(position - m_position, 0));
+	if (view.z >= 0) return false;
+
+	float m_fovx = (m_image_size.x / m_image_size.y) * m_fovy;
+	float view_height = glm::tan(m_fovy / 2);
+	float view_width  = glm::tan(m_fovx / 2);
+
+	pixel.x = (view.x / (-view.z * view_width) + 1) * 0.5f * m_image_size.x;
+	pixel.y = (view.y / (-view.z * view_height) + 1) * 0.5f * m_image_size.y;
+	return true;
+}
@@ -29,9 +29,9 @@ public:
 	Camera() { setPositionOrientation(m_position, m_yaw, m_pitch); }
 
 	// typical get methods
-	glm::vec3 position() { return m_position; }
-	float yaw() { return m_yaw; }
-	float pitch() { return m_pitch; }
+	glm::vec3 position() const { return m_position; }
+	float yaw() const { return m_yaw; }
+	float pitch() const { return m_pitch; }
 
 	// typical set methods
 	void setPositionOrientation(const glm::vec3 &pos, float yaw, float pitch);
@@ -42,4 +42,8 @@ public:
 
 	// converts a position in screen coordinates into a ray in world coordinates
 	Ray generateRay(const glm::vec2 &pixel);
+
+	// converts a world position into screen coordinates (the inverse of
+	// generateRay), false if it is not in front of the camera
+	bool project(const glm::vec3 &position, glm::vec2 &pixel) const;
 };
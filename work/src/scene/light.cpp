@@ -2,80 +2,205 @@
 // glm
 #include <gtc/constants.hpp>
 
+// std
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
 // project
 #include "light.hpp"
+#include "sampling.hpp"
 
 #include <iostream>
 
-bool DirectionalLight::occluded(Scene *scene, const glm::vec3 &point) const {
-	//-------------------------------------------------------------
-	// [Assignment 4] :
-	// Determine whether the given point is being occluded from
-	// this directional light by an object in the scene.
-	// Remember that directional lights are "infinitely" far away
-	// so any object in the way would cause an occlusion.
-	//-------------------------------------------------------------
-	Ray r(point, -incidentDirection(point)); // Ray from object to light
-	RayIntersection intersect = scene->intersect(r);
-	if (intersect.m_valid) {
-		return true;
-	}
-	else if (!intersect.m_valid || intersect.m_distance < 0) {
-		return false;
-	}
+
+LightSample DirectionalLight::sample(const glm::vec3 &, const glm::vec2 &) const {
+	LightSample s;
+	s.m_direction = m_direction;
+	s.m_irradiance = m_irradiance;
+	s.m_infinite = true;
+	s.m_pdf = 1;
+	return s;
 }
 
-glm::vec3 DirectionalLight::incidentDirection(const glm::vec3 &) const {
-	return m_direction;
+
+LightSample PointLight::sample(const glm::vec3 &point, const glm::vec2 &) const {
+	// the flux spread over the sphere around the light reaching the point
+	const float dist = glm::distance(m_position, point);
+	LightSample s;
+	s.m_direction = glm::normalize(point - m_position);
+	s.m_irradiance = m_flux / (4.0f * glm::pi<float>() * (dist * dist));
+	s.m_position = m_position;
+	s.m_pdf = 1;
+	return s;
+}
+
+
+LightSample AreaLight::areaSample(const glm::vec3 &point, const glm::vec3 &position, const glm::vec3 &normal, float area) const {
+	// an area density of 1 / area is dist^2 / (cos * area) by solid angle
+	const glm::vec3 to_light = position - point;
+	const float dist2 = glm::dot(to_light, to_light);
+	const float cos_light = glm::abs(glm::dot(normal, to_light)) / std::sqrt(dist2);
+	const float pdf = dist2 / (cos_light * area);
+	if (!(pdf > 0 && pdf < std::numeric_limits<float>::infinity())) return LightSample();
+
+	LightSample s;
+	s.m_direction = -to_light / std::sqrt(dist2);
+	s.m_irradiance = m_radiance / pdf;
+	s.m_position = position;
+	s.m_pdf = pdf;
+	return s;
+}
+
+
+LightSample SphereLight::sample(const glm::vec3 &point, const glm::vec2 &u) const {
+	const glm::vec3 to_center = m_sphere.center() - point;
+	const float dist2 = glm::dot(to_center, to_center);
+	const float radius2 = m_sphere.radius() * m_sphere.radius();
+	if (dist2 <= radius2) return LightSample();
+
+	// the cone of directions to the sphere, 1 - cos of its half angle from
+	// the series for small spheres (far away) where the subtraction loses it
+	const float sin2_max = radius2 / dist2;
+	const float one_minus_cos = (sin2_max < 1e-3f) ? sin2_max / 2 + sin2_max * sin2_max / 8 : 1 - std::sqrt(1 - sin2_max);
+	const float dist = std::sqrt(dist2);
+	const glm::vec3 w = to_center / dist;
+	glm::vec3 t, b;
+	orthonormalBasis(w, t, b);
+	const glm::vec3 c = uniformCone(u, one_minus_cos);
+	const glm::vec3 d = glm::normalize(c.x * t + c.y * b + c.z * w);
+
+	// where the direction enters the sphere
+	const float near = dist * c.z - std::sqrt(std::max(0.f, radius2 - dist2 * (1 - c.z * c.z)));
+
+	LightSample s;
+	s.m_direction = -d;
+	s.m_pdf = 1 / (2 * glm::pi<float>() * one_minus_cos);
+	s.m_irradiance = m_radiance * (2 * glm::pi<float>() * one_minus_cos);
+	s.m_position = point + near * d;
+	return s;
 }
 
 
-glm::vec3 DirectionalLight::irradiance(const glm::vec3 &) const {
-	return m_irradiance;
+LightSample DiskLight::sample(const glm::vec3 &point, const glm::vec2 &u) const {
+	const glm::vec3 n = m_disk.normal();
+	glm::vec3 t, b;
+	orthonormalBasis(n, t, b);
+	const glm::vec2 p = m_disk.radius() * concentricDisk(u);
+	const float area = glm::pi<float>() * m_disk.radius() * m_disk.radius();
+	return areaSample(point, m_disk.center() + p.x * t + p.y * b, n, area);
 }
 
 
-bool PointLight::occluded(Scene *scene, const glm::vec3 &point) const {
-	//std::cout << "HERE" << std::endl;
-	//-------------------------------------------------------------
-	// [Assignment 4] :
-	// Determine whether the given point is being occluded from
-	// this directional light by an object in the scene.
-	// Remember that point lights are somewhere in the scene and
-	// an occulsion has to occur somewhere between the light and 
-	// the given point.
-	//-------------------------------------------------------------
-	Ray r(point, -incidentDirection(point));
-	RayIntersection intersect = scene->intersect(r);
-	if (intersect.m_valid) {
-		float dot = glm::dot(-incidentDirection(point), m_position - intersect.m_position);
-		return dot >= 0;
+LightSample RectangleLight::sample(const glm::vec3 &point, const glm::vec2 &u) const {
+	// frame of the rectangle with the point at the origin, flipped so the
+	// rectangle is on the -z side (in the plane z = z0)
+	const float ex_length = glm::length(m_rectangle.edgeU());
+	const float ey_length = glm::length(m_rectangle.edgeV());
+	const glm::vec3 x = m_rectangle.edgeU() / ex_length;
+	const glm::vec3 y = m_rectangle.edgeV() / ey_length;
+	glm::vec3 z = glm::cross(x, y);
+	const glm::vec3 d = m_rectangle.corner() - point;
+	const float x0 = glm::dot(d, x), y0 = glm::dot(d, y);
+	float z0 = glm::dot(d, z);
+	if (z0 == 0) return LightSample();
+	if (z0 > 0) {
+		z0 = -z0;
+		z = -z;
 	}
-	else if (!intersect.m_valid || intersect.m_distance < 0) {
-		return false;
+	const float x1 = x0 + ex_length, y1 = y0 + ey_length;
+
+	// normals of the planes through the point and each edge, and the
+	// angles between them, summing to the solid angle
+	const glm::vec3 n0 = glm::normalize(glm::vec3(0, z0, -y0));
+	const glm::vec3 n1 = glm::normalize(glm::vec3(-z0, 0, x1));
+	const glm::vec3 n2 = glm::normalize(glm::vec3(0, -z0, y1));
+	const glm::vec3 n3 = glm::normalize(glm::vec3(z0, 0, -x0));
+	const float g0 = std::acos(glm::clamp(-glm::dot(n0, n1), -1.f, 1.f));
+	const float g1 = std::acos(glm::clamp(-glm::dot(n1, n2), -1.f, 1.f));
+	const float g2 = std::acos(glm::clamp(-glm::dot(n2, n3), -1.f, 1.f));
+	const float g3 = std::acos(glm::clamp(-glm::dot(n3, n0), -1.f, 1.f));
+	const float k = 2 * glm::pi<float>() - g2 - g3;
+	const float solid_angle = g0 + g1 - k;
+
+	// the sum cancels most of its precision for small solid angles
+	if (solid_angle < 3e-4f) {
+		const glm::vec3 position = m_rectangle.corner() + u.x * m_rectangle.edgeU() + u.y * m_rectangle.edgeV();
+		return areaSample(point, position, m_rectangle.normal(), ex_length * ey_length);
+	}
+
+	// x of the sample from the area of the spherical rectangle left of it
+	const float b0 = n0.z, b1 = n2.z;
+	const float au = u.x * solid_angle + k;
+	const float fu = (std::cos(au) * b0 - b1) / std::sin(au);
+	const float cu = glm::clamp(std::copysign(1.f, fu) / std::sqrt(fu * fu + b0 * b0), -1.f, 1.f);
+	const float xu = glm::clamp(-(cu * z0) / std::sqrt(std::max(1 - cu * cu, 1e-12f)), x0, x1);
+
+	// then y, uniform in the height of the projection onto the sphere
+	const float dist = std::sqrt(xu * xu + z0 * z0);
+	const float h0 = y0 / std::sqrt(dist * dist + y0 * y0);
+	const float h1 = y1 / std::sqrt(dist * dist + y1 * y1);
+	const float hv = h0 + u.y * (h1 - h0);
+	const float yv = (hv * hv < 1 - 1e-6f) ? (hv * dist) / std::sqrt(1 - hv * hv) : y1;
+
+	const glm::vec3 to_light = xu * x + yv * y + z0 * z;
+	LightSample s;
+	s.m_direction = -glm::normalize(to_light);
+	s.m_pdf = 1 / solid_angle;
+	s.m_irradiance = m_radiance * solid_angle;
+	s.m_position = point + to_light;
+	return s;
+}
+
+
+EnvironmentLight::EnvironmentLight(std::shared_ptr<const Texture> image, float scale, const glm::vec3 &ambience)
+	: m_image(std::move(image)), m_scale(scale), m_ambience(ambience)
+{
+	// texels by luminance, times the sine of their latitude as rows near
+	// the poles cover less solid angle
+	const glm::ivec2 size = m_image->size();
+	std::vector<float> weights(size_t(size.x) * size.y);
+	for (int y = 0; y < size.y; y++) {
+		const float sin_theta = std::sin(glm::pi<float>() * (y + 0.5f) / size.y);
+		for (int x = 0; x < size.x; x++) {
+			const glm::vec3 c = m_image->texel(glm::ivec2(x, y));
+			weights[y * size.x + x] = (0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b) * sin_theta;
+		}
 	}
+	m_distribution = Distribution2D(weights, size.x, size.y);
 }
 
 
-glm::vec3 PointLight::incidentDirection(const glm::vec3 &point) const {
-	//-------------------------------------------------------------
-	// [Assignment 4] :
-	// Return the direction of the incoming light (light to point)
-	//-------------------------------------------------------------
-	return glm::normalize(point - m_position);
+glm::vec3 EnvironmentLight::radiance(const glm::vec2 &uv) const {
+	const glm::ivec2 size = m_image->size();
+	const glm::ivec2 p = glm::clamp(glm::ivec2(uv * glm::vec2(size)), glm::ivec2(0), size - 1);
+	return m_scale * m_image->texel(p);
 }
 
 
-glm::vec3 PointLight::irradiance(const glm::vec3 &point) const {
-	//-------------------------------------------------------------
-	// [Assignment 4] :
-	// Return the total irradiance on the given point.
-	// This requires you to convert the flux of the light into
-	// irradiance by dividing it by the surface of the sphere
-	// it illuminates. Remember that the surface area increases
-	// as the sphere gets bigger, ie. the point is further away.
-	//-------------------------------------------------------------
-	float distToLight = glm::abs(glm::distance(m_position, point));
-	glm::vec3 intensity = m_flux / (4.0f * glm::pi<float>() * (distToLight * distToLight));
-	return intensity;
-}
\ No newline at end of file
+glm::vec3 EnvironmentLight::radiance(const glm::vec3 &direction) const {
+	const glm::vec3 d = glm::normalize(direction);
+	const float phi = std::atan2(d.x, -d.z);
+	const float theta = std::acos(glm::clamp(d.y, -1.f, 1.f));
+	return radiance(glm::vec2(0.5f + phi / (2 * glm::pi<float>()), 1 - theta / glm::pi<float>()));
+}
+
+
+LightSample EnvironmentLight::sample(const glm::vec3 &, const glm::vec2 &u) const {
+	float map_pdf;
+	const glm::vec2 uv = m_distribution.sample(u, map_pdf);
+	const float theta = (1 - uv.y) * glm::pi<float>();
+	const float phi = (uv.x - 0.5f) * 2 * glm::pi<float>();
+	const float sin_theta = std::sin(theta);
+	if (map_pdf == 0 || sin_theta <= 0) return LightSample();
+
+	// from the density over the image to solid angle, the image spans
+	// 2pi by pi and a texel shrinks by the sine of its latitude
+	LightSample s;
+	s.m_direction = -glm::vec3(sin_theta * std::sin(phi), std::cos(theta), -sin_theta * std::cos(phi));
+	s.m_pdf = map_pdf / (2 * glm::pi<float>() * glm::pi<float>() * sin_theta);
+	s.m_irradiance = radiance(uv) / s.m_pdf;
+	s.m_infinite = true;
+	return s;
+}
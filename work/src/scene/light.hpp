@@ -1,25 +1,52 @@
 
 #pragma once
 
+// std
+#include <memory>
+
 // glm
 #include <glm.hpp>
 
 // project
+#include "sampling.hpp"
 #include "scene.hpp"
+#include "shape.hpp"
+#include "texture.hpp"
 
 
-class Light {
+// Light arriving at a point from a direction sampled towards a light
+class LightSample {
 public:
-	// return true if the point is occluded from the scene
-	virtual bool occluded(Scene *scene, const glm::vec3 &point) const = 0;
+	// direction of the incoming light (light to point), unit length
+	glm::vec3 m_direction{ 0 };
 
-	// return direction of incoming light (light to point)
-	virtual glm::vec3 incidentDirection(const glm::vec3 &point) const = 0;
+	// irradiance cast from that direction onto a surface oriented towards
+	// it, divided by the pdf (so for area lights an estimate of the
+	// irradiance from all of it), assuming there is no obstruction
+	glm::vec3 m_irradiance{ 0 };
 
-	// return the irradiance (flux of radiant energy per unit area) cast by this
-	// light onto the ray intersection point, assuming there is no obstruction
-	// and the surface is oriented towards the light
-	virtual glm::vec3 irradiance(const glm::vec3 &point) const = 0;
+	// point on the light that shadow rays go to, unless it is at infinity
+	glm::vec3 m_position{ 0 };
+	bool m_infinite = false;
+
+	// solid angle density the direction was sampled with, 1 for lights
+	// from a single direction and 0 if the light can't be seen at all
+	float m_pdf = 0;
+
+	bool valid() const { return m_pdf > 0; }
+};
+
+
+class Light {
+public:
+	// sample the light arriving at point, given two uniform numbers in [0, 1)
+	// (ignored by lights from a single direction)
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const = 0;
+
+	// ray from the intersection point to the sampled point on the light
+	Ray shadowRay(const RayIntersection &intersect, const LightSample &sample) const {
+		return sample.m_infinite ? intersect.spawnRay(-sample.m_direction) : intersect.spawnRayTo(sample.m_position);
+	}
 
 	// return ambience (contribution of light bouncing around the scene)
 	// approximates indirect lighting and does not require the light to be visable
@@ -37,9 +64,7 @@ public:
 	DirectionalLight(const glm::vec3 &direction, const glm::vec3 &irradiance, const glm::vec3 &ambience)
 		: m_direction(normalize(direction)), m_irradiance(irradiance), m_ambience(ambience) { }
 
-	virtual bool occluded(Scene *scene, const glm::vec3 &point) const override;
-	virtual glm::vec3 incidentDirection(const glm::vec3 &point) const override;
-	virtual glm::vec3 irradiance(const glm::vec3 & point) const override;
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const override;
 	virtual glm::vec3 ambience() const override { return m_ambience; }
 };
 
@@ -54,8 +79,100 @@ public:
 	PointLight(const glm::vec3 &position, const glm::vec3 &flux, const glm::vec3 &ambience)
 		: m_position(position), m_flux(flux), m_ambience(ambience) { }
 
-	virtual bool occluded(Scene *scene, const glm::vec3 &point) const override;
-	virtual glm::vec3 incidentDirection(const glm::vec3 &point) const override;
-	virtual glm::vec3 irradiance(const glm::vec3 &point) const override;
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const override;
+	virtual glm::vec3 ambience() const override { return m_ambience; }
+};
+
+
+// Light emitted by the surface of a shape, with the same radiance from
+// every point in every direction (from both sides of flat shapes), which
+// gives soft shadows. The scene should also have an object of the shape
+// with a material emitting that radiance, so the light itself is seen by
+// camera and reflected rays. Samples are spread over the solid angle the
+// light covers where that can be done cheaply, so a single shadow ray
+// per sample gives little noise.
+class AreaLight : public Light {
+protected:
+	glm::vec3 m_radiance;
+	glm::vec3 m_ambience;
+
+	// sample for a position on the light picked uniformly by area, its
+	// density converted to solid angle at point
+	LightSample areaSample(const glm::vec3 &point, const glm::vec3 &position, const glm::vec3 &normal, float area) const;
+
+public:
+	AreaLight(const glm::vec3 &radiance, const glm::vec3 &ambience) : m_radiance(radiance), m_ambience(ambience) { }
+
+	glm::vec3 radiance() const { return m_radiance; }
+	virtual glm::vec3 ambience() const override { return m_ambience; }
+};
+
+
+// sampled uniformly over the cone of directions the sphere covers,
+// it can't be seen from inside
+class SphereLight : public AreaLight {
+private:
+	Sphere m_sphere;
+
+public:
+	SphereLight(const Sphere &sphere, const glm::vec3 &radiance, const glm::vec3 &ambience)
+		: AreaLight(radiance, ambience), m_sphere(sphere) { }
+
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const override;
+};
+
+
+// sampled uniformly by area
+class DiskLight : public AreaLight {
+private:
+	Disk m_disk;
+
+public:
+	DiskLight(const Disk &disk, const glm::vec3 &radiance, const glm::vec3 &ambience)
+		: AreaLight(radiance, ambience), m_disk(disk) { }
+
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const override;
+};
+
+
+// sampled uniformly over the spherical rectangle it projects to (Urena
+// et al. 2013), or by area where it covers too small a solid angle to
+// do that precisely
+class RectangleLight : public AreaLight {
+private:
+	Rectangle m_rectangle;
+
+public:
+	RectangleLight(const Rectangle &rectangle, const glm::vec3 &radiance, const glm::vec3 &ambience)
+		: AreaLight(radiance, ambience), m_rectangle(rectangle) { }
+
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const override;
+};
+
+
+// Light from infinitely far away in every direction, the radiance of an
+// equirectangular (latitude longitude) image around +y, scaled. Also what
+// rays that miss the scene see. Directions are sampled in proportion to
+// the radiance of the texel they fall in (by its solid angle), so a sun
+// a few texels across gets the shadow rays it deserves rather than being
+// found by a lucky few as fireflies.
+class EnvironmentLight : public Light {
+private:
+	std::shared_ptr<const Texture> m_image;
+	float m_scale;
+	glm::vec3 m_ambience;
+	Distribution2D m_distribution;
+
+	// radiance of the texel at uv in [0, 1]^2, u = 0.5 looking down -z
+	// and turning to +x as it grows, v = 1 straight up
+	glm::vec3 radiance(const glm::vec2 &uv) const;
+
+public:
+	EnvironmentLight(std::shared_ptr<const Texture> image, float scale, const glm::vec3 &ambience);
+
+	// radiance seen looking along direction
+	glm::vec3 radiance(const glm::vec3 &direction) const;
+
+	virtual LightSample sample(const glm::vec3 &point, const glm::vec2 &u) const override;
 	virtual glm::vec3 ambience() const override { return m_ambience; }
 };
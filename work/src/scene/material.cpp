@@ -6,8 +6,8 @@
 #include "material.hpp"
 
 
-Material::Material(const glm::vec3 &diffuse, const glm::vec3 &specular, float shininess)
-	: m_diffuse(diffuse), m_specular(specular), m_shininess(shininess) { }
+Material::Material(const glm::vec3 &diffuse, const glm::vec3 &specular, float shininess, const glm::vec3 &emission)
+	: m_diffuse(diffuse), m_specular(specular), m_shininess(shininess), m_emission(emission) { }
 
 
 Material::Material(const glm::vec3 &diffuse_chroma, float shininess, float specular_ratio, float metalicity_ratio) : m_shininess(shininess) {
@@ -17,11 +17,13 @@ private:
 	glm::vec3 m_diffuse;
 	glm::vec3 m_specular;
 	float m_shininess;
+	glm::vec3 m_emission{ 0 };
 
 public:
 	
-	// Typical constructor that takes the diffuse, specular and shininess
-	Material(const glm::vec3 &diffuse, const glm::vec3 &specular, float shininess);
+	// Typical constructor that takes the diffuse, specular and shininess,
+	// and the radiance emitted for the surfaces of area lights
+	Material(const glm::vec3 &diffuse, const glm::vec3 &specular, float shininess, const glm::vec3 &emission = glm::vec3(0));
 
 	// An alternative constructor that takes a diffuse chroma and extra paramaters
 	// to construct a material that conforms approximately to the following rules:
@@ -38,4 +40,8 @@ public:
 	
 	// return the shininess of this material
 	virtual float shininess() const { return m_shininess; }
+
+	// return the radiance emitted (from both sides) by surfaces of this material
+	virtual glm::vec3 emission() const { return m_emission; }
+	bool emissive() const { return emission() != glm::vec3(0); }
 };
\ No newline at end of file
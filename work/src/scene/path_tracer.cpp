@@ -4,43 +4,91 @@
 #include <gtc/random.hpp>
 
 // std
+#include <algorithm>
+#include <chrono>
+#include <new>
 #include <random>
+#include <stdexcept>
 
 // project
+#include "arena.hpp"
 #include "scene.hpp"
 #include "shape.hpp"
 #include "light.hpp"
 #include "material.hpp"
 #include "path_tracer.hpp"
+#include "sampling.hpp"
 
 
 
-glm::vec3 SimplePathTracer::sampleRay(const Ray &ray, int) {
+void SampleRecord::setSurface(const RayIntersection &intersect) {
+	m_albedo = intersect.m_material->diffuse();
+	m_normal = intersect.m_normal;
+	m_position = intersect.m_position;
+	m_depth = intersect.m_distance;
+	m_object = intersect.m_object;
+
+	const glm::vec3 d = intersect.m_material->diffuse();
+	const glm::vec3 s = intersect.m_material->specular();
+	const float diffuse = std::max(d.r, std::max(d.g, d.b));
+	const float specular = std::max(s.r, std::max(s.g, s.b));
+	m_specular = (specular > 0) ? specular / (diffuse + specular) : 0;
+	m_shininess = intersect.m_material->shininess();
+}
+
+
+std::unique_ptr<PathTracer> makePathTracer(const std::string &name, Scene *scene) {
+	if (name == "simple") return std::make_unique<SimplePathTracer>(scene);
+	if (name == "core") return std::make_unique<CorePathTracer>(scene);
+	if (name == "completion") return std::make_unique<CompletionPathTracer>(scene);
+	if (name == "challenge") return std::make_unique<ChallengePathTracer>(scene);
+	throw std::invalid_argument("Unknown path tracer " + name);
+}
+
+
+void PathTracer::sampleRays(const Ray *rays, int count, int depth, glm::vec3 *colors, SampleRecord *records, bool) {
+	for (int i = 0; i < count; i++) colors[i] = sampleRay(rays[i], depth, records ? &records[i] : nullptr);
+	RayStats stats;
+	stats.m_camera = count;
+	OccluderCache::thread().flush(stats);
+	RayStats::add(stats);
+}
+
+
+
+glm::vec3 SimplePathTracer::sampleRay(const Ray &ray, int, SampleRecord *record) {
 	// intersect ray with the scene
 	RayIntersection intersect = m_scene->intersect(ray);
 
 	// if ray hit something
 	if (intersect.m_valid) {
+		if (record) record->setSurface(intersect);
+
 		// simple grey shape shading
 		float f = glm::abs(glm::dot(-ray.direction, intersect.m_normal));
 		glm::vec3 grey(0.5, 0.5, 0.5);
-		return glm::mix(grey / 2.0f, grey, f);
+		glm::vec3 color = glm::mix(grey / 2.0f, grey, f);
+		if (record) record->m_direct = color;
+		return color;
 	}
 
 	// no intersection - return background color
-	return { 0.3f, 0.3f, 0.4f };
+	return m_scene->background(ray);
 }
 
 
 
-glm::vec3 CorePathTracer::sampleRay(const Ray &ray, int) {
+glm::vec3 CorePathTracer::sampleRay(const Ray &ray, int, SampleRecord *record) {
 	// intersect ray with the scene
 	RayIntersection intersect = m_scene->intersect(ray);
 
 	// if ray hit something
 	if (intersect.m_valid) {
+		if (record) record->setSurface(intersect);
+
 		glm::vec3 reflectionConstant = intersect.m_material->diffuse();
 		float roughnessConstant = intersect.m_material->shininess();
+		OccluderCache &cache = OccluderCache::thread();
 
 		glm::vec3 controlGI(0); // Ambient light Global Illumination
 		glm::vec3 summedLambertian(0);
@@ -50,14 +98,18 @@ glm::vec3 CorePathTracer::sampleRay(const Ray &ray, int) {
 		for (int i = 0; i < m_scene->lights().size(); i++) {
 			// Setup variables
 			Light &light = *m_scene->lights().at(i);
-			glm::vec3 dirToLight = -(light.incidentDirection(intersect.m_position));
+			LightSample sample = light.sample(intersect.m_position, hashSample(intersect.m_position, ray.direction, i));
+			if (!sample.valid()) {
+				controlGI += light.ambience();
+				continue;
+			}
+			glm::vec3 dirToLight = -sample.m_direction;
 			glm::vec3 dirToLightNormal = glm::normalize(dirToLight);
-			glm::vec3 point = intersect.m_position;
-			glm::vec3 lightIntensity = light.irradiance(point);
+			glm::vec3 lightIntensity = sample.m_irradiance;
 
-			float normalToLight = glm::dot(intersect.m_normal, -(light.incidentDirection(intersect.m_position)));
+			float normalToLight = glm::dot(intersect.m_normal, -sample.m_direction);
 			if (glm::isnan(normalToLight)) continue;
-			if (light.occluded(m_scene, intersect.m_position + (intersect.m_normal * 0.001f)) && normalToLight >= 0) {
+			if (m_scene->occluded(light.shadowRay(intersect, sample), cache, i) && normalToLight >= 0) {
 				controlGI += light.ambience();
 				continue;
 			}
@@ -71,6 +123,7 @@ glm::vec3 CorePathTracer::sampleRay(const Ray &ray, int) {
 			if (glm::isnan(intense)) continue;
 			glm::vec3 lamb_intensity = lightIntensity * lamb_surfaceDiffusion * glm::max(0.0f, intense);
 			summedLambertian += lamb_intensity;
+			if (record) record->addDirect(i, lamb_intensity);
 
 			// Phong Specular Reflection
 			glm::vec3 nHat = intersect.m_normal * (glm::dot(dirToLightNormal, intersect.m_normal));
@@ -80,17 +133,27 @@ glm::vec3 CorePathTracer::sampleRay(const Ray &ray, int) {
 			glm::vec3 ks = intersect.m_material->specular();
 			float val = glm::dot(perfectReflection, vecToCamera);
 			if (glm::isnan(val)) continue;
-			summedPhong += lightIntensity * ks * (glm::pow(glm::max(0.0f, val), roughnessConstant));
+			glm::vec3 phong_intensity = lightIntensity * ks * (glm::pow(glm::max(0.0f, val), roughnessConstant));
+			summedPhong += phong_intensity;
+			if (record) record->addDirect(i, phong_intensity);
+		}
+		if (record) record->addIndirect(controlGI * reflectionConstant);
+		glm::vec3 color = controlGI * reflectionConstant + summedLambertian + summedPhong;
+
+		// the surface of an area light
+		if (intersect.m_material->emissive()) {
+			color += intersect.m_material->emission();
+			if (record) record->m_direct += intersect.m_material->emission();
 		}
-		return controlGI * reflectionConstant + summedLambertian + summedPhong;
+		return color;
 	}
 	// no intersection - return background color
-	return { 0.3f, 0.3f, 0.4f };
+	return m_scene->background(ray);
 }
 
 
 
-glm::vec3 CompletionPathTracer::sampleRay(const Ray &ray, int depth) {
+glm::vec3 CompletionPathTracer::sampleRay(const Ray &ray, int depth, SampleRecord *record) {
 	//-------------------------------------------------------------
 	// [Assignment 4] :
 	// Using the same requirements for the CorePathTracer add in 
@@ -101,74 +164,168 @@ glm::vec3 CompletionPathTracer::sampleRay(const Ray &ray, int depth) {
 	// the incoming light by the (1 - (1/shininess)).
 	//-------------------------------------------------------------
 
-	if (depth == 0) return { 0.3f, 0.3f, 0.4f };
+	if (depth == 0) return m_scene->background(ray);
 
 	RayIntersection intersect = m_scene->intersect(ray);
 
 	// if ray hit something
 	if (intersect.m_valid) {
-		glm::vec3 reflectionConstant = intersect.m_material->diffuse();
-		float roughnessConstant = intersect.m_material->shininess();
+		Shading shading = shade(ray, intersect, record);
+		glm::vec3 mirrorColor(0);
+		if (shading.m_reflects) mirrorColor = sampleRay(shading.m_reflect_ray, depth - 1);
+		return finish(shading, mirrorColor, record);
+	}
+	// no intersection - return background color
+	return m_scene->background(ray);
+}
 
-		glm::vec3 controlGI(0); // Ambient light Global Illumination
-		glm::vec3 summedLambertian(0);
-		glm::vec3 summedPhong(0);
-		glm::vec3 summedShadows(0);
 
-		for (int i = 0; i < m_scene->lights().size(); i++) {
-			// Setup variables
-			Light &light = *m_scene->lights().at(i);
-			glm::vec3 dirToLight = -(light.incidentDirection(intersect.m_position));
-			glm::vec3 dirToLightNormal = glm::normalize(dirToLight);
-			glm::vec3 point = intersect.m_position;
-			glm::vec3 lightIntensity = light.irradiance(point);
-			glm::vec3 acneBias = intersect.m_normal * 1e-4f;
+void CompletionPathTracer::sampleRays(const Ray *rays, int count, int depth, glm::vec3 *colors, SampleRecord *records, bool sort_rays) {
+	RayStats stats;
+	stats.m_camera = count;
+	traceBatch(rays, count, depth, colors, records, sort_rays, false, stats);
+	OccluderCache::thread().flush(stats);
+	RayStats::add(stats);
+}
 
-			float normalToLight = glm::dot(intersect.m_normal, dirToLightNormal);
-			if (glm::isnan(normalToLight)) continue;
-			if (light.occluded(m_scene, intersect.m_position + acneBias) && normalToLight >= 0) {
-				controlGI += light.ambience();
-				continue;
-			}
 
-			// Ambient light
-			controlGI += light.ambience();
+void CompletionPathTracer::traceBatch(const Ray *rays, int count, int depth, glm::vec3 *colors, SampleRecord *records, bool sort_rays, bool secondary, RayStats &stats) {
+	if (depth == 0) {
+		for (int i = 0; i < count; i++) colors[i] = m_scene->background(rays[i]);
+		return;
+	}
 
-			// Lambertian Diffuse Reflection
-			glm::vec3 lamb_surfaceDiffusion = intersect.m_material->diffuse();
-			float intense = glm::dot(dirToLightNormal, intersect.m_normal);
-			if (glm::isnan(intense)) continue;
-			glm::vec3 lamb_intensity = lightIntensity * lamb_surfaceDiffusion * glm::max(0.f, intense);
-			summedLambertian += lamb_intensity;
+	// find every hit first, so a batch of reflections traverses the bvh
+	// back to back (in the order it was sorted in)
+	Arena &arena = scratchArena();
+	RayHit *hits = arena.allocate<RayHit>(count);
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) new(&hits[i]) RayHit(m_scene->closestHit(rays[i]));
+	if (secondary) {
+		stats.m_secondary += count;
+		stats.m_batches++;
+		stats.m_secondary_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
 
-			// Phong Specular Reflection
-			glm::vec3 nHat = (intersect.m_normal * (glm::dot(dirToLightNormal, intersect.m_normal)));
-			glm::vec3 perfectReflection = nHat * 2.0f - dirToLightNormal;
-			glm::vec3 vecToCamera = glm::normalize(-ray.direction);
-			glm::vec3 ks = intersect.m_material->specular();
+	// shade the hits, gathering the reflections to trace as the next batch
+	Shading *shading = arena.allocate<Shading>(count);
+	Ray *reflect_rays = arena.allocate<Ray>(count);
+	int *reflecting = arena.allocate<int>(count);
+	int reflections = 0;
+	for (int i = 0; i < count; i++) {
+		SampleRecord *record = records ? &records[i] : nullptr;
+		RayIntersection intersect = m_scene->interaction(rays[i], hits[i]);
+		if (!intersect.m_valid) {
+			colors[i] = m_scene->background(rays[i]);
+			continue;
+		}
+		new(&shading[i]) Shading(shade(rays[i], intersect, record));
+		if (shading[i].m_reflects) {
+			reflect_rays[reflections] = shading[i].m_reflect_ray;
+			reflecting[reflections++] = i;
+		} else {
+			colors[i] = finish(shading[i], glm::vec3(0), record);
+		}
+	}
+	if (reflections == 0) return;
 
-			float val = glm::dot(perfectReflection, vecToCamera);
-			if (glm::isnan(val)) continue;
+	if (sort_rays && depth > 1) {
+		sortRays(reflect_rays, reflecting, reflections);
+		stats.m_sorted++;
+	}
+	glm::vec3 *mirror_colors = arena.allocate<glm::vec3>(reflections);
+	traceBatch(reflect_rays, reflections, depth - 1, mirror_colors, nullptr, sort_rays, true, stats);
+	for (int k = 0; k < reflections; k++) {
+		const int i = reflecting[k];
+		colors[i] = finish(shading[i], mirror_colors[k], records ? &records[i] : nullptr);
+	}
+}
 
-			glm::vec3 intensity(0);
-			if (depth > 0) {
-				Ray reflectRay(intersect.m_position + perfectReflection * 1e-4f, perfectReflection);
-				float m = 1 - (1 / roughnessConstant);
-				glm::vec3 mirrorColor = sampleRay(reflectRay, depth - 1);
-				// Idk how TF this works, I spent so long trying to get reflection to work, it works average so I'm giving up at this point.
-				intensity += m * mirrorColor;
-			}
-			summedPhong = intensity * ks;
+
+CompletionPathTracer::Shading CompletionPathTracer::shade(const Ray &ray, const RayIntersection &intersect, SampleRecord *record) const {
+	Shading shading;
+	if (record) record->setSurface(intersect);
+
+	glm::vec3 reflectionConstant = intersect.m_material->diffuse();
+	float roughnessConstant = intersect.m_material->shininess();
+	OccluderCache &cache = OccluderCache::thread();
+
+	glm::vec3 controlGI(0); // Ambient light Global Illumination
+	glm::vec3 summedLambertian(0);
+
+	for (int i = 0; i < m_scene->lights().size(); i++) {
+		// Setup variables
+		Light &light = *m_scene->lights().at(i);
+		LightSample sample = light.sample(intersect.m_position, hashSample(intersect.m_position, ray.direction, i));
+		if (!sample.valid()) {
+			controlGI += light.ambience();
+			continue;
+		}
+		glm::vec3 dirToLight = -sample.m_direction;
+		glm::vec3 dirToLightNormal = glm::normalize(dirToLight);
+		glm::vec3 lightIntensity = sample.m_irradiance;
+
+		float normalToLight = glm::dot(intersect.m_normal, dirToLightNormal);
+		if (glm::isnan(normalToLight)) continue;
+		if (m_scene->occluded(light.shadowRay(intersect, sample), cache, i) && normalToLight >= 0) {
+			controlGI += light.ambience();
+			continue;
 		}
-		return controlGI * reflectionConstant + summedLambertian + summedPhong;
+
+		// Ambient light
+		controlGI += light.ambience();
+
+		// Lambertian Diffuse Reflection
+		glm::vec3 lamb_surfaceDiffusion = intersect.m_material->diffuse();
+		float intense = glm::dot(dirToLightNormal, intersect.m_normal);
+		if (glm::isnan(intense)) continue;
+		glm::vec3 lamb_intensity = lightIntensity * lamb_surfaceDiffusion * glm::max(0.f, intense);
+		summedLambertian += lamb_intensity;
+		if (record) record->addDirect(i, lamb_intensity);
+
+		// Phong Specular Reflection
+		glm::vec3 nHat = (intersect.m_normal * (glm::dot(dirToLightNormal, intersect.m_normal)));
+		glm::vec3 perfectReflection = nHat * 2.0f - dirToLightNormal;
+		glm::vec3 vecToCamera = glm::normalize(-ray.direction);
+		glm::vec3 ks = intersect.m_material->specular();
+
+		float val = glm::dot(perfectReflection, vecToCamera);
+		if (glm::isnan(val)) continue;
+
+		// only the reflection of the last light to get here is used, so
+		// only that one is traced
+		shading.m_reflects = true;
+		shading.m_reflect_ray = intersect.spawnRay(perfectReflection);
+		shading.m_reflect_weight = 1 - (1 / roughnessConstant);
+		shading.m_specular = ks;
 	}
-	// no intersection - return background color
-	return { 0.3f, 0.3f, 0.4f };
+	shading.m_ambient = controlGI * reflectionConstant;
+	shading.m_color = controlGI * reflectionConstant + summedLambertian;
+
+	// the surface of an area light
+	if (intersect.m_material->emissive()) {
+		shading.m_color += intersect.m_material->emission();
+		if (record) record->m_direct += intersect.m_material->emission();
+	}
+	return shading;
+}
+
+
+glm::vec3 CompletionPathTracer::finish(const Shading &shading, const glm::vec3 &mirrorColor, SampleRecord *record) const {
+	glm::vec3 summedPhong(0);
+	if (shading.m_reflects) {
+		glm::vec3 intensity(0);
+		// Idk how TF this works, I spent so long trying to get reflection to work, it works average so I'm giving up at this point.
+		intensity += shading.m_reflect_weight * mirrorColor;
+		summedPhong = intensity * shading.m_specular;
+	}
+	if (record) record->addIndirect(shading.m_ambient + summedPhong);
+	return shading.m_color + summedPhong;
 }
 
 
 
-glm::vec3 ChallengePathTracer::sampleRay(const Ray &ray, int depth) {
+glm::vec3 ChallengePathTracer::sampleRay(const Ray &ray, int depth, SampleRecord *record) {
 	//-------------------------------------------------------------
 	// [Assignment 4] :
 	// Implement a PathTracer that calculates the diffuse and 
@@ -191,5 +348,5 @@ glm::vec3 ChallengePathTracer::sampleRay(const Ray &ray, int depth) {
 	// ...
 
 	// no intersection - return background color
-	return { 0.3f, 0.3f, 0.4f };
+	return m_scene->background(ray);
 }
\ No newline at end of file
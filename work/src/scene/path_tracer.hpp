@@ -1,14 +1,55 @@
 
 #pragma once
 
+// std
+#include <algorithm>
+#include <memory>
+#include <string>
+
 // glm
 #include <glm.hpp>
 
 // project
 #include "ray.hpp"
+#include "ray_batch.hpp"
 #include "scene.hpp"
 
 
+// Lightweight per sample record of what a camera ray saw, written by
+// sampleRay if given one and accumulated into the AOV framebuffer.
+// Surface features are of the first hit (zero if the ray escapes the
+// scene), lighting is split into direct light (in total and per light)
+// and indirect light (ambient and reflections).
+class SampleRecord {
+public:
+	// lights beyond this are only counted in the direct total
+	static constexpr int max_lights = 8;
+
+	glm::vec3 m_albedo{ 0 };
+	glm::vec3 m_normal{ 0 };
+	glm::vec3 m_position{ 0 };
+	float m_depth = 0;
+	int m_object = -1;
+	float m_specular = 0; // view dependent share of the reflectance
+	float m_shininess = 0;
+
+	glm::vec3 m_direct{ 0 };
+	glm::vec3 m_indirect{ 0 };
+	glm::vec3 m_lights[max_lights];
+
+	SampleRecord() { std::fill(m_lights, m_lights + max_lights, glm::vec3(0)); }
+
+	void setSurface(const RayIntersection &intersect);
+
+	void addDirect(int light, const glm::vec3 &c) {
+		m_direct += c;
+		if (light < max_lights) m_lights[light] += c;
+	}
+
+	void addIndirect(const glm::vec3 &c) { m_indirect += c; }
+};
+
+
 // The base class for the pathtracer (backwards ray tracing) which
 // provides a constructor that takes a scene and a method that
 // casts a ray into the scene and returns the correct color
@@ -17,15 +58,31 @@ public:
 	Scene *m_scene;
 
 	PathTracer(Scene *s) : m_scene(s) { }
-	virtual glm::vec3 sampleRay(const Ray &ray, int depth) = 0;
+	virtual ~PathTracer() { }
+	virtual glm::vec3 sampleRay(const Ray &ray, int depth, SampleRecord *record = nullptr) = 0;
+
+	// sampleRay for a batch of count camera rays, into colors (and records
+	// if given, one per ray). pathtracers that spawn rays trace them as the
+	// next batch, reordered for coherence if sort_rays is set, drawing the
+	// batches from the scratch arena. the default traces one at a time
+	virtual void sampleRays(const Ray *rays, int count, int depth, glm::vec3 *colors, SampleRecord *records = nullptr, bool sort_rays = false);
+
+	// the same pathtracer for another scene
+	virtual std::unique_ptr<PathTracer> clone(Scene *s) const = 0;
 };
 
 
+// create a pathtracer by name : simple, core, completion or challenge
+// throws std::invalid_argument for an unknown name
+std::unique_ptr<PathTracer> makePathTracer(const std::string &name, Scene *scene);
+
+
 // A pathtracer that renders a simple smooth grey representation of the scene
 class SimplePathTracer : public PathTracer {
 public : 
 	SimplePathTracer(Scene *s) : PathTracer(s) { }
-	virtual glm::vec3 sampleRay(const Ray &ray, int) override;
+	virtual std::unique_ptr<PathTracer> clone(Scene *s) const override { return std::make_unique<SimplePathTracer>(s); }
+	virtual glm::vec3 sampleRay(const Ray &ray, int, SampleRecord *record = nullptr) override;
 };
 
 
@@ -36,16 +93,34 @@ public :
 class CorePathTracer : public PathTracer {
 public:
 	CorePathTracer(Scene *s) : PathTracer(s) { }
-	virtual glm::vec3 sampleRay(const Ray &ray, int) override;
+	virtual std::unique_ptr<PathTracer> clone(Scene *s) const override { return std::make_unique<CorePathTracer>(s); }
+	virtual glm::vec3 sampleRay(const Ray &ray, int, SampleRecord *record = nullptr) override;
 };
 
 
 // Like the CorePathTracer but with the following addition :
 //  - Perfect specular reflection (for shiny objects)
 class CompletionPathTracer : public PathTracer {
+private:
+	// lighting at a hit before its reflection is traced
+	struct Shading {
+		glm::vec3 m_color{ 0 }; // ambient and direct
+		glm::vec3 m_ambient{ 0 };
+		bool m_reflects = false;
+		Ray m_reflect_ray;
+		float m_reflect_weight = 0;
+		glm::vec3 m_specular{ 0 };
+	};
+
+	Shading shade(const Ray &ray, const RayIntersection &intersect, SampleRecord *record) const;
+	glm::vec3 finish(const Shading &shading, const glm::vec3 &mirror_color, SampleRecord *record) const;
+	void traceBatch(const Ray *rays, int count, int depth, glm::vec3 *colors, SampleRecord *records, bool sort_rays, bool secondary, RayStats &stats);
+
 public:
 	CompletionPathTracer(Scene *s) : PathTracer(s) { }
-	virtual glm::vec3 sampleRay(const Ray &ray, int depth = 0) override;
+	virtual std::unique_ptr<PathTracer> clone(Scene *s) const override { return std::make_unique<CompletionPathTracer>(s); }
+	virtual glm::vec3 sampleRay(const Ray &ray, int depth = 0, SampleRecord *record = nullptr) override;
+	virtual void sampleRays(const Ray *rays, int count, int depth, glm::vec3 *colors, SampleRecord *records = nullptr, bool sort_rays = false) override;
 };
 
 
@@ -56,5 +131,6 @@ public:
 class ChallengePathTracer : public PathTracer {
 public:
 	ChallengePathTracer(Scene *s) : PathTracer(s) { }
-	virtual glm::vec3 sampleRay(const Ray &ray, int depth = 0) override;
+	virtual std::unique_ptr<PathTracer> clone(Scene *s) const override { return std::make_unique<ChallengePathTracer>(s); }
+	virtual glm::vec3 sampleRay(const Ray &ray, int depth = 0, SampleRecord *record = nullptr) override;
 };
\ No newline at end of file
@@ -0,0 +1,68 @@
+
+// project
+#include "primitive.hpp"
+
+
+int PrimitiveSet::add(Shape *shape) {
+	unsigned id;
+	if (auto *s = dynamic_cast<AABB *>(shape)) {
+		id = (aabb_type << type_shift) | unsigned(m_aabbs.size());
+		m_aabbs.push_back(*s);
+	} else if (auto *s = dynamic_cast<Sphere *>(shape)) {
+		id = (sphere_type << type_shift) | unsigned(m_spheres.size());
+		m_spheres.push_back(*s);
+	} else if (auto *s = dynamic_cast<Plane *>(shape)) {
+		id = (plane_type << type_shift) | unsigned(m_planes.size());
+		m_planes.push_back(*s);
+	} else if (auto *s = dynamic_cast<Disk *>(shape)) {
+		id = (disk_type << type_shift) | unsigned(m_disks.size());
+		m_disks.push_back(*s);
+	} else if (auto *s = dynamic_cast<Rectangle *>(shape)) {
+		id = (rectangle_type << type_shift) | unsigned(m_rectangles.size());
+		m_rectangles.push_back(*s);
+	} else if (auto *s = dynamic_cast<Triangle *>(shape)) {
+		id = (triangle_type << type_shift) | unsigned(m_triangles.size());
+		m_triangles.push_back(*s);
+	} else {
+		id = (generic_type << type_shift) | unsigned(m_generic.size());
+		m_generic.push_back(shape);
+	}
+	m_ids.push_back(id);
+	return int(m_ids.size()) - 1;
+}
+
+
+size_t PrimitiveSet::bytes() const {
+	return m_ids.size() * sizeof(unsigned) + m_aabbs.size() * sizeof(AABB) + m_spheres.size() * sizeof(Sphere)
+		+ m_planes.size() * sizeof(Plane) + m_disks.size() * sizeof(Disk)
+		+ m_rectangles.size() * sizeof(Rectangle) + m_triangles.size() * sizeof(Triangle)
+		+ m_generic.size() * sizeof(Shape *);
+}
+
+
+bool PrimitiveSet::hit(int prim, const Ray &ray, float &t) const {
+	unsigned index = m_ids[prim] & ((1u << type_shift) - 1);
+	switch (type(prim)) {
+	case aabb_type: return m_aabbs[index].hit(ray, t);
+	case sphere_type: return m_spheres[index].hit(ray, t);
+	case plane_type: return m_planes[index].hit(ray, t);
+	case disk_type: return m_disks[index].hit(ray, t);
+	case rectangle_type: return m_rectangles[index].hit(ray, t);
+	case triangle_type: return m_triangles[index].hit(ray, t);
+	default: return m_generic[index]->hit(ray, t);
+	}
+}
+
+
+void PrimitiveSet::interaction(int prim, const Ray &ray, float t, RayIntersection &intersect) const {
+	unsigned index = m_ids[prim] & ((1u << type_shift) - 1);
+	switch (type(prim)) {
+	case aabb_type: m_aabbs[index].interaction(ray, t, intersect); break;
+	case sphere_type: m_spheres[index].interaction(ray, t, intersect); break;
+	case plane_type: m_planes[index].interaction(ray, t, intersect); break;
+	case disk_type: m_disks[index].interaction(ray, t, intersect); break;
+	case rectangle_type: m_rectangles[index].interaction(ray, t, intersect); break;
+	case triangle_type: m_triangles[index].interaction(ray, t, intersect); break;
+	default: m_generic[index]->interaction(ray, t, intersect); break;
+	}
+}
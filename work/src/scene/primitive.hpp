@@ -0,0 +1,52 @@
+#pragma once
+
+// std
+#include <vector>
+
+// project
+#include "ray.hpp"
+#include "scene.hpp"
+#include "shape.hpp"
+
+
+// Closed set of primitive types kept in per-type arrays. Intersection
+// switches on the primitive type and calls that (final) shapes methods
+// directly instead of going through virtual calls. Shapes outside the set
+// are kept by pointer and use their virtual methods.
+class PrimitiveSet {
+public:
+	enum Type { aabb_type, sphere_type, plane_type, disk_type, rectangle_type, triangle_type, generic_type };
+
+private:
+	// per primitive : type << type_shift | index into the array for that type
+	static const int type_shift = 29;
+	std::vector<unsigned> m_ids;
+
+	std::vector<AABB> m_aabbs;
+	std::vector<Sphere> m_spheres;
+	std::vector<Plane> m_planes;
+	std::vector<Disk> m_disks;
+	std::vector<Rectangle> m_rectangles;
+	std::vector<Triangle> m_triangles;
+	std::vector<Shape *> m_generic;
+
+public:
+	PrimitiveSet() { }
+
+	// adds a copy of the shape (or a pointer to it if the type is
+	// not part of the set) and returns its primitive index
+	int add(Shape *shape);
+
+	int size() const { return int(m_ids.size()); }
+
+	// memory used by the arrays (not the shapes kept by pointer)
+	size_t bytes() const;
+
+	Type type(int prim) const { return Type(m_ids[prim] >> type_shift); }
+
+	// find the distance to primitive within the rays interval
+	bool hit(int prim, const Ray &ray, float &t) const;
+
+	// fill in the surface attributes at distance t from hit
+	void interaction(int prim, const Ray &ray, float t, RayIntersection &intersect) const;
+};
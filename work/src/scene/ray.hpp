@@ -1,16 +1,67 @@
-
 #pragma once
 
+// std
+#include <cmath>
+#include <limits>
+
 // glm
 #include <glm.hpp>
 
 
-// Simple ray class with origin and direction
+// Conservative bound on the relative rounding error accumulated
+// by n floating point operations (Higham's gamma_n)
+inline float errorGamma(int n) {
+	const float e = std::numeric_limits<float>::epsilon() * 0.5f;
+	return (n * e) / (1 - n * e);
+}
+
+
+// Offsets a point on a surface along its normal by the points error bound,
+// to the side that w leaves through. Rays starting there can't re-intersect
+// the surface they left regardless of the scale of the scene.
+inline glm::vec3 offsetRayOrigin(const glm::vec3 &p, const glm::vec3 &p_error, const glm::vec3 &n, const glm::vec3 &w) {
+	float d = glm::dot(glm::abs(n), p_error);
+	glm::vec3 offset = d * n;
+	if (glm::dot(w, n) < 0) offset = -offset;
+	glm::vec3 po = p + offset;
+
+	// round away from p so the addition can't land back inside the error box
+	for (int i = 0; i < 3; i++) {
+		if (offset[i] > 0) po[i] = std::nextafter(po[i], std::numeric_limits<float>::infinity());
+		else if (offset[i] < 0) po[i] = std::nextafter(po[i], -std::numeric_limits<float>::infinity());
+	}
+	return po;
+}
+
+
+// Ray class with origin, direction and the interval (tmin, tmax] along it
+// that intersections are valid in, at a time in the shutter interval
+// (0 when it opens, 1 when it closes) for motion blur. The reciprocal direction and its sign
+// per axis (octant) are computed once on creation so box tests are
+// division-free and traversal can order children front to back.
 class Ray {
 public:
 	glm::vec3 origin;
 	glm::vec3 direction;
+	float tmin = 0;
+	float tmax = std::numeric_limits<float>::infinity();
+	float time = 0;
+
+	glm::vec3 inv_direction;
+	int sign[3];
 
 	Ray() { }
-	Ray(const glm::vec3 &o, const glm::vec3 &d) : origin(o), direction(d) { }
+	Ray(const glm::vec3 &o, const glm::vec3 &d, float t0 = 0, float t1 = std::numeric_limits<float>::infinity(), float time = 0)
+		: origin(o), direction(d), tmin(t0), tmax(t1), time(time), inv_direction(1.f / d)
+	{
+		sign[0] = inv_direction.x < 0;
+		sign[1] = inv_direction.y < 0;
+		sign[2] = inv_direction.z < 0;
+	}
+
+	// position at distance t along the ray
+	glm::vec3 at(float t) const { return origin + t * direction; }
+
+	// true if t lies inside the rays interval
+	bool contains(float t) const { return t > tmin && t <= tmax; }
 };
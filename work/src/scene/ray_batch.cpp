@@ -0,0 +1,119 @@
+// std
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+// project
+#include "ray_batch.hpp"
+#include "arena.hpp"
+#include "bounds.hpp"
+
+
+namespace {
+	// a fixed set of slots so adding never allocates, threads beyond
+	// them share the last one
+	const int max_slots = 256;
+
+	struct Slot {
+		std::mutex mutex;
+		RayStats stats;
+	};
+
+	Slot slots[max_slots];
+	std::atomic<int> used_slots{ 0 };
+
+	Slot & threadSlot() {
+		static thread_local Slot &slot = slots[std::min(used_slots.fetch_add(1), max_slots - 1)];
+		return slot;
+	}
+
+	int slotCount() {
+		return std::min(used_slots.load(), max_slots);
+	}
+}
+
+
+RayStats & RayStats::operator+=(const RayStats &s) {
+	m_camera += s.m_camera;
+	m_secondary += s.m_secondary;
+	m_batches += s.m_batches;
+	m_sorted += s.m_sorted;
+	m_secondary_seconds += s.m_secondary_seconds;
+	m_occluder_lookups += s.m_occluder_lookups;
+	m_occluder_hits += s.m_occluder_hits;
+	m_occluded_traversals += s.m_occluded_traversals;
+	m_occluded_steps += s.m_occluded_steps;
+	return *this;
+}
+
+
+double RayStats::occluderStepsSaved() const {
+	if (m_occluded_traversals == 0) return 0;
+	const double steps = double(m_occluded_steps) / m_occluded_traversals;
+	return m_occluder_hits * (steps - 1) - (m_occluder_lookups - m_occluder_hits);
+}
+
+
+void RayStats::add(const RayStats &s) {
+	Slot &slot = threadSlot();
+	std::lock_guard<std::mutex> lock(slot.mutex);
+	slot.stats += s;
+}
+
+
+std::vector<RayStats> RayStats::threads() {
+	std::vector<RayStats> stats;
+	for (int i = 0; i < slotCount(); i++) {
+		std::lock_guard<std::mutex> lock(slots[i].mutex);
+		stats.push_back(slots[i].stats);
+	}
+	return stats;
+}
+
+
+RayStats RayStats::total() {
+	RayStats total;
+	for (const RayStats &s : threads()) total += s;
+	return total;
+}
+
+
+void RayStats::reset() {
+	for (int i = 0; i < slotCount(); i++) {
+		std::lock_guard<std::mutex> lock(slots[i].mutex);
+		slots[i].stats = RayStats();
+	}
+}
+
+
+OccluderCache & OccluderCache::thread() {
+	static thread_local OccluderCache cache;
+	return cache;
+}
+
+
+void sortRays(Ray *rays, int *values, int count) {
+	Bounds origins;
+	for (int i = 0; i < count; i++) origins.extend(rays[i].origin);
+
+	// octant in the top 3 bits, then the 30 bit morton code, then the
+	// position in the batch in the low 31 bits (keeping the order stable)
+	Arena &arena = scratchArena();
+	uint64_t *keys = arena.allocate<uint64_t>(count);
+	for (int i = 0; i < count; i++) {
+		const unsigned octant = unsigned(rays[i].sign[0] << 2 | rays[i].sign[1] << 1 | rays[i].sign[2]);
+		keys[i] = uint64_t(octant) << 61 | uint64_t(origins.mortonCode(rays[i].origin)) << 31 | unsigned(i);
+	}
+	std::sort(keys, keys + count);
+
+	Ray *sorted_rays = arena.allocate<Ray>(count);
+	int *sorted_values = arena.allocate<int>(count);
+	for (int i = 0; i < count; i++) {
+		const int from = int(keys[i] & 0x7fffffffu);
+		sorted_rays[i] = rays[from];
+		sorted_values[i] = values[from];
+	}
+	std::copy(sorted_rays, sorted_rays + count, rays);
+	std::copy(sorted_values, sorted_values + count, values);
+}
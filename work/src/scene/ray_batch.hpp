@@ -0,0 +1,94 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <vector>
+
+// project
+#include "ray.hpp"
+
+
+// Counts of the rays a thread has traced. Each thread adds to a slot of
+// its own (once per batch of rays, so the lock is never contended) and
+// the slots are read for the totals, or per thread to see the balance.
+class RayStats {
+public:
+	long m_camera = 0; // rays from the camera
+	long m_secondary = 0; // rays spawned at hits, traced in batches
+	long m_batches = 0; // of secondary rays
+	long m_sorted = 0; // batches reordered before they were traced
+	double m_secondary_seconds = 0; // finding the closest hits of secondary rays
+
+	// shadow rays through an OccluderCache
+	long m_occluder_lookups = 0; // with a cached occluder to test first
+	long m_occluder_hits = 0; // blocked by it, skipping the traversal
+	long m_occluded_traversals = 0; // full traversals that found an occluder
+	long m_occluded_steps = 0; // nodes visited and primitives tested by them
+
+	RayStats & operator+=(const RayStats &s);
+
+	// hits per lookup, and the traversal steps hits saved net of the
+	// primitives tested for misses (taking the steps a hit saved as the
+	// mean of the full traversals that found an occluder, less the one test)
+	double occluderHitRate() const { return m_occluder_lookups ? double(m_occluder_hits) / m_occluder_lookups : 0; }
+	double occluderStepsSaved() const;
+
+	// add s to the slot of the calling thread
+	static void add(const RayStats &s);
+
+	// per thread that has traced since the last reset, and their sum
+	static std::vector<RayStats> threads();
+	static RayStats total();
+
+	// only between renders, counts added meanwhile may be lost
+	static void reset();
+};
+
+
+// Reorder a batch of rays so that rays likely to visit the same nodes
+// are traced one after another: by the octant of their direction (which
+// sets the order children are visited in), then along a morton curve
+// through the bounds of their origins. values are moved along with the
+// rays. The keys are drawn from the scratch arena.
+void sortRays(Ray *rays, int *values, int count);
+
+
+// The primitive that last blocked a shadow ray towards each light, for the
+// calling thread. A thread traces neighbouring pixels one after another,
+// whose shadow rays are often blocked by the same object (a wall between
+// a region and a light), so Scene::occluded tests that primitive before
+// traversing for one. It only ever saves work, what is occluded is the
+// same either way. Counts go to RayStats when flushed, once per batch.
+class OccluderCache {
+public:
+	static const int max_lights = 16; // lights beyond are not cached
+
+private:
+	unsigned long m_generation = 0; // of the scene the occluders are in
+	int m_occluder[max_lights];
+
+public:
+	RayStats m_stats; // occluder counts only
+
+	OccluderCache() { std::fill(m_occluder, m_occluder + max_lights, -1); }
+
+	// the cached occluder of light in a scene of the given generation (-1
+	// for none, or no slot for lights beyond max_lights), cleared when the
+	// thread moves to another scene or the scene is rebuilt
+	int * occluder(unsigned long generation, int light) {
+		if (generation != m_generation) {
+			std::fill(m_occluder, m_occluder + max_lights, -1);
+			m_generation = generation;
+		}
+		return (light >= 0 && light < max_lights) ? &m_occluder[light] : nullptr;
+	}
+
+	// move the counts into stats
+	void flush(RayStats &stats) {
+		stats += m_stats;
+		m_stats = RayStats();
+	}
+
+	// the cache of the calling thread
+	static OccluderCache & thread();
+};
@@ -0,0 +1,59 @@
+// std
+#include <algorithm>
+
+// project
+#include "sampling.hpp"
+
+
+AliasTable::AliasTable(const std::vector<float> &weights) : m_bins(weights.size()), m_pmf(weights.size()) {
+	const int n = int(weights.size());
+	double total = 0;
+	for (float w : weights) total += std::max(w, 0.f);
+	m_total = float(total);
+	for (int i = 0; i < n; i++) m_pmf[i] = (total > 0) ? float(std::max(weights[i], 0.f) / total) : 1.f / n;
+
+	// split the outcomes by whether their share scaled by n is under or
+	// over 1, and fill up the bins of small ones from the large ones
+	std::vector<double> scaled(n);
+	std::vector<int> small, large;
+	for (int i = 0; i < n; i++) {
+		scaled[i] = double(m_pmf[i]) * n;
+		(scaled[i] < 1 ? small : large).push_back(i);
+	}
+	while (!small.empty() && !large.empty()) {
+		const int s = small.back(), l = large.back();
+		small.pop_back();
+		m_bins[s].probability = float(scaled[s]);
+		m_bins[s].alias = l;
+		scaled[l] -= 1 - scaled[s];
+		if (scaled[l] < 1) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	// whatever is left is 1 up to rounding
+	for (int i : small) m_bins[i] = { 1, i };
+	for (int i : large) m_bins[i] = { 1, i };
+}
+
+
+Distribution2D::Distribution2D(const std::vector<float> &weights, int width, int height) : m_width(width), m_height(height) {
+	std::vector<float> row_weights(height);
+	m_rows.reserve(height);
+	for (int y = 0; y < height; y++) {
+		m_rows.emplace_back(std::vector<float>(weights.begin() + y * width, weights.begin() + (y + 1) * width));
+		row_weights[y] = m_rows.back().total();
+	}
+	m_marginal = AliasTable(row_weights);
+}
+
+
+glm::vec2 Distribution2D::sample(const glm::vec2 &u, float &pdf) const {
+	glm::vec2 offset;
+	const int y = m_marginal.sample(u.y, offset.y);
+	const int x = m_rows[y].sample(u.x, offset.x);
+	pdf = m_marginal.pmf(y) * m_rows[y].pmf(x) * m_width * m_height;
+	return glm::vec2((x + offset.x) / m_width, (y + offset.y) / m_height);
+}
+
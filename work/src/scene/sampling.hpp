@@ -0,0 +1,135 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// glm
+#include <glm.hpp>
+#include <gtc/constants.hpp>
+
+
+// integer hash with good avalanche (lowbias32)
+inline uint32_t hashBits(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+// uniform in [0, 1)
+inline float toUnit(uint32_t x) { return (x >> 8) * (1.f / 16777216.f); }
+
+
+// two uniform numbers in [0, 1) hashed from the bits of a point and a
+// direction (where a ray hit and where it came from) and a key, so every
+// sample of a pixel, which hits somewhere slightly different, gets its own
+inline glm::vec2 hashSample(const glm::vec3 &p, const glm::vec3 &d, uint32_t key) {
+	uint32_t bits[6];
+	std::memcpy(bits, &p[0], 3 * sizeof(float));
+	std::memcpy(bits + 3, &d[0], 3 * sizeof(float));
+	uint32_t h = hashBits(key);
+	for (uint32_t b : bits) h = hashBits(h ^ b);
+	return glm::vec2(toUnit(h), toUnit(hashBits(h ^ 0x9e3779b9)));
+}
+
+
+// unit vectors t and b completing an orthonormal basis with the unit
+// vector n (Duff et al. 2017)
+inline void orthonormalBasis(const glm::vec3 &n, glm::vec3 &t, glm::vec3 &b) {
+	const float sign = std::copysign(1.f, n.z);
+	const float a = -1 / (sign + n.z);
+	const float c = n.x * n.y * a;
+	t = glm::vec3(1 + sign * n.x * n.x * a, sign * c, -sign * n.x);
+	b = glm::vec3(c, sign + n.y * n.y * a, -n.y);
+}
+
+
+// point on the unit disk, uniform by area (concentric mapping, which
+// keeps strata of u together)
+inline glm::vec2 concentricDisk(const glm::vec2 &u) {
+	const glm::vec2 o = 2.f * u - 1.f;
+	if (o.x == 0 && o.y == 0) return glm::vec2(0);
+	const float quarter = glm::pi<float>() / 4;
+	if (std::abs(o.x) > std::abs(o.y)) return o.x * glm::vec2(std::cos(quarter * o.y / o.x), std::sin(quarter * o.y / o.x));
+	return o.y * glm::vec2(std::cos(2 * quarter - quarter * o.x / o.y), std::sin(2 * quarter - quarter * o.x / o.y));
+}
+
+
+// direction within the cone around +z whose cosine to it is 1 - one_minus_cos
+// at the rim, uniform by solid angle (one_minus_cos given as such to keep
+// the precision of narrow cones)
+inline glm::vec3 uniformCone(const glm::vec2 &u, float one_minus_cos) {
+	const float cos_theta = 1 - u.x * one_minus_cos;
+	const float sin_theta = std::sqrt(std::max(0.f, 1 - cos_theta * cos_theta));
+	const float phi = 2 * glm::pi<float>() * u.y;
+	return glm::vec3(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta);
+}
+
+
+// Discrete distribution over outcomes in proportion to their weights,
+// sampled in constant time by the alias method (Walker), with the table
+// built by Vose's algorithm. Each bin holds an outcome and another it
+// gives the rest of its share to, so sampling is a pick of a bin and a
+// single comparison. If every weight is zero outcomes are equally likely.
+class AliasTable {
+private:
+	struct Bin {
+		float probability = 1; // of keeping the outcome of the bin over its alias
+		int alias = 0;
+	};
+	std::vector<Bin> m_bins;
+	std::vector<float> m_pmf;
+	float m_total = 0;
+
+public:
+	AliasTable() { }
+	explicit AliasTable(const std::vector<float> &weights);
+
+	int size() const { return int(m_bins.size()); }
+
+	// sum of the weights
+	float total() const { return m_total; }
+
+	// probability of outcome i
+	float pmf(int i) const { return m_pmf[i]; }
+
+	// outcome for u in [0, 1), remapped to what is left of u, also uniform
+	// in [0, 1) (to place the sample within the outcome)
+	int sample(float u, float &remapped) const {
+		const float scaled = u * m_bins.size();
+		const int i = std::min(int(scaled), int(m_bins.size()) - 1);
+		const float f = std::min(scaled - i, 0.99999994f);
+		const Bin &bin = m_bins[i];
+		if (f < bin.probability) {
+			remapped = std::min(f / bin.probability, 0.99999994f);
+			return i;
+		}
+		remapped = std::min((f - bin.probability) / (1 - bin.probability), 0.99999994f);
+		return bin.alias;
+	}
+};
+
+
+// Piecewise constant distribution over [0, 1)^2 from a grid of width *
+// height weights (row major, row 0 at y = 0), sampled as a row by its
+// share of the total and then a cell along the row, both by alias tables
+class Distribution2D {
+private:
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<AliasTable> m_rows;
+	AliasTable m_marginal;
+
+public:
+	Distribution2D() { }
+	Distribution2D(const std::vector<float> &weights, int width, int height);
+
+	// point distributed by the weights, and its density over the unit square
+	glm::vec2 sample(const glm::vec2 &u, float &pdf) const;
+};
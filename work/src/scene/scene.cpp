@@ -1,27 +1,298 @@
 
 // std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <limits>
+#include <stdexcept>
+#include <vector>
 
 // glm
+#include <gtc/constants.hpp>
 #include <gtc/matrix_transform.hpp>
 
 // project
 #include "scene.hpp"
+#include "arena.hpp"
 #include "scene_object.hpp"
 #include "light.hpp"
+#include "primitive.hpp"
+#include "ray_batch.hpp"
+
+
+namespace {
+	// source of Scene::m_generation, 0 is never used
+	std::atomic<unsigned long> next_generation{ 1 };
+
+	// equirectangular sky as EnvironmentLight maps it (rows from straight
+	// down), a gradient from the horizon to the zenith over dark ground with
+	// a small sun thousands of times brighter than the rest
+	std::shared_ptr<Texture> skyTexture(const glm::vec3 &sun_direction) {
+		const glm::ivec2 size(512, 256);
+		const glm::vec3 sun = glm::normalize(sun_direction);
+		const float sun_cos = std::cos(glm::radians(1.5f));
+		std::vector<float> data(size_t(size.x) * size.y * 3);
+		for (int y = 0; y < size.y; y++) {
+			const float theta = glm::pi<float>() * (1 - (y + 0.5f) / size.y);
+			for (int x = 0; x < size.x; x++) {
+				const float phi = 2 * glm::pi<float>() * ((x + 0.5f) / size.x - 0.5f);
+				const glm::vec3 d(std::sin(theta) * std::sin(phi), std::cos(theta), -std::sin(theta) * std::cos(phi));
+				glm::vec3 c = (d.y > 0) ? glm::mix(glm::vec3(0.6f, 0.7f, 0.8f), glm::vec3(0.15f, 0.3f, 0.7f), std::sqrt(d.y)) : glm::vec3(0.15f, 0.13f, 0.1f);
+				if (glm::dot(d, sun) > sun_cos) c = glm::vec3(500, 470, 420);
+				std::copy(&c[0], &c[0] + 3, &data[(y * size.x + x) * 3]);
+			}
+		}
+		return std::make_shared<Texture>(size, std::move(data));
+	}
+}
+
+
+Scene::Scene(std::vector<std::shared_ptr<SceneObject>> objects, std::vector<std::shared_ptr<Light>> lights)
+	: m_objects(objects), m_lights(lights), m_motion(objects.size()), m_transforms(objects.size())
+{
+	auto primitives = std::make_shared<PrimitiveSet>();
+	for (std::shared_ptr<SceneObject> &object : m_objects) primitives->add(object->shape());
+	m_primitives = primitives;
+	for (std::shared_ptr<Light> &light : m_lights) {
+		if (auto *environment = dynamic_cast<const EnvironmentLight *>(light.get())) m_environment = environment;
+	}
+	build();
+}
+
+
+void Scene::build() {
+	std::vector<Bounds> bounds;
+	m_dynamic.clear();
+	for (int i = 0; i < int(m_objects.size()); i++) {
+		if (m_motion[i].empty()) {
+			bounds.push_back(m_objects[i]->bounds());
+		} else {
+			bounds.push_back(Bounds());
+			m_dynamic.push_back(i);
+		}
+	}
+	const auto start = std::chrono::steady_clock::now();
+	BVH bvh;
+	if (m_bvh_options.quality == bvh_sah && m_bvh_options.split_budget > 0) {
+		auto clip = [&](int prim, const Bounds &box) { return m_objects[prim]->shape()->clippedBounds(box); };
+		bvh.build(bounds, clip, m_bvh_options.split_budget);
+	} else {
+		bvh.build(bounds, m_bvh_options.quality);
+	}
+	m_bvh.build(bvh, m_bvh_options.format);
+	m_build_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	m_generation = next_generation++;
+	updateDynamic(true);
+}
+
+
+void Scene::updateDynamic(bool rebuild) {
+	if (m_dynamic.empty()) {
+		m_dynamic_bvh = BVH();
+		return;
+	}
+
+	// static objects are left out with empty bounds
+	std::vector<Bounds> open(m_objects.size()), close(m_objects.size());
+	for (int i : m_dynamic) {
+		const Bounds rest = m_objects[i]->bounds();
+		const glm::vec3 pivot = rest.finite() ? rest.centroid() : glm::vec3(0);
+		m_transforms[i] = MotionTransform(m_motion[i].at(m_shutter_open), m_motion[i].at(m_shutter_close), pivot);
+		m_transforms[i].bounds(rest, open[i], close[i]);
+	}
+
+	if (!rebuild) {
+		m_dynamic_bvh.refit(open, close);
+		rebuild = m_dynamic_bvh.cost() > 2 * m_dynamic_cost;
+	}
+	if (rebuild) {
+		m_dynamic_bvh.build(open, close);
+		m_dynamic_cost = m_dynamic_bvh.cost();
+	}
+}
+
+
+void Scene::setMotion(int object, const Track<Pose> &motion) {
+	m_motion.at(object) = motion;
+	m_transforms[object] = MotionTransform();
+	build();
+}
+
+
+void Scene::setShutter(float open, float close) {
+	m_shutter_open = open;
+	m_shutter_close = close;
+	updateDynamic(false);
+}
+
+
+void Scene::setBVHOptions(const BVHOptions &options) {
+	const float split_budget = std::max(options.split_budget, 0.f);
+	if (options.format == m_bvh_options.format && options.quality == m_bvh_options.quality && split_budget == m_bvh_options.split_budget) return;
+	m_bvh_options = options;
+	m_bvh_options.split_budget = split_budget;
+	build();
+}
+
+
+void Scene::setEnvironment(std::shared_ptr<EnvironmentLight> environment) {
+	m_lights.erase(std::remove_if(m_lights.begin(), m_lights.end(), [&](const std::shared_ptr<Light> &light) {
+		return light.get() == m_environment;
+	}), m_lights.end());
+	if (environment) m_lights.push_back(environment);
+	m_environment = environment.get();
+	m_generation = next_generation++;
+}
+
+
+glm::vec3 Scene::background(const Ray &ray) const {
+	if (m_environment) return m_environment->radiance(ray.direction);
+	return { 0.3f, 0.3f, 0.4f };
+}
+
+
+Scene Scene::replicate() const {
+	Scene replica = *this;
+	if (m_primitives) replica.m_primitives = std::make_shared<PrimitiveSet>(*m_primitives);
+	return replica;
+}
+
+
+size_t Scene::bytes() const {
+	return m_bvh.bytes() + m_dynamic_bvh.bytes() + (m_primitives ? m_primitives->bytes() : 0);
+}
+
+
+RayHit Scene::closestHit(const Ray &ray) const {
+	RayHit hit;
+	if (!m_primitives) return hit;
+
+	// shrink the interval as closer hits are found so
+	// the traversal skips anything further away
+	Ray r = ray;
+	m_bvh.traverse(r, [&](int i) {
+		float t;
+		if (m_primitives->hit(i, r, t)) {
+			r.tmax = t;
+			hit.m_distance = t;
+			hit.m_primitive = i;
+		}
+		return false;
+	});
+
+	// distances are the same along the ray in object space
+	if (!m_dynamic.empty()) {
+		m_dynamic_bvh.traverse(r, [&](int i) {
+			float t;
+			if (m_primitives->hit(i, m_transforms[i].at(r.time).inverse(r), t)) {
+				r.tmax = t;
+				hit.m_distance = t;
+				hit.m_primitive = i;
+			}
+			return false;
+		});
+	}
+	return hit;
+}
 
 
-RayIntersection Scene::intersect(const Ray &ray) {
-	RayIntersection closest_intersect;
-	
-	// go through the vector of objects and return the closest intersection
-	for (std::shared_ptr<SceneObject> &object : m_objects) {
-		RayIntersection intersect = object->intersect(ray);
-		if (intersect.m_valid && intersect.m_distance < closest_intersect.m_distance) {
-			closest_intersect = intersect;
+RayIntersection Scene::interaction(const Ray &ray, const RayHit &hit) const {
+	RayIntersection intersect;
+	if (hit.valid()) {
+		if (m_motion[hit.m_primitive].empty()) {
+			m_primitives->interaction(hit.m_primitive, ray, hit.m_distance, intersect);
+		} else {
+			// in object space, then back out to the world
+			const RigidTransform transform = m_transforms[hit.m_primitive].at(ray.time);
+			m_primitives->interaction(hit.m_primitive, transform.inverse(ray), hit.m_distance, intersect);
+			intersect.m_error = transform.error(intersect.m_position, intersect.m_error);
+			intersect.m_position = transform.point(intersect.m_position);
+			intersect.m_normal = transform.vector(intersect.m_normal);
 		}
+		intersect.m_shape = m_objects[hit.m_primitive]->shape();
+		intersect.m_material = m_objects[hit.m_primitive]->material();
+		intersect.m_object = hit.m_primitive;
+		intersect.m_time = ray.time;
+	}
+	return intersect;
+}
+
+
+bool Scene::occluded(const Ray &ray) const {
+	if (!m_primitives) return false;
+
+	bool occluded = false;
+	m_bvh.traverse(ray, [&](int i) {
+		float t;
+		occluded = m_primitives->hit(i, ray, t);
+		return occluded;
+	});
+	if (!occluded && !m_dynamic.empty()) {
+		m_dynamic_bvh.traverse(ray, [&](int i) {
+			float t;
+			occluded = m_primitives->hit(i, m_transforms[i].at(ray.time).inverse(ray), t);
+			return occluded;
+		});
 	}
-	return closest_intersect;
+	return occluded;
+}
+
+
+
+bool Scene::occluded(const Ray &ray, OccluderCache &cache, int light) const {
+	if (!m_primitives) return false;
+	int *occluder = cache.occluder(m_generation, light);
+	if (!occluder) return occluded(ray);
+
+	// the last occluder, a single test instead of a traversal when it
+	// still blocks the ray
+	if (*occluder >= 0 && *occluder < m_primitives->size()) {
+		cache.m_stats.m_occluder_lookups++;
+		if (hitPrimitive(*occluder, ray)) {
+			cache.m_stats.m_occluder_hits++;
+			return true;
+		}
+	}
+
+	int steps = 0;
+	*occluder = -1;
+	m_bvh.traverse(ray, [&](int i) {
+		float t;
+		steps++;
+		if (m_primitives->hit(i, ray, t)) *occluder = i;
+		return *occluder >= 0;
+	}, steps);
+	if (*occluder < 0 && !m_dynamic.empty()) {
+		m_dynamic_bvh.traverse(ray, [&](int i) {
+			steps++;
+			if (hitPrimitive(i, ray)) *occluder = i;
+			return *occluder >= 0;
+		});
+	}
+	if (*occluder < 0) return false;
+	cache.m_stats.m_occluded_traversals++;
+	cache.m_stats.m_occluded_steps += steps;
+	return true;
+}
+
+
+bool Scene::hitPrimitive(int prim, const Ray &ray) const {
+	float t;
+	if (m_motion[prim].empty()) return m_primitives->hit(prim, ray, t);
+	return m_primitives->hit(prim, m_transforms[prim].at(ray.time).inverse(ray), t);
+}
+
+
+Scene Scene::fromName(const std::string &name) {
+	if (name == "simple") return simpleScene();
+	if (name == "light") return lightScene();
+	if (name == "material") return materialScene();
+	if (name == "shape") return shapeScene();
+	if (name == "cornell") return cornellBoxScene();
+	if (name == "area") return areaLightScene();
+	if (name == "sky") return skyScene();
+	throw std::invalid_argument("Unknown scene " + name);
 }
 
 
@@ -29,22 +300,23 @@ RayIntersection Scene::intersect(const Ray &ray) {
 Scene Scene::simpleScene() {
 	std::vector<std::shared_ptr<SceneObject>> objects;
 	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
 
 	// declare materials
-	std::shared_ptr<Material> shiny_red = std::make_shared<Material>(glm::vec3(1, 0, 0), 10, 0.5f, 0);
-	std::shared_ptr<Material> green = std::make_shared<Material>(glm::vec3(0, 0.8f, 0), 1.05f, 0.1f, 0);
+	std::shared_ptr<Material> shiny_red = arena->make<Material>(glm::vec3(1, 0, 0), 10, 0.5f, 0);
+	std::shared_ptr<Material> green = arena->make<Material>(glm::vec3(0, 0.8f, 0), 1.05f, 0.1f, 0);
 
 	// create a box on a sphere
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Sphere>(glm::vec3(0, -2, -10), 1), shiny_red
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(0, -2, -10), 1), shiny_red
 	));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, -3.5f, -10), glm::vec3(3, 0.5, 3)), green
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, -3.5f, -10), glm::vec3(3, 0.5, 3)), green
 	));
 
 	// one directional light
-	lights.push_back(std::make_shared<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
+	lights.push_back(arena->make<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
 
 	return Scene(objects, lights);
 }
@@ -54,31 +326,32 @@ Scene Scene::simpleScene() {
 Scene Scene::lightScene() {
 	std::vector<std::shared_ptr<SceneObject>> objects;
 	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
 
 	// declare materials
-	std::shared_ptr<Material> shiny_red = std::make_shared<Material>(glm::vec3(1, 0, 0), 10, 0.5f, 0);
-	std::shared_ptr<Material> green = std::make_shared<Material>(glm::vec3(0, 0.8f, 0), 1.05f, 0.1f, 0);
+	std::shared_ptr<Material> shiny_red = arena->make<Material>(glm::vec3(1, 0, 0), 10, 0.5f, 0);
+	std::shared_ptr<Material> green = arena->make<Material>(glm::vec3(0, 0.8f, 0), 1.05f, 0.1f, 0);
 
 	// create a box on a sphere
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Sphere>(glm::vec3(0, -2, -10), 1), shiny_red
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(0, -2, -10), 1), shiny_red
 	));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, -3.5f, -10), glm::vec3(3, 0.5f, 3)), green
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, -3.5f, -10), glm::vec3(3, 0.5f, 3)), green
 	));
 
 	// wall blocking one of the point lights
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(3.5f, 0, -10), glm::vec3(0.5f, 3, 3)), green
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(3.5f, 0, -10), glm::vec3(0.5f, 3, 3)), green
 	));
 
 	// one directional light
-	lights.push_back(std::make_shared<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
+	lights.push_back(arena->make<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
 
 	// two point lights
-	lights.push_back(std::make_shared<PointLight>(glm::vec3(-5, 0, -10), glm::vec3(50), glm::vec3(0.05f)));
-	lights.push_back(std::make_shared<PointLight>(glm::vec3(5, 0, -10), glm::vec3(50), glm::vec3(0.05f)));
+	lights.push_back(arena->make<PointLight>(glm::vec3(-5, 0, -10), glm::vec3(50), glm::vec3(0.05f)));
+	lights.push_back(arena->make<PointLight>(glm::vec3(5, 0, -10), glm::vec3(50), glm::vec3(0.05f)));
 
 	return Scene(objects, lights);
 }
@@ -88,9 +361,10 @@ Scene Scene::lightScene() {
 Scene Scene::materialScene() {
 	std::vector<std::shared_ptr<SceneObject>> objects;
 	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
 
 	// declare materials
-	std::shared_ptr<Material> green = std::make_shared<Material>(glm::vec3(0, 0.8f, 0), 1.05f, 0.1f, 0);
+	std::shared_ptr<Material> green = arena->make<Material>(glm::vec3(0, 0.8f, 0), 1.05f, 0.1f, 0);
 
 	// create a grid of materials with varying shininess and specular ratios
 	for (int shin = 0; shin <= 10; shin++) {
@@ -98,19 +372,19 @@ Scene Scene::materialScene() {
 			float shininess = 1 * exp(float(shin));
 			float specular_ratio = spec / 10.f;
 
-			std::shared_ptr<Material> m = std::make_shared<Material>(glm::vec3(1, 0, 0), shininess, specular_ratio, 0);
+			std::shared_ptr<Material> m = arena->make<Material>(glm::vec3(1, 0, 0), shininess, specular_ratio, 0);
 
-			objects.push_back(std::make_shared<SceneObject>(
-				std::make_shared<Sphere>(glm::vec3(5.5f - shin, -2, -5.5f - spec), 0.4), m
+			objects.push_back(arena->make<SceneObject>(
+				arena->make<Sphere>(glm::vec3(5.5f - shin, -2, -5.5f - spec), 0.4), m
 			));
 		}
 	}
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, -3, -10), glm::vec3(6, 0.5f, 6)), green
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, -3, -10), glm::vec3(6, 0.5f, 6)), green
 	));
 
-	lights.push_back(std::make_shared<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
+	lights.push_back(arena->make<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
 
 	return Scene(objects, lights);
 }
@@ -120,6 +394,7 @@ Scene Scene::materialScene() {
 Scene Scene::shapeScene() {
 	std::vector<std::shared_ptr<SceneObject>> objects;
 	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
 
 	//-------------------------------------------------------------
 	// [Assignment 4] :
@@ -133,33 +408,33 @@ Scene Scene::shapeScene() {
 	//  - Triangle
 	//-------------------------------------------------------------
 
-	std::shared_ptr<Material> white = std::make_shared<Material>(glm::vec3(1), 1.05f, 0.1, 0);
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(-3, 0, -5), glm::vec3(0.5)), white
+	std::shared_ptr<Material> white = arena->make<Material>(glm::vec3(1), 1.05f, 0.1, 0);
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(-3, 0, -5), glm::vec3(0.5)), white
 	));
 
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Sphere>(glm::vec3(-1, 0, -5), 0.5), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(-1, 0, -5), 0.5), white
 	));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Plane>(glm::vec3(-2, -4, -2), glm::vec3(0, 1, 0)), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Plane>(glm::vec3(-2, -4, -2), glm::vec3(0, 1, 0)), white
 		));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Disk>(glm::vec3(1, 0, -5), glm::vec3(0, 0, 1), 1), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Disk>(glm::vec3(1, 0, -5), glm::vec3(0, 0, 1), 1), white
 		));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Triangle>(glm::vec3(2, -1, -5), glm::vec3(2.5f, -0.5f, -5), glm::vec3(3, -1, -5)), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Triangle>(glm::vec3(2, -1, -5), glm::vec3(2.5f, -0.5f, -5), glm::vec3(3, -1, -5)), white
 		));
 
 	// YOUR CODE GOES HERE
 	// ...
 
 
-	lights.push_back(std::make_shared<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
+	lights.push_back(arena->make<DirectionalLight>(glm::vec3(-1, -1, -1), glm::vec3(0.5f), glm::vec3(0.05f)));
 
 	return Scene(objects, lights);
 }
@@ -170,71 +445,178 @@ Scene Scene::cornellBoxScene() {
 
 	std::vector<std::shared_ptr<SceneObject>> objects;
 	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
 
-	auto white = std::make_shared<Material>(glm::vec3(1), 1.05f, 0.1f, 0);
-	auto green = std::make_shared<Material>(glm::vec3(0, 1, 0), 1.05f, 0.1f, 0);
-	auto red = std::make_shared<Material>(glm::vec3(1, 0, 0), 1.05f, 0.1f, 0);
+	auto white = arena->make<Material>(glm::vec3(1), 1.05f, 0.1f, 0);
+	auto green = arena->make<Material>(glm::vec3(0, 1, 0), 1.05f, 0.1f, 0);
+	auto red = arena->make<Material>(glm::vec3(1, 0, 0), 1.05f, 0.1f, 0);
 
-	auto gold = std::make_shared<Material>(glm::vec3(1, 1, 0), 50, 0.8f, 1);
-	auto silver = std::make_shared<Material>(glm::vec3(1, 1, 1), 1000, 0.8f, 1);
-	auto blue = std::make_shared<Material>(glm::vec3(0.5f, 0.5f, 1), 1.1f, 0.1f, 0);
+	auto gold = arena->make<Material>(glm::vec3(1, 1, 0), 50, 0.8f, 1);
+	auto silver = arena->make<Material>(glm::vec3(1, 1, 1), 1000, 0.8f, 1);
+	auto blue = arena->make<Material>(glm::vec3(0.5f, 0.5f, 1), 1.1f, 0.1f, 0);
 
 
 	// box
 	//
 
 	// bottom
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, -3.2f, 0), glm::vec3(3, .2f, 13)), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, -3.2f, 0), glm::vec3(3, .2f, 13)), white
 	));
 
 	// top
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, 3.2f, 0), glm::vec3(3, .2f, 13)), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, 3.2f, 0), glm::vec3(3, .2f, 13)), white
 	));
 
 	// back
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, 0, -13.2f), glm::vec3(3, 3, .2f)), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, 0, -13.2f), glm::vec3(3, 3, .2f)), white
 	));
 
 	// front
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(0, 0, 13.2f), glm::vec3(3, 3, .2f)), white
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, 0, 13.2f), glm::vec3(3, 3, .2f)), white
 	));
 
 	// right
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(3.2f, 0, 0), glm::vec3(.2f, 3, 13)), green
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(3.2f, 0, 0), glm::vec3(.2f, 3, 13)), green
 	));
 
 	// left
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<AABB>(glm::vec3(-3.2f, 0, 0), glm::vec3(.2f, 3, 13)), red
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(-3.2f, 0, 0), glm::vec3(.2f, 3, 13)), red
 	));
 
 
 	// spheres
 	//
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Sphere>(glm::vec3(1, -2, -7), 1), gold
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(1, -2, -7), 1), gold
 	));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Sphere>(glm::vec3(-1.25, -2.25f, -7), .75f), silver
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(-1.25, -2.25f, -7), .75f), silver
 	));
 
-	objects.push_back(std::make_shared<SceneObject>(
-		std::make_shared<Sphere>(glm::vec3(0, -1.5, -10), 1.5), blue
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(0, -1.5, -10), 1.5), blue
 	));
 
 
 	// lights
-	lights.push_back(std::make_shared<PointLight>(glm::vec3(0, 2.5f, -10), glm::vec3(50), glm::vec3(0.05f)));
+	lights.push_back(arena->make<PointLight>(glm::vec3(0, 2.5f, -10), glm::vec3(50), glm::vec3(0.05f)));
 
-	lights.push_back(std::make_shared<PointLight>(glm::vec3(0, 2.5f, 0), glm::vec3(50), glm::vec3(0.05f)));
+	lights.push_back(arena->make<PointLight>(glm::vec3(0, 2.5f, 0), glm::vec3(50), glm::vec3(0.05f)));
 
-	lights.push_back(std::make_shared<PointLight>(glm::vec3(0, 2.5f, 10), glm::vec3(50), glm::vec3(0.05f)));
+	lights.push_back(arena->make<PointLight>(glm::vec3(0, 2.5f, 10), glm::vec3(50), glm::vec3(0.05f)));
 
 	return Scene(objects, lights);
-}
\ No newline at end of file
+}
+
+
+
+Scene Scene::areaLightScene() {
+	std::vector<std::shared_ptr<SceneObject>> objects;
+	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
+
+	auto white = arena->make<Material>(glm::vec3(1), 1.05f, 0.1f, 0);
+	auto green = arena->make<Material>(glm::vec3(0, 1, 0), 1.05f, 0.1f, 0);
+	auto red = arena->make<Material>(glm::vec3(1, 0, 0), 1.05f, 0.1f, 0);
+
+	auto gold = arena->make<Material>(glm::vec3(1, 1, 0), 50, 0.8f, 1);
+	auto blue = arena->make<Material>(glm::vec3(0.5f, 0.5f, 1), 1.1f, 0.1f, 0);
+
+
+	// box (as the cornell box)
+	//
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, -3.2f, 0), glm::vec3(3, .2f, 13)), white
+	));
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, 3.2f, 0), glm::vec3(3, .2f, 13)), white
+	));
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, 0, -13.2f), glm::vec3(3, 3, .2f)), white
+	));
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(0, 0, 13.2f), glm::vec3(3, 3, .2f)), white
+	));
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(3.2f, 0, 0), glm::vec3(.2f, 3, 13)), green
+	));
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(-3.2f, 0, 0), glm::vec3(.2f, 3, 13)), red
+	));
+
+
+	// objects casting soft shadows
+	//
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(1, -2, -7), 1), gold
+	));
+
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(0, -1.5, -10), 1.5), blue
+	));
+
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(-1.5f, -2.25f, -6), glm::vec3(0.5f, 0.75f, 0.5f)), white
+	));
+
+
+	// lights, each also an object emitting the same radiance
+	//
+	// panel on the ceiling
+	auto panel = arena->make<Rectangle>(glm::vec3(-1, 2.95f, -11), glm::vec3(2, 0, 0), glm::vec3(0, 0, 2));
+	objects.push_back(arena->make<SceneObject>(panel, arena->make<Material>(glm::vec3(0), glm::vec3(0), 1, glm::vec3(2))));
+	lights.push_back(arena->make<RectangleLight>(*panel, glm::vec3(2), glm::vec3(0.05f)));
+
+	// bulb
+	auto bulb = arena->make<Sphere>(glm::vec3(1.5f, 0.5f, -4), 0.3f);
+	objects.push_back(arena->make<SceneObject>(bulb, arena->make<Material>(glm::vec3(0), glm::vec3(0), 1, glm::vec3(8))));
+	lights.push_back(arena->make<SphereLight>(*bulb, glm::vec3(8), glm::vec3(0.05f)));
+
+	// lamp on the left wall
+	auto lamp = arena->make<Disk>(glm::vec3(-2.95f, 0.5f, -8), glm::vec3(1, 0, 0), 0.6f);
+	objects.push_back(arena->make<SceneObject>(lamp, arena->make<Material>(glm::vec3(0), glm::vec3(0), 1, glm::vec3(2))));
+	lights.push_back(arena->make<DiskLight>(*lamp, glm::vec3(2), glm::vec3(0.05f)));
+
+	return Scene(objects, lights);
+}
+
+
+
+Scene Scene::skyScene() {
+	std::vector<std::shared_ptr<SceneObject>> objects;
+	std::vector<std::shared_ptr<Light>> lights;
+	std::shared_ptr<SceneArena> arena = SceneArena::create();
+
+	auto ground = arena->make<Material>(glm::vec3(0.8f), 1.05f, 0.1f, 0);
+	auto red = arena->make<Material>(glm::vec3(1, 0.2f, 0.2f), 1.05f, 0.1f, 0);
+	auto blue = arena->make<Material>(glm::vec3(0.5f, 0.5f, 1), 1.1f, 0.1f, 0);
+	auto silver = arena->make<Material>(glm::vec3(1, 1, 1), 1000, 0.8f, 1);
+
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Plane>(glm::vec3(0, -3, 0), glm::vec3(0, 1, 0)), ground
+	));
+
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(-2, -1.5f, -10), 1.5f), red
+	));
+
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<Sphere>(glm::vec3(1.5f, -2, -8), 1), silver
+	));
+
+	objects.push_back(arena->make<SceneObject>(
+		arena->make<AABB>(glm::vec3(2.5f, -2, -13), glm::vec3(1, 1, 1)), blue
+	));
+
+	// the sky, sun from the back left
+	lights.push_back(arena->make<EnvironmentLight>(skyTexture(glm::vec3(-0.6f, 0.5f, -0.6f)), 0.4f, glm::vec3(0.02f)));
+
+	return Scene(objects, lights);
+}
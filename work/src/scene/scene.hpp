@@ -3,20 +3,42 @@
 
 // std
 #include <memory>
+#include <string>
 #include <vector>
 
 // glm
 #include <glm.hpp>
 
 // project
+#include "animation.hpp"
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
 #include "ray.hpp"
 
 
 // forward declare scene (and components)
 class Light;
+class EnvironmentLight;
 class SceneObject;
 class Shape;
 class Material;
+class PrimitiveSet;
+class OccluderCache;
+
+
+// how the acceleration structure over the static objects is built
+struct BVHOptions {
+	// node format, compressed nodes take half the memory (for large
+	// scenes) but cost more to test
+	BVHFormat format = bvh_wide;
+
+	// fast builds take less time but trace slower
+	BVHQuality quality = bvh_sah;
+
+	// duplicate references allowed by spatial splits, relative to the
+	// number of objects, or 0 for an object partition bvh. sah builds only
+	float split_budget = 0;
+};
 
 
 // Ray intersection class that stores information about a rays
@@ -35,9 +57,44 @@ public:
 	glm::vec3 m_normal;
 	glm::vec2 m_uv_coord; // challenge only!
 
+	// conservative bound on the floating point error in m_position
+	glm::vec3 m_error{ 0 };
+
 	// pointers to the original shape and material
 	Shape * m_shape = nullptr;
 	Material * m_material = nullptr;
+
+	// index of the object in the scene
+	int m_object = -1;
+
+	// time of the ray that hit, rays leaving the surface happen at the same time
+	float m_time = 0;
+
+	// ray leaving the surface in direction d, starting outside the error bound
+	Ray spawnRay(const glm::vec3 &d) const {
+		return Ray(offsetRayOrigin(m_position, m_error, m_normal, d), d, 0, std::numeric_limits<float>::infinity(), m_time);
+	}
+
+	// ray from the surface to the point p, stopping just short of it
+	Ray spawnRayTo(const glm::vec3 &p) const {
+		glm::vec3 o = offsetRayOrigin(m_position, m_error, m_normal, p - m_position);
+		return Ray(o, p - o, 0, 1 - shadow_epsilon, m_time);
+	}
+
+	// fraction of a spawnRayTo ray left short of its target
+	static constexpr float shadow_epsilon = 1e-4f;
+};
+
+
+// Result of the first (cheap) phase of intersecting a scene, the
+// distance to and index of the closest primitive along a ray.
+// Scene::interaction turns it into a full RayIntersection.
+class RayHit {
+public:
+	float m_distance = std::numeric_limits<float>::infinity();
+	int m_primitive = -1;
+
+	bool valid() const { return m_primitive >= 0; }
 };
 
 
@@ -45,23 +102,120 @@ class Scene {
 private:
 	std::vector<std::shared_ptr<SceneObject>> m_objects;
 	std::vector<std::shared_ptr<Light>> m_lights;
+	const EnvironmentLight *m_environment = nullptr; // of m_lights, if any
+
+	// acceleration structure over m_objects and their shapes
+	// (primitive i is the shape of object i), 8 wide for simd node tests
+	WideBVH m_bvh;
+	BVHOptions m_bvh_options;
+	float m_build_seconds = 0; // of m_bvh
+	std::shared_ptr<const PrimitiveSet> m_primitives;
+
+	// unique to each build of the primitives or change of the lights,
+	// shared by copies
+	unsigned long m_generation = 0;
+
+	// objects with motion are left out of m_bvh and kept in a small motion
+	// bvh of their own (over where they are while the shutter is open),
+	// which is only refit (or rebuilt once refitting has made it too loose)
+	// when the shutter changes. their shapes are intersected in the space
+	// they were defined in, at the time of the ray
+	std::vector<Track<Pose>> m_motion; // per object, empty for static objects
+	std::vector<MotionTransform> m_transforms; // per object, over the shutter
+	std::vector<int> m_dynamic; // objects with motion
+	BVH m_dynamic_bvh;
+	float m_dynamic_cost = 0; // of m_dynamic_bvh when it was built
+	float m_shutter_open = 0;
+	float m_shutter_close = 0;
+
+	void build();
+	void updateDynamic(bool rebuild);
+
+	// true if the ray hits primitive prim (at its time, if it moves)
+	bool hitPrimitive(int prim, const Ray &ray) const;
 
 public:
 
 	Scene() { }
 
-	Scene(std::vector<std::shared_ptr<SceneObject>> objects, std::vector<std::shared_ptr<Light>> lights)
-		: m_objects(objects), m_lights(lights) { }
+	Scene(std::vector<std::shared_ptr<SceneObject>> objects, std::vector<std::shared_ptr<Light>> lights);
 
-	// return an intersetion for a ray in the scene
-	RayIntersection intersect(const Ray &ray);
+	// return the closest intersetion for a ray in the scene
+	// within the rays (tmin, tmax] interval
+	RayIntersection intersect(const Ray &ray) { return interaction(ray, closestHit(ray)); }
+
+	// find only the distance and primitive of the closest intersection
+	RayHit closestHit(const Ray &ray) const;
+
+	// fill in the surface attributes and material of a hit from closestHit
+	RayIntersection interaction(const Ray &ray, const RayHit &hit) const;
+
+	// return true if anything intersects the ray, stops at the first
+	// intersection found and never computes surface attributes
+	bool occluded(const Ray &ray) const;
+
+	// occluded for a shadow ray towards a light, testing the primitive
+	// that blocked the last one towards it on this thread first and
+	// remembering what blocks this one, counting into the cache stats
+	bool occluded(const Ray &ray, OccluderCache &cache, int light) const;
 
 	// returns a vector of the objects in the scene
-	std::vector<std::shared_ptr<SceneObject>> objects() const { return m_objects; }
+	const std::vector<std::shared_ptr<SceneObject>> & objects() const { return m_objects; }
 
 	// returns a vector of the lights in the scene
-	std::vector<std::shared_ptr<Light>> lights() const { return m_lights; }
+	const std::vector<std::shared_ptr<Light>> & lights() const { return m_lights; }
+
+	// light the scene by an environment, replacing the one it had (if any),
+	// or by none if null
+	void setEnvironment(std::shared_ptr<EnvironmentLight> environment);
+
+	// radiance seen by a ray that misses the scene, from the environment
+	// light or a constant background without one
+	glm::vec3 background(const Ray &ray) const;
+
+	// keyframe the motion of an object, as an offset from where it was
+	// defined and a rotation about its center. rebuilds the acceleration
+	// structures, so set up motion before rendering
+	void setMotion(int object, const Track<Pose> &motion);
+	bool animated() const { return !m_dynamic.empty(); }
+
+	// move the objects with motion to where they are at time
+	void setTime(float time) { setShutter(time, time); }
+	float time() const { return m_shutter_open; }
+
+	// open the shutter from time open to close, rays with times from 0
+	// to 1 see the objects with motion moving between the two (linearly,
+	// blurring them when sampled over the interval)
+	void setShutter(float open, float close);
+	float shutterOpen() const { return m_shutter_open; }
+	float shutterClose() const { return m_shutter_close; }
 
+	// rebuild the acceleration structure with other options, if they differ
+	void setBVHOptions(const BVHOptions &options);
+	const BVHOptions & bvhOptions() const { return m_bvh_options; }
+	const WideBVH & bvh() const { return m_bvh; }
+
+	// wall time the last build of the acceleration structure took
+	float buildSeconds() const { return m_build_seconds; }
+
+	// changes whenever primitive or light indices may refer to something
+	// else, for caches of them (see OccluderCache)
+	unsigned long generation() const { return m_generation; }
+
+	// copy of the scene with its own acceleration structures and primitives,
+	// the data every ray reads, sharing the rest. replicas made on each numa
+	// node (by a thread there) keep their traversal in local memory
+	Scene replicate() const;
+
+	// memory used by the acceleration structures and primitives
+	size_t bytes() const;
+
+
+	// create one of the scenes below by name : simple, light,
+	// material, shape, cornell, area or sky. throws std::invalid_argument
+	// for an unknown name. their objects, shapes, materials and
+	// lights are made in a SceneArena, each type kept together
+	static Scene fromName(const std::string &name);
 
 	// Simple scene with a single sphere, box, and light.
 	// requires Sphere
@@ -86,4 +240,12 @@ public:
 	// Typical raytracing scene
 	// requires Sphere and PointLight
 	static Scene cornellBoxScene();
+
+	// The cornell box lit by area lights (a rectangle, a sphere
+	// and a disk) instead of point lights, with soft shadows
+	static Scene areaLightScene();
+
+	// Objects on a plane under an open sky, lit only by an
+	// environment light of a sky with a bright sun
+	static Scene skyScene();
 };
\ No newline at end of file
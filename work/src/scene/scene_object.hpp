@@ -22,4 +22,8 @@ private:
 public:
 	SceneObject(std::shared_ptr<Shape> shape, std::shared_ptr<Material> material);
 	RayIntersection intersect(const Ray &ray);
+	Bounds bounds() const { return m_shape->bounds(); }
+
+	Shape * shape() const { return m_shape.get(); }
+	Material * material() const { return m_material.get(); }
 };
\ No newline at end of file
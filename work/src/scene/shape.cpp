@@ -11,73 +11,56 @@
 #include "shape.hpp"
 #include <iostream>
 
-RayIntersection AABB::intersect(const Ray &ray) {
-	RayIntersection intersect;
-	glm::vec3 rel_origin = ray.origin - m_center;
-
-	// start magic
-	// x
-	float rdx_inv = 1 / ray.direction.x;
-	float tx1 = (-m_halfsize.x - rel_origin.x) * rdx_inv;
-	float tx2 = (m_halfsize.x - rel_origin.x) * rdx_inv;
-
-	float tmin = std::min(tx1, tx2);
-	float tmax = std::max(tx1, tx2);
-
-	// y
-	float rdy_inv = 1 / ray.direction.y;
-	float ty1 = (-m_halfsize.y - rel_origin.y) * rdy_inv;
-	float ty2 = (m_halfsize.y - rel_origin.y) * rdy_inv;
-
-	tmin = std::max(tmin, std::min(ty1, ty2));
-	tmax = std::min(tmax, std::max(ty1, ty2));
-
-	// z
-	float rdz_inv = 1 / ray.direction.z;
-	float tz1 = (-m_halfsize.z - rel_origin.z) * rdz_inv;
-	float tz2 = (m_halfsize.z - rel_origin.z) * rdz_inv;
-
-	tmin = std::max(tmin, std::min(tz1, tz2));
-	tmax = std::min(tmax, std::max(tz1, tz2));
+bool AABB::hit(const Ray &ray, float &t) const {
+	// slab test with the rays precomputed reciprocal direction
+	float tmin, tmax;
+	if (!bounds().intersect(ray, tmin, tmax)) return false;
+
+	// entry distance, or exit distance if the ray starts inside
+	t = (tmin > ray.tmin) ? tmin : tmax;
+	return ray.contains(t);
+}
 
-	if (tmax < tmin) return intersect;
-	// end magic
 
-	intersect.m_distance = tmin < 0 ? tmax : tmin;
-	intersect.m_position = ray.origin + intersect.m_distance * ray.direction;
-	intersect.m_valid = tmax >= 0;
+void AABB::interaction(const Ray &ray, float t, RayIntersection &intersect) const {
+	intersect.m_valid = true;
+	intersect.m_distance = t;
+	intersect.m_position = ray.at(t);
 	glm::vec3 work_out_a_name_for_it_later = glm::abs((intersect.m_position - m_center) / m_halfsize);
 	float max_v = std::max(work_out_a_name_for_it_later[0], std::max(work_out_a_name_for_it_later[1], work_out_a_name_for_it_later[2]));
 	intersect.m_normal = glm::normalize(glm::mix(intersect.m_position - m_center, glm::vec3(0), glm::lessThan(work_out_a_name_for_it_later, glm::vec3(max_v))));
 	intersect.m_uv_coord = (glm::abs(intersect.m_normal.x) > 0) ?
 		glm::vec2(intersect.m_position.y, intersect.m_position.z) :
 		glm::vec2(intersect.m_position.x, intersect.m_position.y + intersect.m_position.z);
-	intersect.m_shape = this;
 
-	return intersect;
+	// snap onto the face that was hit so its coordinate is exact,
+	// the others carry the rounding error of evaluating o + t * d
+	int axis = (work_out_a_name_for_it_later.x == max_v) ? 0 : (work_out_a_name_for_it_later.y == max_v) ? 1 : 2;
+	glm::vec3 rel_position = intersect.m_position - m_center;
+	intersect.m_position[axis] = bounds()[rel_position[axis] > 0][axis];
+	intersect.m_error = errorGamma(5) * (glm::abs(ray.origin) + glm::abs(t * ray.direction));
+	intersect.m_error[axis] = 0;
 }
 
 
-RayIntersection Sphere::intersect(const Ray &ray) {
-	RayIntersection intersect;
+Bounds AABB::bounds() const {
+	return Bounds(m_center - m_halfsize, m_center + m_halfsize);
+}
+
 
+bool Sphere::hit(const Ray &ray, float &t) const {
 	glm::vec3 L = ray.origin - m_center;
 	float a = glm::dot(ray.direction, ray.direction);
 	float b = glm::dot(ray.direction, L) * 2.0f;
 	float c = glm::dot(L, L) - (m_radius * m_radius);
 
-	if (glm::isnan(a) || glm::isnan(b) || glm::isnan(c)) {
-		intersect.m_valid = false;
-		return intersect;
-	}
+	if (glm::isnan(a) || glm::isnan(b) || glm::isnan(c)) return false;
 
-	bool invalid = false;
-	float t;
 	float t0 = 0;
 	float t1 = 0;
 	// Solve the quadratic
 	float discrim = b * b - 4 * a * c;
-	if (discrim < 0) invalid = true;
+	if (discrim < 0) return false;
 	else if (discrim == 0) {
 		t0 = t1 = -0.5f * b / a;
 	}
@@ -89,119 +72,226 @@ RayIntersection Sphere::intersect(const Ray &ray) {
 
 	if (t0 > t1) std::swap(t0, t1);
 
-	if (t0 < 0) {
-		t0 = t1;
-		if (t0 < 0) invalid = true;
-	}
-	
-	t = t0;
+	// nearest root inside the rays interval
+	t = ray.contains(t0) ? t0 : t1;
+	return ray.contains(t);
+}
 
-	if (invalid) {
-		intersect.m_valid = false;
-	}
-	else {
-		intersect.m_valid = true;
-		intersect.m_distance = t;
-		intersect.m_position = glm::vec3(ray.origin + ray.direction*t);
-		intersect.m_normal = glm::normalize(intersect.m_position - m_center);
-	}
-	return intersect;
+
+void Sphere::interaction(const Ray &ray, float t, RayIntersection &intersect) const {
+	intersect.m_valid = true;
+	intersect.m_distance = t;
+	intersect.m_position = glm::vec3(ray.origin + ray.direction*t);
+	intersect.m_normal = glm::normalize(intersect.m_position - m_center);
+
+	// reproject onto the surface, which bounds the error by the
+	// radius instead of by the distance travelled along the ray
+	glm::vec3 rel_position = intersect.m_normal * m_radius;
+	intersect.m_position = m_center + rel_position;
+	intersect.m_error = errorGamma(5) * glm::abs(rel_position) + errorGamma(1) * glm::abs(intersect.m_position);
 }
 
-RayIntersection Plane::intersect(const Ray & ray) {
-	RayIntersection intersect;
+Bounds Sphere::bounds() const {
+	return Bounds(m_center - m_radius, m_center + m_radius);
+}
 
-	float t = -1;
+bool Plane::hit(const Ray & ray, float &t) const {
 	float denominator = glm::dot(m_normal, ray.direction);
-	if (denominator == 0) {
-		intersect.m_valid = false;
-		return intersect;
-	}
-	if (glm::abs(denominator) > 1e-6) {
-		float numerator = glm::dot((m_position - ray.origin), m_normal);
-		t = numerator / denominator;
-	}
+	if (glm::abs(denominator) <= 1e-6) return false;
+
+	float numerator = glm::dot((m_position - ray.origin), m_normal);
+	t = numerator / denominator;
+	return ray.contains(t);
+}
 
-	intersect.m_valid = t >= 0;
+void Plane::interaction(const Ray & ray, float t, RayIntersection &intersect) const {
+	intersect.m_valid = true;
 	intersect.m_distance = t;
 	intersect.m_normal = glm::normalize(m_normal);
-	if (denominator > 0) intersect.m_normal *= -1;
+	if (glm::dot(m_normal, ray.direction) > 0) intersect.m_normal *= -1;
 	intersect.m_position = glm::vec3(ray.origin + t*ray.direction);
-
-	return intersect;
+	intersect.m_error = errorGamma(7) * (glm::abs(ray.origin) + glm::abs(t * ray.direction) + glm::abs(m_position));
 }
 
-RayIntersection Disk::intersect(const Ray & ray)
-{
-	RayIntersection intersect;
+Bounds Plane::bounds() const {
+	return Bounds::infinite();
+}
 
-	float t = -1;
+bool Disk::hit(const Ray & ray, float &t) const {
 	float denominator = glm::dot(m_normal, ray.direction);
-	if (denominator == 0) {
-		intersect.m_valid = false;
-		return intersect;
-	}
-	if (glm::abs(denominator) > 1e-6) {
-		float numerator = glm::dot((m_position - ray.origin), m_normal);
-		t = numerator / denominator;
-		glm::vec3 pos = ray.origin + ray.direction*t;
-		if (glm::distance(pos, m_position) >= m_radius) {
-			intersect.m_valid = false;
-			return intersect;
-		}
-	}
+	if (glm::abs(denominator) <= 1e-6) return false;
 
-	intersect.m_valid = t >= 0;
+	float numerator = glm::dot((m_position - ray.origin), m_normal);
+	t = numerator / denominator;
+	if (!ray.contains(t)) return false;
+
+	glm::vec3 pos = ray.origin + ray.direction*t;
+	return glm::distance(pos, m_position) < m_radius;
+}
+
+void Disk::interaction(const Ray & ray, float t, RayIntersection &intersect) const {
+	intersect.m_valid = true;
 	intersect.m_distance = t;
 	intersect.m_normal = glm::normalize(m_normal);
-	if (denominator > 0) intersect.m_normal *= -1;
+	if (glm::dot(m_normal, ray.direction) > 0) intersect.m_normal *= -1;
 	intersect.m_position = glm::vec3(ray.origin + t*ray.direction);
+	intersect.m_error = errorGamma(7) * (glm::abs(ray.origin) + glm::abs(t * ray.direction) + glm::abs(m_position));
+}
 
-	return intersect;
+Bounds Disk::bounds() const {
+	// extent along each axis is the radius scaled by the sine to the normal
+	glm::vec3 n = glm::normalize(m_normal);
+	glm::vec3 e = m_radius * glm::sqrt(glm::max(glm::vec3(1) - n * n, glm::vec3(0)));
+	return Bounds(m_position - e, m_position + e);
 }
 
-RayIntersection Triangle::intersect(const Ray & ray)
-{
-	RayIntersection intersect;
+bool Rectangle::hit(const Ray & ray, float &t) const {
+	float denominator = glm::dot(m_normal, ray.direction);
+	if (glm::abs(denominator) <= 1e-6) return false;
+
+	t = glm::dot(m_corner - ray.origin, m_normal) / denominator;
+	if (!ray.contains(t)) return false;
 
-	glm::vec3 D = ray.direction;
-	glm::vec3 O = ray.origin;
-	glm::vec3 Q = m_v1;
-	glm::vec3 N = glm::cross(m_v2 - m_v1, m_v3 - m_v1);
+	// position along each edge, the edges are at right angles
+	glm::vec3 rel_position = ray.at(t) - m_corner;
+	float u = glm::dot(rel_position, m_edge_u) / glm::dot(m_edge_u, m_edge_u);
+	float v = glm::dot(rel_position, m_edge_v) / glm::dot(m_edge_v, m_edge_v);
+	return u >= 0 && u <= 1 && v >= 0 && v <= 1;
+}
+
+void Rectangle::interaction(const Ray & ray, float t, RayIntersection &intersect) const {
+	intersect.m_valid = true;
+	intersect.m_distance = t;
+	intersect.m_normal = (glm::dot(m_normal, ray.direction) > 0) ? -m_normal : m_normal;
+	intersect.m_position = ray.at(t);
+	glm::vec3 rel_position = intersect.m_position - m_corner;
+	intersect.m_uv_coord = glm::vec2(glm::dot(rel_position, m_edge_u) / glm::dot(m_edge_u, m_edge_u),
+		glm::dot(rel_position, m_edge_v) / glm::dot(m_edge_v, m_edge_v));
+	intersect.m_error = errorGamma(7) * (glm::abs(ray.origin) + glm::abs(t * ray.direction) + glm::abs(m_corner));
+}
 
-	glm::vec3 t1 = (Q - O);
-	float t2 = glm::dot(D, N);
-	float t3 = glm::dot(t1, N);
+Bounds Rectangle::bounds() const {
+	Bounds b(m_corner, m_corner + m_edge_u);
+	b.extend(m_corner + m_edge_v);
+	b.extend(m_corner + m_edge_u + m_edge_v);
+	return b;
+}
 
-	if (glm::abs(t2) < 1e-6) {
-		intersect.m_valid = false;
-		return intersect;
-	}
-	float tPrime = t3 / t2;
-	if (tPrime < 0) {
-		intersect.m_valid = false;
-		return intersect;
+bool Triangle::test(const Ray & ray, float &t, glm::vec3 &b) const
+{
+	// translate vertices to the ray origin
+	glm::vec3 p0t = m_p0 - ray.origin;
+	glm::vec3 p1t = m_p1 - ray.origin;
+	glm::vec3 p2t = m_p2 - ray.origin;
+
+	// permute so the largest direction component is z
+	glm::vec3 ad = glm::abs(ray.direction);
+	int kz = (ad.x > ad.y) ? ((ad.x > ad.z) ? 0 : 2) : ((ad.y > ad.z) ? 1 : 2);
+	int kx = (kz + 1) % 3;
+	int ky = (kx + 1) % 3;
+	glm::vec3 d(ray.direction[kx], ray.direction[ky], ray.direction[kz]);
+	p0t = glm::vec3(p0t[kx], p0t[ky], p0t[kz]);
+	p1t = glm::vec3(p1t[kx], p1t[ky], p1t[kz]);
+	p2t = glm::vec3(p2t[kx], p2t[ky], p2t[kz]);
+
+	// shear so the ray points down +z
+	float sx = -d.x / d.z;
+	float sy = -d.y / d.z;
+	float sz = 1.f / d.z;
+	p0t.x += sx * p0t.z;
+	p0t.y += sy * p0t.z;
+	p1t.x += sx * p1t.z;
+	p1t.y += sy * p1t.z;
+	p2t.x += sx * p2t.z;
+	p2t.y += sy * p2t.z;
+
+	// edge functions, fall back to double precision exactly on an edge
+	float e0 = p1t.x * p2t.y - p1t.y * p2t.x;
+	float e1 = p2t.x * p0t.y - p2t.y * p0t.x;
+	float e2 = p0t.x * p1t.y - p0t.y * p1t.x;
+	if (e0 == 0 || e1 == 0 || e2 == 0) {
+		e0 = float(double(p1t.x) * double(p2t.y) - double(p1t.y) * double(p2t.x));
+		e1 = float(double(p2t.x) * double(p0t.y) - double(p2t.y) * double(p0t.x));
+		e2 = float(double(p0t.x) * double(p1t.y) - double(p0t.y) * double(p1t.x));
 	}
 
-	glm::vec3 pt(O + tPrime*D);
-	glm::vec3 F0 = glm::cross((m_v2 - m_v1), (pt - m_v1));
-	glm::vec3 F1 = glm::cross((m_v3 - m_v2), (pt - m_v2));
-	glm::vec3 F2 = glm::cross((m_v1 - m_v3), (pt - m_v3));
+	if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0)) return false;
+	float det = e0 + e1 + e2;
+	if (det == 0) return false;
+	float inv_det = 1 / det;
+	b = glm::vec3(e0, e1, e2) * inv_det;
+
+	// scaled distance, checked against the ray interval before dividing
+	p0t.z *= sz;
+	p1t.z *= sz;
+	p2t.z *= sz;
+	float t_scaled = e0 * p0t.z + e1 * p1t.z + e2 * p2t.z;
+	if (det < 0 && (t_scaled >= 0 || t_scaled < ray.tmax * det)) return false;
+	if (det > 0 && (t_scaled <= 0 || t_scaled > ray.tmax * det)) return false;
+
+	t = t_scaled * inv_det;
+	return !(t <= ray.tmin);
+}
 
-	float NF0 = glm::dot(N, F0);
-	float NF1 = glm::dot(N, F1);
-	float NF2 = glm::dot(N, F2);
+bool Triangle::hit(const Ray & ray, float &t) const
+{
+	glm::vec3 b;
+	return test(ray, t, b);
+}
 
-	if (NF0 < 0 || NF1 < 0 || NF2 < 0) {
-		intersect.m_valid = false;
-		return intersect;
-	}
+void Triangle::interaction(const Ray & ray, float t, RayIntersection &intersect) const
+{
+	// recompute the barycentrics, cheaper than carrying them for every
+	// candidate. the ray is the one that hit (transformed the same way for
+	// motion), so the edge tests pass again whatever its interval is now
+	glm::vec3 b;
+	float t_test;
+	test(ray, t_test, b);
 
 	intersect.m_valid = true;
-	intersect.m_distance = tPrime;
-	intersect.m_normal = glm::normalize(N);
-	if (t2 > 0) intersect.m_normal *= -1;
-	intersect.m_position = pt;
+	intersect.m_distance = t;
+	intersect.m_position = b[0] * m_p0 + b[1] * m_p1 + b[2] * m_p2;
+	intersect.m_error = errorGamma(7) * (glm::abs(b[0] * m_p0) + glm::abs(b[1] * m_p1) + glm::abs(b[2] * m_p2));
+	intersect.m_normal = (glm::dot(ray.direction, m_normal) > 0) ? -m_normal : m_normal;
+	intersect.m_uv_coord = glm::vec2(b[1], b[2]);
+}
 
-	return intersect;
-}
\ No newline at end of file
+Bounds Triangle::bounds() const {
+	Bounds b(m_p0, m_p1);
+	b.extend(m_p2);
+	return b;
+}
+
+
+Bounds Triangle::clippedBounds(const Bounds &box) const {
+	// clip the triangle against each plane of the box in turn
+	// (sutherland-hodgman), each plane adds at most one vertex
+	glm::vec3 poly[9] = { m_p0, m_p1, m_p2 };
+	int count = 3;
+	for (int plane = 0; plane < 6 && count > 0; plane++) {
+		const int axis = plane / 2;
+		const float d = box[plane % 2][axis];
+		auto inside = [&](const glm::vec3 &p) { return (plane % 2) ? p[axis] <= d : p[axis] >= d; };
+		glm::vec3 clipped[9];
+		int clipped_count = 0;
+		for (int i = 0; i < count; i++) {
+			const glm::vec3 &a = poly[i], &b = poly[(i + 1) % count];
+			if (inside(a)) clipped[clipped_count++] = a;
+			if (inside(a) != inside(b)) {
+				glm::vec3 p = glm::mix(a, b, (d - a[axis]) / (b[axis] - a[axis]));
+				p[axis] = d;
+				clipped[clipped_count++] = p;
+			}
+		}
+		count = std::min(clipped_count, 9);
+		std::copy(clipped, clipped + count, poly);
+	}
+
+	Bounds b;
+	for (int i = 0; i < count; i++) b.extend(poly[i]);
+	if (b.empty()) return b;
+
+	// padded for the rounding of the clipped vertices
+	glm::vec3 e = errorGamma(4) * glm::max(glm::abs(b.min), glm::abs(b.max));
+	return Bounds(b.min - e, b.max + e).intersection(box).intersection(bounds());
+}
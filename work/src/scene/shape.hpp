@@ -1,21 +1,49 @@
-
 #pragma once
 
 // glm
 #include <glm.hpp>
 
 // project
+#include "bounds.hpp"
 #include "ray.hpp"
 #include "scene.hpp"
 
 
+// Base class for shapes, intersections are only reported
+// inside the (tmin, tmax] interval of the given ray.
+// Intersection is split in two phases so the attributes of
+// the surface are only computed for the closest hit :
+// - hit only finds the distance to the surface
+// - interaction fills in the surface attributes at a distance from hit
 class Shape {
 public:
-	virtual RayIntersection intersect(const Ray &ray) = 0;
+	virtual bool hit(const Ray &ray, float &t) const = 0;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const = 0;
+
+	// world space bounds, infinite for unbounded shapes
+	virtual Bounds bounds() const = 0;
+
+	// bounds of the part of the shape inside box, for splitting it between
+	// the nodes of a split bvh. the overlap with bounds() unless overridden
+	virtual Bounds clippedBounds(const Bounds &box) const { return bounds().intersection(box); }
+
+	// both phases together
+	RayIntersection intersect(const Ray &ray) {
+		RayIntersection intersect;
+		float t;
+		if (hit(ray, t)) {
+			interaction(ray, t, intersect);
+			intersect.m_shape = this;
+		}
+		return intersect;
+	}
 };
 
 
-class AABB : public Shape {
+// The shapes below are final so calls through the concrete
+// type (see PrimitiveSet) are dispatched statically
+
+class AABB final : public Shape {
 private:
 	glm::vec3 m_center;
 	glm::vec3 m_halfsize;
@@ -23,48 +51,97 @@ private:
 public:
 	AABB(const glm::vec3 &c, float hs) : m_center(c), m_halfsize(hs) { }
 	AABB(const glm::vec3 &c, const glm::vec3 &hs) : m_center(c), m_halfsize(hs) { }
-	virtual RayIntersection intersect(const Ray &ray) override;
+	virtual bool hit(const Ray &ray, float &t) const override;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const override;
+	virtual Bounds bounds() const override;
 };
 
 
-class Sphere : public Shape {
+class Sphere final : public Shape {
 private:
 	glm::vec3 m_center;
 	float m_radius;
 
 public:
 	Sphere(const glm::vec3 &c, float radius) : m_center(c), m_radius(radius) { }
-	virtual RayIntersection intersect(const Ray &ray) override;
+	glm::vec3 center() const { return m_center; }
+	float radius() const { return m_radius; }
+	virtual bool hit(const Ray &ray, float &t) const override;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const override;
+	virtual Bounds bounds() const override;
 };
 
-class Plane : public Shape {
+class Plane final : public Shape {
 private:
 	glm::vec3 m_position; // Any position on the plane
 	glm::vec3 m_normal; // A vector that represents the direction the plane faces
 
 public:
-	Plane(const glm::vec3 &pos, glm::vec3 &norm) : m_position(pos), m_normal(norm) { }
-	virtual RayIntersection intersect(const Ray &ray) override;
+	Plane(const glm::vec3 &pos, const glm::vec3 &norm) : m_position(pos), m_normal(norm) { }
+	virtual bool hit(const Ray &ray, float &t) const override;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const override;
+	virtual Bounds bounds() const override;
 };
 
-class Disk : public Shape {
+class Disk final : public Shape {
 private:
 	glm::vec3 m_position; // Any position on the disc
 	glm::vec3 m_normal; // A vector that represents the direction the disk faces
 	float m_radius;
 public:
-	Disk(const glm::vec3 &pos, glm::vec3 &norm, float r) : m_position(pos), m_normal(norm), m_radius(r) { }
-	virtual RayIntersection intersect(const Ray &ray) override;
+	Disk(const glm::vec3 &pos, const glm::vec3 &norm, float r) : m_position(pos), m_normal(norm), m_radius(r) { }
+	glm::vec3 center() const { return m_position; }
+	glm::vec3 normal() const { return glm::normalize(m_normal); }
+	float radius() const { return m_radius; }
+	virtual bool hit(const Ray &ray, float &t) const override;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const override;
+	virtual Bounds bounds() const override;
+};
+
+// Rectangle spanned by two edges at right angles from a corner,
+// intersections return the position along each edge (0 to 1) in m_uv_coord
+class Rectangle final : public Shape {
+private:
+	glm::vec3 m_corner;
+	glm::vec3 m_edge_u;
+	glm::vec3 m_edge_v;
+	glm::vec3 m_normal;
+
+public:
+	Rectangle(const glm::vec3 &corner, const glm::vec3 &edge_u, const glm::vec3 &edge_v)
+		: m_corner(corner), m_edge_u(edge_u), m_edge_v(edge_v), m_normal(glm::normalize(glm::cross(edge_u, edge_v))) { }
+	glm::vec3 corner() const { return m_corner; }
+	glm::vec3 edgeU() const { return m_edge_u; }
+	glm::vec3 edgeV() const { return m_edge_v; }
+	glm::vec3 normal() const { return m_normal; }
+	virtual bool hit(const Ray &ray, float &t) const override;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const override;
+	virtual Bounds bounds() const override;
 };
 
-class Triangle : public Shape {
+// Watertight triangle (Woop et al. 2013), no ray passes between triangles
+// sharing an edge. Stores the vertices and the unit normal in 48 bytes,
+// intersections return the barycentrics (b1, b2) in m_uv_coord for
+// interpolating vertex attributes.
+class Triangle final : public Shape {
 private:
-	glm::vec3 m_v1;
-	glm::vec3 m_v2;
-	glm::vec3 m_v3;
+	glm::vec3 m_p0;
+	glm::vec3 m_p1;
+	glm::vec3 m_p2;
+	glm::vec3 m_normal;
+
+	// shared by hit and interaction. b holds the barycentrics, set before
+	// the distance is checked against the ray interval (they only depend on
+	// the ray origin and direction) so a ray that hit always gets them
+	bool test(const Ray &ray, float &t, glm::vec3 &b) const;
+
 public:
-	Triangle(const glm::vec3 &v1, const glm::vec3 &v2, const glm::vec3 &v3) : m_v1(v1), m_v2(v2), m_v3(v3) { }
-	virtual RayIntersection intersect(const Ray &ray) override;
+	Triangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+		: m_p0(p0), m_p1(p1), m_p2(p2), m_normal(glm::normalize(glm::cross(p1 - p0, p2 - p0))) { }
+	virtual bool hit(const Ray &ray, float &t) const override;
+	virtual void interaction(const Ray &ray, float t, RayIntersection &intersect) const override;
+	virtual Bounds bounds() const override;
+	virtual Bounds clippedBounds(const Bounds &box) const override;
 };
 
 //-------------------------------------------------------------
@@ -75,9 +152,8 @@ public:
 // - Triangle
 // Follow the pattern shown by AABB and Sphere for implementing
 // a class that subclasses Shape making sure that you implement
-// the intersect method for each new Shape.
+// the hit and interaction methods for each new Shape.
 //-------------------------------------------------------------
 
 // YOUR CODE GOES HERE
 // ...
-
@@ -3,7 +3,9 @@
 
 // std
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 // glm
@@ -22,11 +24,24 @@ public:
 	Texture() {}
 
 	// create a texture from a file
-	// supports JPEG, PNG, TGA, BMP and a few others
+	// supports JPEG, PNG, TGA, BMP and a few others, and Radiance HDR
+	// images, which are kept as the floats they hold (unclamped)
 	Texture(const std::string &filename) {
 		int w, h, n;
 
 		stbi_set_flip_vertically_on_load(true);
+		if (stbi_is_hdr(filename.c_str())) {
+			float *img = stbi_loadf(filename.c_str(), &w, &h, &n, 3);
+			if (!img) {
+				std::cerr << "Error: Failed to load image " << filename << " : " << stbi_failure_reason();
+				throw std::runtime_error("Failed to load image " + filename);
+			}
+			m_data = std::vector<float>(img, img + w * h * 3);
+			m_size = glm::ivec2(w, h);
+			stbi_image_free(img);
+			return;
+		}
+
 		unsigned char *img = stbi_load(filename.c_str(), &w, &h, &n, 3);
 
 		if (!img) {
@@ -41,6 +56,13 @@ public:
 		stbi_image_free(img);
 	}
 
+	// create a texture from rgb floats, row by row from the bottom
+	Texture(const glm::ivec2 &size, std::vector<float> data) : m_size(size), m_data(std::move(data)) {
+		if (m_data.size() != size_t(size.x) * size.y * 3) throw std::invalid_argument("Texture data does not match its size");
+	}
+
+	glm::ivec2 size() const { return m_size; }
+
 
 	// fetch the value of a single channel of a texel
 	float texel(float x, float y, int n) const {
@@ -60,6 +82,11 @@ public:
 		return texel(float(p.x), float(p.y), n);
 	}
 
+	// fetch the value of a texel
+	glm::vec3 texel(const glm::ivec2 &p) const {
+		return glm::vec3(texel(p, 0), texel(p, 1), texel(p, 2));
+	}
+
 	// sample given a range of uv in [0, 1]^2
 	// provides wrapping for values outside that range
 	glm::vec3 sample(float u, float v) const {
@@ -0,0 +1,145 @@
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// project
+#include "wide_bvh.hpp"
+
+
+namespace {
+	const char *format_names[bvh_format_count] = { "wide", "compressed" };
+}
+
+
+const char * bvhFormatName(BVHFormat f) {
+	return format_names[f];
+}
+
+
+BVHFormat bvhFormatFromName(const std::string &name) {
+	for (int f = 0; f < bvh_format_count; f++) {
+		if (name == format_names[f]) return BVHFormat(f);
+	}
+	throw std::invalid_argument("Unknown BVH format " + name);
+}
+
+
+void WideBVH::build(const std::vector<Bounds> &prim_bounds, BVHFormat format) {
+	build(BVH(prim_bounds), format);
+}
+
+
+void WideBVH::build(const BVH &bvh, BVHFormat format) {
+	static_assert(sizeof(QuantizedNode) == 128, "compressed nodes should fill two cache lines");
+	m_nodes.clear();
+	m_quantized.clear();
+	m_indices = bvh.indices();
+	m_unbounded = bvh.unbounded();
+	if (bvh.nodes().empty()) return;
+	m_nodes.reserve(bvh.nodes().size() / 4 + 1);
+	collapse(bvh, 0);
+
+	if (format == bvh_compressed) {
+		m_quantized.reserve(m_nodes.size());
+		for (const Node &node : m_nodes) {
+			int lanes = 0;
+			while (lanes < width && node.bounds[0][lanes] <= node.bounds[1][lanes]) lanes++;
+			m_quantized.push_back(quantize(node, lanes));
+		}
+		m_nodes.clear();
+		m_nodes.shrink_to_fit();
+	}
+}
+
+
+WideBVH::QuantizedNode WideBVH::quantize(const Node &node, int lanes) {
+	QuantizedNode q;
+	q.lanes = (unsigned char)(lanes);
+	for (int a = 0; a < 3; a++) {
+		const float *lo = node.bounds[2 * a], *hi = node.bounds[2 * a + 1];
+		const float origin = *std::min_element(lo, lo + lanes);
+		const float max = *std::max_element(hi, hi + lanes);
+
+		// smallest power of two grid spanning the node in 255 steps
+		int exponent;
+		std::frexp((max - origin) / 255, &exponent);
+		exponent = std::max(exponent - 1, -126);
+		while (origin + 255 * std::ldexp(1.f, exponent) < max) exponent++;
+		const float scale = std::ldexp(1.f, exponent);
+		q.origin[a] = origin;
+		q.scale[a] = scale;
+
+		// rounded outwards, checked against the decoded value
+		for (int lane = 0; lane < width; lane++) {
+			int qlo = 0, qhi = 0;
+			if (lane < lanes) {
+				qlo = std::min(std::max(int(std::floor((lo[lane] - origin) / scale)), 0), 255);
+				while (qlo > 0 && origin + qlo * scale > lo[lane]) qlo--;
+				qhi = std::min(std::max(int(std::ceil((hi[lane] - origin) / scale)), 0), 255);
+				while (qhi < 255 && origin + qhi * scale < hi[lane]) qhi++;
+			}
+			q.bounds[2 * a][lane] = (unsigned char)(qlo);
+			q.bounds[2 * a + 1][lane] = (unsigned char)(qhi);
+		}
+	}
+	std::copy(node.child, node.child + width, q.child);
+	std::copy(node.count, node.count + width, q.count);
+	return q;
+}
+
+
+int WideBVH::collapse(const BVH &bvh, int binary_node) {
+	const std::vector<BVH::Node> &binary = bvh.nodes();
+
+	// open the interior child with the largest surface area until there
+	// are as many children as lanes (a leaf root is the only child)
+	int children[width] = { binary_node };
+	int count = 1;
+	if (binary[binary_node].count == 0) {
+		children[0] = binary_node + 1;
+		children[1] = binary[binary_node].offset;
+		count = 2;
+	}
+	while (count < width) {
+		int open = -1;
+		float area = -1;
+		for (int i = 0; i < count; i++) {
+			const BVH::Node &n = binary[children[i]];
+			if (n.count == 0 && n.bounds.surfaceArea() > area) {
+				open = i;
+				area = n.bounds.surfaceArea();
+			}
+		}
+		if (open < 0) break;
+		const int n = children[open];
+		children[open] = n + 1;
+		children[count++] = binary[n].offset;
+	}
+
+	const int index = int(m_nodes.size());
+	m_nodes.emplace_back();
+	Node node;
+	for (int lane = 0; lane < width; lane++) {
+		const Bounds b = (lane < count) ? binary[children[lane]].bounds : Bounds();
+		for (int a = 0; a < 3; a++) {
+			node.bounds[2 * a][lane] = b.min[a];
+			node.bounds[2 * a + 1][lane] = b.max[a];
+		}
+		node.child[lane] = 0;
+		node.count[lane] = 0;
+	}
+
+	// children follow their parent depth first, as in the binary tree
+	for (int lane = 0; lane < count; lane++) {
+		const BVH::Node &n = binary[children[lane]];
+		if (n.count > 0) {
+			node.child[lane] = n.offset;
+			node.count[lane] = n.count;
+		} else {
+			node.child[lane] = collapse(bvh, children[lane]);
+		}
+	}
+	m_nodes[index] = node;
+	return index;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+// std
+#include <limits>
+#include <string>
+#include <vector>
+
+// simd
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define CGRA_WIDE_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+// project
+#include "bounds.hpp"
+#include "bvh.hpp"
+#include "ray.hpp"
+
+
+// node formats of a WideBVH
+enum BVHFormat : int {
+	bvh_wide,       // float child bounds, 256 bytes per node
+	bvh_compressed, // 8 bit child bounds, 128 bytes per node
+	bvh_format_count
+};
+
+// name of a format, and the format by name (throws std::invalid_argument)
+const char * bvhFormatName(BVHFormat f);
+BVHFormat bvhFormatFromName(const std::string &name);
+
+
+// Bounding volume hierarchy with 8 children per node, collapsed from a
+// binary BVH by repeatedly opening the child with the largest surface area.
+// The bounds of the children are stored as structure of arrays so a ray is
+// tested against all of them at once (with AVX2 when built for it, as two
+// halves with SSE otherwise, or lane by lane without either). Children that are hit are pushed
+// by distance so the nearest is traversed first, and anything further than
+// the closest hit found so far is skipped when it comes off the stack.
+// Compressed nodes quantize the child bounds to 8 bits on a power of two
+// grid from the min corner of the node, rounded outwards, so they only
+// ever grow. Decoding (a scale that is exact and a single add) gives the
+// same floats when building and traversing, keeping them conservative.
+// Static only, rebuild it when the primitives move.
+class WideBVH {
+public:
+	static const int width = 8;
+
+	struct alignas(32) Node {
+		// child bounds per lane, min and max of each axis (2 * axis + side,
+		// as Bounds::operator[]), empty for unused lanes
+		float bounds[6][width];
+		int child[width]; // node (interior) or first primitive (leaf)
+		unsigned short count[width]; // number of primitives, 0 for interior children
+	};
+
+	struct alignas(64) QuantizedNode {
+		// child bounds are origin + q * scale per axis, scale a power of two
+		float origin[3];
+		float scale[3];
+		unsigned char lanes; // children used, first in the node
+		unsigned char bounds[6][width];
+		int child[width];
+		unsigned short count[width];
+	};
+
+private:
+	std::vector<Node> m_nodes; // unless compressed
+	std::vector<QuantizedNode> m_quantized; // if compressed
+	std::vector<int> m_indices;
+	std::vector<int> m_unbounded;
+
+	// push the (at most 7) children beyond the one being traversed per level
+	static const int stack_size = (width - 1) * 64 + 1;
+
+	int collapse(const BVH &bvh, int binary_node);
+	static QuantizedNode quantize(const Node &node, int lanes);
+
+	// lanes of node whose bounds the ray passes through, and their entry
+	// distances (t0 aligned to 32 bytes)
+	static unsigned intersect(const Node &node, const Ray &ray, float *t0) {
+#ifdef __AVX2__
+		const __m256 origin[3] = { _mm256_set1_ps(ray.origin.x), _mm256_set1_ps(ray.origin.y), _mm256_set1_ps(ray.origin.z) };
+		const __m256 inv[3] = { _mm256_set1_ps(ray.inv_direction.x), _mm256_set1_ps(ray.inv_direction.y), _mm256_set1_ps(ray.inv_direction.z) };
+		const __m256 pad = _mm256_set1_ps(1 + 2 * errorGamma(3));
+		// max(b, a) is b > a ? b : a, so as Bounds::intersect NaNs never tighten the interval
+		__m256 entry = _mm256_set1_ps(ray.tmin);
+		__m256 exit = _mm256_set1_ps(ray.tmax);
+		for (int a = 0; a < 3; a++) {
+			const __m256 near = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[2 * a + ray.sign[a]]), origin[a]), inv[a]);
+			const __m256 far = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[2 * a + 1 - ray.sign[a]]), origin[a]), inv[a]), pad);
+			entry = _mm256_max_ps(near, entry);
+			exit = _mm256_min_ps(far, exit);
+		}
+		__m256 hit = _mm256_cmp_ps(entry, exit, _CMP_LE_OQ);
+		_mm256_store_ps(t0, entry);
+		return unsigned(_mm256_movemask_ps(hit));
+#elif defined(CGRA_WIDE_BVH_SSE)
+		const __m128 origin[3] = { _mm_set1_ps(ray.origin.x), _mm_set1_ps(ray.origin.y), _mm_set1_ps(ray.origin.z) };
+		const __m128 inv[3] = { _mm_set1_ps(ray.inv_direction.x), _mm_set1_ps(ray.inv_direction.y), _mm_set1_ps(ray.inv_direction.z) };
+		const __m128 pad = _mm_set1_ps(1 + 2 * errorGamma(3));
+		unsigned mask = 0;
+		for (int half = 0; half < width; half += 4) {
+			__m128 entry = _mm_set1_ps(ray.tmin);
+			__m128 exit = _mm_set1_ps(ray.tmax);
+			for (int a = 0; a < 3; a++) {
+				const __m128 near = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[2 * a + ray.sign[a]] + half), origin[a]), inv[a]);
+				const __m128 far = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[2 * a + 1 - ray.sign[a]] + half), origin[a]), inv[a]), pad);
+				entry = _mm_max_ps(near, entry);
+				exit = _mm_min_ps(far, exit);
+			}
+			__m128 hit = _mm_cmple_ps(entry, exit);
+			_mm_store_ps(t0 + half, entry);
+			mask |= unsigned(_mm_movemask_ps(hit)) << half;
+		}
+		return mask;
+#else
+		const float pad = 1 + 2 * errorGamma(3);
+		unsigned mask = 0;
+		for (int i = 0; i < width; i++) {
+			float t1 = ray.tmax;
+			t0[i] = ray.tmin;
+			for (int a = 0; a < 3; a++) {
+				const float near = (node.bounds[2 * a + ray.sign[a]][i] - ray.origin[a]) * ray.inv_direction[a];
+				const float far = (node.bounds[2 * a + 1 - ray.sign[a]][i] - ray.origin[a]) * ray.inv_direction[a] * pad;
+				if (near > t0[i]) t0[i] = near;
+				if (far < t1) t1 = far;
+			}
+			if (t0[i] <= t1) mask |= 1u << i;
+		}
+		return mask;
+#endif
+	}
+
+	static unsigned intersect(const QuantizedNode &node, const Ray &ray, float *t0) {
+		Node decoded;
+		for (int i = 0; i < 6; i++) {
+			const float origin = node.origin[i / 2];
+			const float scale = node.scale[i / 2];
+#if defined(__AVX2__)
+			const __m256 q = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(node.bounds[i]))));
+			_mm256_store_ps(decoded.bounds[i], _mm256_add_ps(_mm256_set1_ps(origin), _mm256_mul_ps(q, _mm256_set1_ps(scale))));
+#elif defined(CGRA_WIDE_BVH_SSE)
+			const __m128i q16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(node.bounds[i])), _mm_setzero_si128());
+			const __m128 q[2] = { _mm_cvtepi32_ps(_mm_unpacklo_epi16(q16, _mm_setzero_si128())), _mm_cvtepi32_ps(_mm_unpackhi_epi16(q16, _mm_setzero_si128())) };
+			for (int half = 0; half < 2; half++) {
+				_mm_store_ps(decoded.bounds[i] + 4 * half, _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(q[half], _mm_set1_ps(scale))));
+			}
+#else
+			for (int lane = 0; lane < width; lane++) decoded.bounds[i][lane] = origin + node.bounds[i][lane] * scale;
+#endif
+		}
+		return intersect(decoded, ray, t0) & ((1u << node.lanes) - 1);
+	}
+
+	// counting the nodes visited into visited if counting is set
+	template <bool counting, typename Nodes, typename Visit>
+	void traverse(const Nodes &nodes, const Ray &ray, Visit &&visit, int &visited) const;
+
+public:
+	WideBVH() { }
+	WideBVH(const std::vector<Bounds> &prim_bounds, BVHFormat format = bvh_wide) { build(prim_bounds, format); }
+
+	// build a binary BVH over the primitives and collapse it
+	void build(const std::vector<Bounds> &prim_bounds, BVHFormat format = bvh_wide);
+	void build(const BVH &bvh, BVHFormat format = bvh_wide);
+
+	BVHFormat format() const { return m_quantized.empty() ? bvh_wide : bvh_compressed; }
+	int nodeCount() const { return int(m_nodes.size() + m_quantized.size()); }
+
+	// memory used by the tree, in total and per primitive
+	size_t bytes() const {
+		return m_nodes.size() * sizeof(Node) + m_quantized.size() * sizeof(QuantizedNode)
+			+ (m_indices.size() + m_unbounded.size()) * sizeof(int);
+	}
+	float bytesPerPrimitive() const {
+		const size_t prims = m_indices.size() + m_unbounded.size();
+		return prims ? float(bytes()) / prims : 0;
+	}
+
+	// Calls visit(prim) for the primitives whose bounds the ray passes through,
+	// as BVH::traverse, visiting the nearer children first.
+	template <typename Visit>
+	void traverse(const Ray &ray, Visit &&visit) const {
+		int visited = 0;
+		for (int prim : m_unbounded) {
+			if (visit(prim)) return;
+		}
+		if (!m_nodes.empty()) traverse<false>(m_nodes, ray, visit, visited);
+		else if (!m_quantized.empty()) traverse<false>(m_quantized, ray, visit, visited);
+	}
+
+	// as traverse, adding the number of nodes visited to visited
+	template <typename Visit>
+	void traverse(const Ray &ray, Visit &&visit, int &visited) const {
+		for (int prim : m_unbounded) {
+			if (visit(prim)) return;
+		}
+		if (!m_nodes.empty()) traverse<true>(m_nodes, ray, visit, visited);
+		else if (!m_quantized.empty()) traverse<true>(m_quantized, ray, visit, visited);
+	}
+};
+
+
+template <bool counting, typename Nodes, typename Visit>
+void WideBVH::traverse(const Nodes &nodes, const Ray &ray, Visit &&visit, int &visited) const {
+	// children to traverse, with the distance they were entered at
+	struct Entry {
+		float t;
+		int child;
+		int count;
+	};
+	Entry stack[stack_size];
+	int top = 0;
+	stack[top++] = { -std::numeric_limits<float>::infinity(), 0, 0 };
+	while (top > 0) {
+		const Entry entry = stack[--top];
+		if (entry.t > ray.tmax) continue; // beyond a closer hit found since it was pushed
+		if (entry.count > 0) {
+			for (int i = entry.child; i < entry.child + entry.count; i++) {
+				if (visit(m_indices[i])) return;
+			}
+			continue;
+		}
+
+		const auto &node = nodes[entry.child];
+		if (counting) visited++;
+		alignas(32) float t0[width];
+		unsigned mask = intersect(node, ray, t0);
+
+		// sort the hit lanes far to near (at most 8, by insertion) so
+		// the nearest ends up on top of the stack
+		const int base = top;
+		for (int lane = 0; lane < width; lane++) {
+			if (!(mask & (1u << lane))) continue;
+			const Entry e = { t0[lane], node.child[lane], node.count[lane] };
+			int j = top++;
+			for (; j > base && stack[j - 1].t < e.t; j--) stack[j] = stack[j - 1];
+			stack[j] = e;
+		}
+	}
+}